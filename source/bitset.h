@@ -0,0 +1,193 @@
+/*
+ * bitset.h: word-parallel sets of small integers.
+ *
+ * Solvers spend much of their time asking questions like `which of
+ * these candidates are still possible' or `do these two sets of
+ * positions overlap'. Stored one byte per element, answering those
+ * means a loop per element; stored as bits, it means a loop per
+ * machine word, and popcount and find-first become single
+ * instructions on compilers which provide them.
+ *
+ * A set over n elements is an array of BS_WORDS(n) bitwords, element
+ * i being bit (i % BS_BITS) of word (i / BS_BITS). Bits beyond n in
+ * the last word must be kept clear, since the counting functions
+ * count them. Sets small enough to fit in one word can use the bw_*
+ * functions on a plain bitword instead.
+ *
+ * The row operations are straight loops over words with no
+ * aliasing between source and destination other than exact
+ * overlap, so that a vectorising compiler can turn them into 128- or
+ * 256-bit operations where the target has them.
+ *
+ * Everything here is inline, so there is no bitset.c.
+ */
+
+#ifndef BITSET_H
+#define BITSET_H
+
+typedef unsigned long bitword;
+
+#define BS_BITS ((int)(8 * sizeof(bitword)))
+#define BS_WORDS(n) (((n) + BS_BITS - 1) / BS_BITS)
+#define BS_BIT(i) ((bitword)1 << ((i) % BS_BITS))
+
+#define BS_TEST(bs, i) (((bs)[(i) / BS_BITS] & BS_BIT(i)) != 0)
+#define BS_SET(bs, i) ((bs)[(i) / BS_BITS] |= BS_BIT(i))
+#define BS_CLEAR(bs, i) ((bs)[(i) / BS_BITS] &= ~BS_BIT(i))
+
+#ifdef __GNUC__
+#define BS_INLINE static __inline__
+#else
+#define BS_INLINE static
+#endif
+
+/* ----------------------------------------------------------------------
+ * Single-word masks.
+ */
+
+/* Number of set bits. */
+BS_INLINE int bw_count(bitword w)
+{
+#ifdef __GNUC__
+    return __builtin_popcountl(w);
+#else
+    int n = 0;
+    while (w) {
+        w &= w - 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* Index of the lowest set bit, or -1 if there are none. */
+BS_INLINE int bw_first(bitword w)
+{
+#ifdef __GNUC__
+    return w ? __builtin_ctzl(w) : -1;
+#else
+    int i = 0;
+    if (!w)
+        return -1;
+    while (!(w & 1)) {
+        w >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/* ----------------------------------------------------------------------
+ * Multi-word sets. nw is the length in words, i.e. BS_WORDS(n).
+ */
+
+BS_INLINE void bs_zero(bitword *bs, int nw)
+{
+    int i;
+    for (i = 0; i < nw; i++)
+        bs[i] = 0;
+}
+
+BS_INLINE void bs_copy(bitword *dst, const bitword *src, int nw)
+{
+    int i;
+    for (i = 0; i < nw; i++)
+        dst[i] = src[i];
+}
+
+BS_INLINE int bs_count(const bitword *bs, int nw)
+{
+    int i, n = 0;
+    for (i = 0; i < nw; i++)
+        n += bw_count(bs[i]);
+    return n;
+}
+
+/* Index of the first set bit at or after `from', or -1. */
+BS_INLINE int bs_next(const bitword *bs, int nw, int from)
+{
+    int i = from / BS_BITS;
+    bitword w;
+
+    if (i >= nw)
+        return -1;
+    w = bs[i] & (~(bitword)0 << (from % BS_BITS));
+    while (!w) {
+        if (++i >= nw)
+            return -1;
+        w = bs[i];
+    }
+    return i * BS_BITS + bw_first(w);
+}
+
+BS_INLINE int bs_first(const bitword *bs, int nw)
+{
+    return bs_next(bs, nw, 0);
+}
+
+BS_INLINE int bs_isempty(const bitword *bs, int nw)
+{
+    int i;
+    for (i = 0; i < nw; i++)
+        if (bs[i])
+            return FALSE;
+    return TRUE;
+}
+
+/* TRUE if a and b have any element in common. */
+BS_INLINE int bs_intersects(const bitword *a, const bitword *b, int nw)
+{
+    int i;
+    for (i = 0; i < nw; i++)
+        if (a[i] & b[i])
+            return TRUE;
+    return FALSE;
+}
+
+/* dst = a & b, dst = a | b, dst = a & ~b. dst may be a or b. */
+BS_INLINE void bs_and(bitword *dst, const bitword *a, const bitword *b,
+                      int nw)
+{
+    int i;
+    for (i = 0; i < nw; i++)
+        dst[i] = a[i] & b[i];
+}
+
+BS_INLINE void bs_or(bitword *dst, const bitword *a, const bitword *b,
+                     int nw)
+{
+    int i;
+    for (i = 0; i < nw; i++)
+        dst[i] = a[i] | b[i];
+}
+
+BS_INLINE void bs_andnot(bitword *dst, const bitword *a, const bitword *b,
+                         int nw)
+{
+    int i;
+    for (i = 0; i < nw; i++)
+        dst[i] = a[i] & ~b[i];
+}
+
+/*
+ * Treat an n-bit set as a binary number, element 0 being the least
+ * significant bit, and add one to it. Returns FALSE, leaving the set
+ * empty, if it wraps round; so starting from the empty set and
+ * looping until this returns FALSE visits every subset of n
+ * elements once.
+ */
+BS_INLINE int bs_increment(bitword *bs, int n)
+{
+    int i, nw = BS_WORDS(n);
+
+    for (i = 0; i < nw; i++)
+        if (++bs[i])
+            break;
+    if (n % BS_BITS && (bs[nw-1] >> (n % BS_BITS))) {
+        bs[nw-1] = 0;
+        return FALSE;
+    }
+    return i < nw;
+}
+
+#endif
@@ -76,8 +76,11 @@ struct game_params {
 
 typedef unsigned int grid_type; /* change me later if we invent > 16 bits of flags. */
 
+/* Scratch space shared between all the states in a game, since it's
+ * only ever used within a single call. */
 struct solver_state {
     int *dsf, *tmpdsf;
+    grid_type *scratch;
     int refcount;
 };
 
@@ -99,7 +102,7 @@ struct island {
 
 struct game_state {
     int w, h, completed, solved, allowloops, maxb;
-    grid_type *grid, *scratch;
+    grid_type *grid;
     struct island *islands;
     int n_islands, n_islands_alloc;
     game_params params; /* used by the aux solver. */
@@ -118,7 +121,7 @@ struct game_state {
 #define INDEX(s,g,x,y) ((s)->g[(y)*((s)->w) + (x)])
 #define IDX(s,g,i) ((s)->g[(i)])
 #define GRID(s,x,y) INDEX(s,grid,x,y)
-#define SCRATCH(s,x,y) INDEX(s,scratch,x,y)
+#define SCRATCH(s,x,y) ((s)->solver->scratch[(y)*((s)->w) + (x)])
 #define POSSIBLES(s,dx,x,y) ((dx) ? (INDEX(s,possh,x,y)) : (INDEX(s,possv,x,y)))
 #define MAXIMUM(s,dx,x,y) ((dx) ? (INDEX(s,maxh,x,y)) : (INDEX(s,maxv,x,y)))
 
@@ -1020,7 +1023,7 @@ static int map_hasloops(game_state *state, int mark)
 {
     int x, y, ox, oy, nx = 0, ny = 0, loop = 0;
 
-    memcpy(state->scratch, state->grid, GRIDSZ(state));
+    memcpy(state->solver->scratch, state->grid, GRIDSZ(state));
 
     /* This algorithm is actually broken; if there are two loops connected
      * by bridges this will also highlight bridges. The correct algorithm
@@ -1582,8 +1585,6 @@ static game_state *new_state(game_params *params)
 
     ret->grid = snewn(wh, grid_type);
     memset(ret->grid, 0, GRIDSZ(ret));
-    ret->scratch = snewn(wh, grid_type);
-    memset(ret->scratch, 0, GRIDSZ(ret));
 
     ret->wha = snewn(wh*N_WH_ARRAYS, char);
     memset(ret->wha, 0, wh*N_WH_ARRAYS*sizeof(char));
@@ -1609,6 +1610,8 @@ static game_state *new_state(game_params *params)
     ret->solver = snew(struct solver_state);
     ret->solver->dsf = snew_dsf(wh);
     ret->solver->tmpdsf = snewn(wh, int);
+    ret->solver->scratch = snewn(wh, grid_type);
+    memset(ret->solver->scratch, 0, GRIDSZ(ret));
 
     ret->solver->refcount = 1;
 
@@ -1628,8 +1631,6 @@ static game_state *dup_game(game_state *state)
 
     ret->grid = snewn(wh, grid_type);
     memcpy(ret->grid, state->grid, GRIDSZ(ret));
-    ret->scratch = snewn(wh, grid_type);
-    memcpy(ret->scratch, state->scratch, GRIDSZ(ret));
 
     ret->wha = snewn(wh*N_WH_ARRAYS, char);
     memcpy(ret->wha, state->wha, wh*N_WH_ARRAYS*sizeof(char));
@@ -1661,6 +1662,7 @@ static void free_game(game_state *state)
     if (--state->solver->refcount <= 0) {
         sfree(state->solver->dsf);
         sfree(state->solver->tmpdsf);
+        sfree(state->solver->scratch);
         sfree(state->solver);
     }
 
@@ -1669,7 +1671,6 @@ static void free_game(game_state *state)
 
     sfree(state->wha);
 
-    sfree(state->scratch);
     sfree(state->grid);
     sfree(state);
 }
@@ -2728,11 +2729,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILE_SIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    NULL,				       /* redraw_region */
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
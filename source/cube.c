@@ -1743,11 +1743,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_GRID_SCALE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    NULL,				       /* redraw_region */
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
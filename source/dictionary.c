@@ -38,24 +38,92 @@
 /** Invalid key token */
 #define DICT_INVALID_KEY    ((char*)-1)
 
+/** Hash table markers: never used, and used by a since deleted key */
+#define DICT_EMPTY          (-1)
+#define DICT_DELETED        (-2)
+
 /*---------------------------------------------------------------------------
   							Private functions
  ---------------------------------------------------------------------------*/
 
-/* Doubles the allocated size associated to a pointer */
-/* 'size' is the current allocated size. */
-static void * mem_double(void * ptr, int size)
+/*
+ * Look a key up in the hash table. Returns its index in key[], or -1
+ * if it is not there. If slot is not NULL, it is set to the table
+ * slot holding the key or, if it is missing, to the slot where it
+ * should be added. The table is never more than half full, so there
+ * is always an empty slot to stop at.
+ */
+static int dict_find(dictionary * d, char * key, unsigned hash, int * slot)
 {
-    void * newptr ;
- 
-    newptr = scalloc(2*size, 1);
-    if (newptr==NULL) {
-        return NULL ;
+    int     mask = d->tsize - 1 ;
+    int     i = hash & mask ;
+    int     free_slot = -1 ;
+    int     t ;
+
+    while ((t = d->table[i]) != DICT_EMPTY) {
+        if (t == DICT_DELETED) {
+            if (free_slot < 0)
+                free_slot = i ;
+        } else if (d->hash[t]==hash && !strcmp(key, d->key[t])) {
+            if (slot) *slot = i ;
+            return t ;
+        }
+        i = (i+1) & mask ;
     }
-    memset(newptr, 0, 2*size);
-    memcpy(newptr, ptr, size);
-    sfree(ptr);
-    return newptr ;
+    if (slot) *slot = free_slot >= 0 ? free_slot : i ;
+    return -1 ;
+}
+
+/*
+ * Move the live entries, in order, into fresh arrays of the given
+ * size (a power of two), and rebuild the hash table at twice that
+ * size. This both grows the dictionary and squeezes out the holes
+ * left by deleted keys, along with their markers in the table.
+ */
+static int dict_resize(dictionary * d, int size)
+{
+    char     ** val, ** key ;
+    unsigned  * hash ;
+    int       * table ;
+    int         i, j, slot ;
+
+    val   = (char **)scalloc(size, sizeof(char*));
+    key   = (char **)scalloc(size, sizeof(char*));
+    hash  = (unsigned *)scalloc(size, sizeof(unsigned));
+    table = (int *)scalloc(2*size, sizeof(int));
+    if (val==NULL || key==NULL || hash==NULL || table==NULL)
+        return -1 ;
+    memset(val, 0, size * sizeof(char*));
+    memset(key, 0, size * sizeof(char*));
+    memset(hash, 0, size * sizeof(unsigned));
+    for (i=0 ; i<2*size ; i++)
+        table[i] = DICT_EMPTY ;
+
+    for (i=0, j=0 ; i<d->used ; i++) {
+        if (d->key[i]==NULL)
+            continue ;
+        key[j]  = d->key[i] ;
+        val[j]  = d->val[i] ;
+        hash[j] = d->hash[i] ;
+        for (slot = hash[j] & (2*size-1) ; table[slot]!=DICT_EMPTY ;
+             slot = (slot+1) & (2*size-1))
+            ;
+        table[slot] = j ;
+        j++ ;
+    }
+
+    if (d->val) sfree(d->val);
+    if (d->key) sfree(d->key);
+    if (d->hash) sfree(d->hash);
+    if (d->table) sfree(d->table);
+    d->val   = val ;
+    d->key   = key ;
+    d->hash  = hash ;
+    d->table = table ;
+    d->size  = size ;
+    d->tsize = 2*size ;
+    d->used  = j ;
+    return 0 ;
 }
 
 /*---------------------------------------------------------------------------
@@ -106,24 +174,21 @@ dictionary * dictionary_new(int size)
 {
 	dictionary	*	d ;
 
-	/* If no size was specified, allocate space for DICTMINSZ */
-	if (size<DICTMINSZ) size=DICTMINSZ ;
+	int			s ;
+
+	/* Allocate at least DICTMINSZ, rounded up to a power of two */
+	for (s=DICTMINSZ ; s<size ; s*=2)
+		;
 
 	if (!(d = (dictionary *)scalloc(1, sizeof(dictionary)))) {
 		return NULL;
 	}
         memset(d, 0, sizeof(dictionary));
 
-	d->size = size ;
-	d->val  = (char **)scalloc(size, sizeof(char*));
-        memset(d->val, 0, size * sizeof(char*));
-
-	d->key  = (char **)scalloc(size, sizeof(char*));
-        memset(d->key, 0, size * sizeof(char*));
-
-	d->hash = (unsigned int *)scalloc(size, sizeof(unsigned));
-        memset(d->hash, 0, size * sizeof(unsigned));
-
+	if (dict_resize(d, s)) {
+		sfree(d);
+		return NULL ;
+	}
 	return d ;
 }
 
@@ -141,7 +206,7 @@ void dictionary_del(dictionary * d)
 	int		i ;
 
 	if (d==NULL) return ;
-	for (i=0 ; i<d->size ; i++) {
+	for (i=0 ; i<d->used ; i++) {
 		if (d->key[i]!=NULL)
 			sfree(d->key[i]);
 		if (d->val[i]!=NULL)
@@ -150,6 +215,7 @@ void dictionary_del(dictionary * d)
 	sfree(d->val);
 	sfree(d->key);
 	sfree(d->hash);
+	sfree(d->table);
 	sfree(d);
 	return ;
 }
@@ -170,22 +236,10 @@ void dictionary_del(dictionary * d)
 /*--------------------------------------------------------------------------*/
 char * dictionary_get(dictionary * d, char * key, char * def)
 {
-	unsigned	hash ;
 	int			i ;
 
-	hash = dictionary_hash(key);
-	for (i=0 ; i<d->size ; i++) {
-        if (d->key[i]==NULL)
-            continue ;
-        /* Compare hash */
-		if (hash==d->hash[i]) {
-            /* Compare string, to avoid hash collisions */
-            if (!strcmp(key, d->key[i])) {
-				return d->val[i] ;
-			}
-		}
-	}
-	return def ;
+	i = dict_find(d, key, dictionary_hash(key), NULL);
+	return i<0 ? def : d->val[i] ;
 }
 
 /*-------------------------------------------------------------------------*/
@@ -216,7 +270,7 @@ char * dictionary_get(dictionary * d, char * key, char * def)
 /*--------------------------------------------------------------------------*/
 int dictionary_set(dictionary * d, char * key, char * val)
 {
-	int			i ;
+	int			i, slot ;
 	unsigned	hash ;
 
 	if (d==NULL || key==NULL) return -1 ;
@@ -224,49 +278,35 @@ int dictionary_set(dictionary * d, char * key, char * val)
 	/* Compute hash for this key */
 	hash = dictionary_hash(key) ;
 	/* Find if value is already in dictionary */
-	if (d->n>0) {
-		for (i=0 ; i<d->size ; i++) {
-            if (d->key[i]==NULL)
-                continue ;
-			if (hash==d->hash[i]) { /* Same hash value */
-				if (!strcmp(key, d->key[i])) {	 /* Same key */
-					/* Found a value: modify and return */
-					if (d->val[i]!=NULL)
-						sfree(d->val[i]);
-                    d->val[i] = val ? dupstr(val) : NULL ;
-                    /* Value has been modified: return */
-					return 0 ;
-				}
-			}
-		}
+	i = dict_find(d, key, hash, &slot);
+	if (i>=0) {
+		/* Found a value: modify and return */
+		if (d->val[i]!=NULL)
+			sfree(d->val[i]);
+		d->val[i] = val ? dupstr(val) : NULL ;
+		return 0 ;
 	}
 	/* Add a new value */
 	/* See if dictionary needs to grow */
-	if (d->n==d->size) {
-
-		/* Reached maximum size: reallocate dictionary */
-		d->val  = (char **)mem_double(d->val,  d->size * sizeof(char*)) ;
-		d->key  = (char **)mem_double(d->key,  d->size * sizeof(char*)) ;
-		d->hash = (unsigned int *)mem_double(d->hash, d->size * sizeof(unsigned)) ;
-        if ((d->val==NULL) || (d->key==NULL) || (d->hash==NULL)) {
-            /* Cannot grow dictionary */
-            return -1 ;
-        }
-		/* Double size */
-		d->size *= 2 ;
+	if (d->used==d->size) {
+		/*
+		 * Out of slots at the end. If at least half of them are
+		 * holes left by deleted keys, squeezing those out is
+		 * enough; otherwise double the size.
+		 */
+		if (dict_resize(d, d->n*2 > d->size ? d->size*2 : d->size)) {
+			/* Cannot grow dictionary */
+			return -1 ;
+		}
+		dict_find(d, key, hash, &slot);
 	}
 
-    /* Insert key in the first empty slot */
-    for (i=0 ; i<d->size ; i++) {
-        if (d->key[i]==NULL) {
-            /* Add key here */
-            break ;
-        }
-    }
-	/* Copy key */
+	/* Append the key, keeping the entries in insertion order */
+	i = d->used++ ;
 	d->key[i]  = dupstr(key);
-    d->val[i]  = val ? dupstr(val) : NULL ;
+	d->val[i]  = val ? dupstr(val) : NULL ;
 	d->hash[i] = hash;
+	d->table[slot] = i ;
 	d->n ++ ;
 	return 0 ;
 }
@@ -284,30 +324,19 @@ int dictionary_set(dictionary * d, char * key, char * val)
 /*--------------------------------------------------------------------------*/
 void dictionary_unset(dictionary * d, char * key)
 {
-	unsigned	hash ;
-	int			i ;
+	int			i, slot ;
 
 	if (key == NULL) {
 		return;
 	}
 
-	hash = dictionary_hash(key);
-	for (i=0 ; i<d->size ; i++) {
-        if (d->key[i]==NULL)
-            continue ;
-        /* Compare hash */
-		if (hash==d->hash[i]) {
-            /* Compare string, to avoid hash collisions */
-            if (!strcmp(key, d->key[i])) {
-                /* Found key */
-                break ;
-			}
-		}
-	}
-    if (i>=d->size)
+	i = dict_find(d, key, dictionary_hash(key), &slot);
+    if (i<0)
         /* Key not found */
         return ;
 
+    /* Leave the hole in key[] and a marker in the table */
+    d->table[slot] = DICT_DELETED ;
     sfree(d->key[i]);
     d->key[i] = NULL ;
     if (d->val[i]!=NULL) {
@@ -340,7 +369,7 @@ void dictionary_dump(dictionary * d, FILE * out)
 		fprintf(out, "empty dictionary\n");
 		return ;
 	}
-	for (i=0 ; i<d->size ; i++) {
+	for (i=0 ; i<d->used ; i++) {
         if (d->key[i]) {
             fprintf(out, "%20s\t[%s]\n",
                     d->key[i],
@@ -353,13 +382,18 @@ void dictionary_dump(dictionary * d, FILE * out)
 
 /* Test code */
 #ifdef TESTDIC
+#include <time.h>
 #define NVALS 20000
+/* A config holding the settings of a hundred games, fifty apiece */
+#define NBENCH 5000
+#define NROUNDS 100
 int main(int argc, char *argv[])
 {
 	dictionary	*	d ;
 	char	*	val ;
-	int			i ;
+	int			i, j ;
 	char		cval[90] ;
+	clock_t		t0, t1, t2 ;
 
 	/* Allocate dictionary */
 	printf("allocating...\n");
@@ -387,8 +421,46 @@ int main(int argc, char *argv[])
     if (d->n != 0) {
         printf("error deleting values\n");
     }
+
+    /* Keys must come back out in the order they went in */
+    printf("checking insertion order...\n");
+	for (i=0 ; i<NVALS ; i++) {
+		sprintf(cval, "%04d", i);
+		dictionary_set(d, cval, "salut");
+		if (i % 3 == 0) {
+			sprintf(cval, "%04d", i/2);
+			dictionary_unset(d, cval);
+		}
+	}
+	for (i=0, j=-1 ; i<d->size ; i++) {
+		if (d->key[i]==NULL)
+			continue ;
+		if (atoi(d->key[i]) <= j)
+			printf("key [%s] out of order\n", d->key[i]);
+		j = atoi(d->key[i]);
+	}
 	printf("deallocating...\n");
 	dictionary_del(d);
+
+	printf("benchmarking %d keys...\n", NBENCH);
+	t0 = clock();
+	d = dictionary_new(0);
+	for (i=0 ; i<NBENCH ; i++) {
+		sprintf(cval, "Game%03d:setting%02d", i/50, i%50);
+		dictionary_set(d, cval, "T");
+	}
+	t1 = clock();
+	for (j=0 ; j<NROUNDS ; j++)
+		for (i=0 ; i<NBENCH ; i++) {
+			sprintf(cval, "Game%03d:setting%02d", i/50, i%50);
+			if (dictionary_get(d, cval, NULL)==NULL)
+				printf("cannot get value for key [%s]\n", cval);
+		}
+	t2 = clock();
+	printf("load %.2f ms, lookup %.3f us per key\n",
+	       (t1-t0) * 1000.0 / CLOCKS_PER_SEC,
+	       (t2-t1) * 1e6 / CLOCKS_PER_SEC / ((double)NBENCH*NROUNDS));
+	dictionary_del(d);
 	return 0 ;
 }
 #endif
@@ -42,9 +42,14 @@
   @brief	Dictionary object
 
   This object contains a list of string/string associations. Each
-  association is identified by a unique string key. Looking up values
-  in the dictionary is speeded up by the use of a (hopefully collision-free)
-  hash function.
+  association is identified by a unique string key.
+
+  The entries live in the key/val/hash arrays in the order they were
+  added, so that walking them from 0 to size-1 (skipping NULL keys,
+  which are unused or deleted slots) writes a file back out in the
+  order it was read. Lookups go through a separate open-addressing
+  table of entry indices, probed linearly from the key's hash, so they
+  take constant time however many entries there are.
  */
 /*-------------------------------------------------------------------------*/
 typedef struct _dictionary_ {
@@ -53,6 +58,9 @@ typedef struct _dictionary_ {
 	char 		**	val ;	/** List of string values */
 	char 		**  key ;	/** List of string keys */
 	unsigned	 *	hash ;	/** List of hash values for keys */
+	int				used ;	/** Slots of key[] used, including deleted ones */
+	int			 *	table ;	/** Hash table of indices into key[] */
+	int				tsize ;	/** Size of table, a power of two */
 } dictionary ;
 
 
@@ -1804,11 +1804,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILESIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    NULL,				       /* redraw_region */
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
@@ -48,6 +48,9 @@ struct drawing {
      * this may set it to NULL. */
     midend *me;
     char *laststatus;
+    /* If `restricted', all drawing is clipped to this rectangle. */
+    int restricted;
+    int rx, ry, rw, rh;
 };
 
 drawing *drawing_new(const drawing_api *api, midend *me, void *handle)
@@ -60,6 +63,7 @@ drawing *drawing_new(const drawing_api *api, midend *me, void *handle)
     dr->scale = 1.0F;
     dr->me = me;
     dr->laststatus = NULL;
+    dr->restricted = FALSE;
     return dr;
 }
 
@@ -109,11 +113,45 @@ void draw_update(drawing *dr, int x, int y, int w, int h)
 
 void clip(drawing *dr, int x, int y, int w, int h)
 {
+    if (dr->restricted) {
+	int x2 = min(x + w, dr->rx + dr->rw);
+	int y2 = min(y + h, dr->ry + dr->rh);
+
+	x = max(x, dr->rx);
+	y = max(y, dr->ry);
+	w = max(x2 - x, 0);
+	h = max(y2 - y, 0);
+    }
     dr->api->clip(dr->handle, x, y, w, h);
 }
 
 void unclip(drawing *dr)
 {
+    if (dr->restricted)
+	dr->api->clip(dr->handle, dr->rx, dr->ry, dr->rw, dr->rh);
+    else
+	dr->api->unclip(dr->handle);
+}
+
+/*
+ * Confine all drawing to a rectangle until further notice. Used by
+ * the midend around a redraw whose extent the back end has told it
+ * in advance; the back end's own clip() and unclip() calls then
+ * operate within the rectangle rather than the whole window.
+ */
+void draw_restrict(drawing *dr, int x, int y, int w, int h)
+{
+    dr->restricted = TRUE;
+    dr->rx = x;
+    dr->ry = y;
+    dr->rw = w;
+    dr->rh = h;
+    dr->api->clip(dr->handle, x, y, w, h);
+}
+
+void draw_unrestrict(drawing *dr)
+{
+    dr->restricted = FALSE;
     dr->api->unclip(dr->handle);
 }
 
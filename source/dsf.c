@@ -176,3 +176,366 @@ void edsf_merge(int *dsf, int v1, int v2, int inverse)
 
 /*    fprintf(stderr, "dsf[%2d] = %2d\n", v2, dsf[v2]); */
 }
+
+/*
+ * Canonify every element of a dsf in one pass, writing the canonical
+ * element of each into canon[] and (if inverse is non-NULL) its
+ * inverse flag into inverse[]. As a side effect the forest is
+ * flattened, so that every element points straight at its root.
+ *
+ * This is cheaper than calling edsf_canonify on each element in
+ * turn: once elements 0..i-1 are flat, any element whose parent
+ * has a smaller index can be resolved from its parent's entry
+ * without walking anywhere.
+ */
+void edsf_canonify_all(int *dsf, int size, int *canon, int *inverse)
+{
+    int i, c, inv, parent;
+
+    for (i = 0; i < size; i++) {
+	if (dsf[i] & 2) {
+	    c = i;
+	    inv = 0;
+	} else if ((parent = dsf[i] >> 2) < i) {
+	    if (dsf[parent] & 2) {
+		c = parent;
+		inv = dsf[i] & 1;
+	    } else {
+		c = dsf[parent] >> 2;
+		inv = (dsf[i] ^ dsf[parent]) & 1;
+		dsf[i] = (c << 2) | inv;
+	    }
+	} else {
+	    c = edsf_canonify(dsf, i, &inv);
+	}
+
+	canon[i] = c;
+	if (inverse)
+	    inverse[i] = inv;
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * Resettable dsf.
+ *
+ * Solvers which are run many times during generation tend to
+ * reinitialise their dsfs from scratch on every run, which costs
+ * O(size) each time. An rdsf stamps every entry with the epoch in
+ * which it was last written, and treats any entry with a stale
+ * stamp as if it still held its initial value; so rdsf_reset()
+ * only has to advance the epoch.
+ *
+ * The stamp is stored next to the packed dsf word it qualifies, so
+ * that checking it costs no extra cache misses. Only the element
+ * a canonify starts from needs checking at all: every element
+ * reachable from it by parent links was written by a merge in the
+ * current epoch.
+ *
+ * Merging is by size, with ties going to v1, exactly as in
+ * edsf_merge(); so a sequence of operations on an rdsf chooses the
+ * same canonical elements as the same sequence on a plain dsf.
+ */
+
+struct rdsf_entry {
+    int val;			       /* packed as for dsf_init() */
+    unsigned epoch;
+};
+
+struct rdsf {
+    int size;
+    unsigned epoch;
+    struct rdsf_entry *entries;
+};
+
+rdsf *rdsf_new(int size)
+{
+    rdsf *ret = snew(rdsf);
+    int i;
+
+    ret->size = size;
+    ret->epoch = 1;
+    ret->entries = snewn(size, struct rdsf_entry);
+    for (i = 0; i < size; i++) {
+	ret->entries[i].val = 6;
+	ret->entries[i].epoch = 0;
+    }
+
+    return ret;
+}
+
+void rdsf_free(rdsf *r)
+{
+    if (r) {
+	sfree(r->entries);
+	sfree(r);
+    }
+}
+
+void rdsf_reset(rdsf *r)
+{
+    if (++r->epoch == 0) {
+	/*
+	 * The epoch counter has wrapped, so stamps from 2^32 resets
+	 * ago would look current again. Clear them all and start
+	 * over; this happens rarely enough not to matter.
+	 */
+	int i;
+	for (i = 0; i < r->size; i++)
+	    r->entries[i].epoch = 0;
+	r->epoch = 1;
+    }
+}
+
+int erdsf_canonify(rdsf *r, int index, int *inverse_return)
+{
+    struct rdsf_entry *e = r->entries;
+    int start_index = index, canonical_index;
+    int inverse = 0;
+
+    assert(index >= 0 && index < r->size);
+
+    if (e[index].epoch != r->epoch || (e[index].val & 2)) {
+	/* A root (perhaps untouched since the last reset). */
+	if (inverse_return)
+	    *inverse_return = 0;
+	return index;
+    }
+
+    if (e[e[index].val >> 2].val & 2) {
+	/* Parent is the root, so there's no path to compress. */
+	if (inverse_return)
+	    *inverse_return = e[index].val & 1;
+	return e[index].val >> 2;
+    }
+
+    while ((e[index].val & 2) == 0) {
+	inverse ^= (e[index].val & 1);
+	index = e[index].val >> 2;
+    }
+    canonical_index = index;
+
+    if (inverse_return)
+	*inverse_return = inverse;
+
+    index = start_index;
+    while (index != canonical_index) {
+	int nextindex = e[index].val >> 2;
+	int nextinverse = inverse ^ (e[index].val & 1);
+	e[index].val = (canonical_index << 2) | inverse;
+	inverse = nextinverse;
+	index = nextindex;
+    }
+
+    assert(inverse == 0);
+
+    return index;
+}
+
+int rdsf_canonify(rdsf *r, int index)
+{
+    return erdsf_canonify(r, index, NULL);
+}
+
+void erdsf_merge(rdsf *r, int v1, int v2, int inverse)
+{
+    struct rdsf_entry *e = r->entries;
+    int i1, i2;
+
+    v1 = erdsf_canonify(r, v1, &i1);
+    inverse ^= i1;
+    v2 = erdsf_canonify(r, v2, &i2);
+    inverse ^= i2;
+
+    if (v1 == v2)
+	assert(!inverse);
+    else {
+	int val1 = (e[v1].epoch == r->epoch ? e[v1].val : 6);
+	int val2 = (e[v2].epoch == r->epoch ? e[v2].val : 6);
+
+	assert(inverse == 0 || inverse == 1);
+	assert((val1 & 2) && (val2 & 2));
+	if ((val2 >> 2) > (val1 >> 2)) {
+	    int v3 = v1, val3 = val1;
+	    v1 = v2;
+	    val1 = val2;
+	    v2 = v3;
+	    val2 = val3;
+	}
+	e[v1].val = val1 + ((val2 >> 2) << 2);
+	e[v1].epoch = r->epoch;
+	e[v2].val = (v1 << 2) | !!inverse;
+	e[v2].epoch = r->epoch;
+    }
+}
+
+void rdsf_merge(rdsf *r, int v1, int v2)
+{
+    erdsf_merge(r, v1, v2, FALSE);
+}
+
+int rdsf_size(rdsf *r, int index)
+{
+    index = rdsf_canonify(r, index);
+    return (r->entries[index].epoch == r->epoch ?
+	    r->entries[index].val >> 2 : 1);
+}
+
+/* compile this with:
+ *   gcc -O2 -o dsftest -DSTANDALONE_DSF_TEST dsf.c malloc.c
+ *
+ * Run with no arguments to cross-check the rdsf and batch canonify
+ * against the plain dsf functions; with arguments SIZE OPS RESETS to
+ * time a solver-like workload (RESETS rounds of OPS random merges
+ * and lookups on SIZE elements) done each way.
+ */
+#ifdef STANDALONE_DSF_TEST
+
+#include <stdio.h>
+#include <time.h>
+
+void fatal(char *fmt, ...)
+{
+    abort();
+}
+
+static unsigned long lcg = 1;
+static int rnd(int n)
+{
+    lcg = (lcg * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+    return (int)((lcg >> 8) % n);
+}
+
+static int check(int size, int rounds, int ops)
+{
+    int *dsf = snew_dsf(size);
+    int *canon = snewn(size, int), *inv = snewn(size, int);
+    rdsf *r = rdsf_new(size);
+    int round, i, errs = 0;
+
+    for (round = 0; round < rounds; round++) {
+	/* Build a random consistent assignment, then merge by it. */
+	int *sign = snewn(size, int);
+	for (i = 0; i < size; i++)
+	    sign[i] = rnd(2);
+
+	dsf_init(dsf, size);
+	rdsf_reset(r);
+	for (i = 0; i < ops; i++) {
+	    int a = rnd(size), b = rnd(size), c1, c2, i1, i2;
+
+	    if (rnd(3)) {
+		edsf_merge(dsf, a, b, sign[a] ^ sign[b]);
+		erdsf_merge(r, a, b, sign[a] ^ sign[b]);
+	    }
+	    c1 = edsf_canonify(dsf, a, &i1);
+	    c2 = erdsf_canonify(r, a, &i2);
+	    if (c1 != c2 || i1 != i2 ||
+		dsf_size(dsf, a) != rdsf_size(r, a)) {
+		printf("round %d op %d: element %d: dsf %d/%d/%d, "
+		       "rdsf %d/%d/%d\n", round, i, a, c1, i1,
+		       dsf_size(dsf, a), c2, i2, rdsf_size(r, a));
+		errs++;
+	    }
+	}
+
+	edsf_canonify_all(dsf, size, canon, inv);
+	for (i = 0; i < size; i++) {
+	    int c, iv;
+	    c = erdsf_canonify(r, i, &iv);
+	    if (canon[i] != c || inv[i] != iv ||
+		inv[i] != (sign[i] ^ sign[c])) {
+		printf("round %d: canonify_all element %d: %d/%d, "
+		       "expected %d/%d\n", round, i, canon[i], inv[i], c, iv);
+		errs++;
+	    }
+	}
+	sfree(sign);
+    }
+
+    sfree(dsf);
+    sfree(canon);
+    sfree(inv);
+    rdsf_free(r);
+    return errs;
+}
+
+static void bench(int size, int ops, int resets)
+{
+    int *dsf = snew_dsf(size), *canon = snewn(size, int);
+    rdsf *r = rdsf_new(size);
+    int round, i;
+    unsigned long sum = 0;
+    clock_t t0;
+
+    lcg = 1;
+    t0 = clock();
+    for (round = 0; round < resets; round++) {
+	dsf_init(dsf, size);
+	for (i = 0; i < ops; i++) {
+	    dsf_merge(dsf, rnd(size), rnd(size));
+	    sum += dsf_canonify(dsf, rnd(size));
+	}
+    }
+    printf("dsf_init + ops:      %8.1f ns/round\n",
+	   (double)(clock() - t0) * 1e9 / CLOCKS_PER_SEC / resets);
+
+    lcg = 1;
+    t0 = clock();
+    for (round = 0; round < resets; round++) {
+	rdsf_reset(r);
+	for (i = 0; i < ops; i++) {
+	    rdsf_merge(r, rnd(size), rnd(size));
+	    sum -= rdsf_canonify(r, rnd(size));
+	}
+    }
+    printf("rdsf_reset + ops:    %8.1f ns/round\n",
+	   (double)(clock() - t0) * 1e9 / CLOCKS_PER_SEC / resets);
+
+    lcg = 1;
+    t0 = clock();
+    for (round = 0; round < resets; round++) {
+	dsf_init(dsf, size);
+	for (i = 0; i < ops; i++)
+	    dsf_merge(dsf, rnd(size), rnd(size));
+	for (i = 0; i < size; i++)
+	    sum += dsf_canonify(dsf, i);
+    }
+    printf("ops + canonify each: %8.1f ns/round\n",
+	   (double)(clock() - t0) * 1e9 / CLOCKS_PER_SEC / resets);
+
+    lcg = 1;
+    t0 = clock();
+    for (round = 0; round < resets; round++) {
+	dsf_init(dsf, size);
+	for (i = 0; i < ops; i++)
+	    dsf_merge(dsf, rnd(size), rnd(size));
+	edsf_canonify_all(dsf, size, canon, NULL);
+	for (i = 0; i < size; i++)
+	    sum -= canon[i];
+    }
+    printf("ops + canonify_all:  %8.1f ns/round\n",
+	   (double)(clock() - t0) * 1e9 / CLOCKS_PER_SEC / resets);
+
+    if (sum != 0)
+	printf("checksum mismatch\n");
+
+    sfree(dsf);
+    sfree(canon);
+    rdsf_free(r);
+}
+
+int main(int argc, char *argv[])
+{
+    int errs;
+
+    if (argc == 4) {
+	bench(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]));
+	return 0;
+    }
+
+    errs = check(1, 10, 5) + check(17, 200, 30) + check(1000, 50, 1500);
+    printf("%d errors\n", errs);
+    return errs != 0;
+}
+
+#endif
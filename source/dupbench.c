@@ -0,0 +1,100 @@
+/*
+ * dupbench.c: measure how much memory a game's dup_game() and
+ * execute_move() ask for, and how long they take. Used to check the
+ * effect of sharing a game's constant data between its states
+ * rather than copying it on every move.
+ *
+ * Link with one game's back end and the STANDALONE objects, and run
+ * as `<game>bench [params [iterations]]'. The move timed is the one
+ * the game's own solve() produces for a freshly generated puzzle.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "puzzles.h"
+
+#ifdef COMBINED
+#error dupbench needs a single game back end
+#endif
+
+extern const game thegame;
+
+static void report(char *what, unsigned long bytes, clock_t ticks, int n)
+{
+    printf("%-14s %8lu bytes %10.0f ns\n", what, bytes / n,
+	   (double)ticks * 1e9 / CLOCKS_PER_SEC / n);
+}
+
+int main(int argc, char **argv)
+{
+    game_params *p;
+    random_state *rs;
+    game_state *s, *t;
+    char *desc, *aux = NULL, *move, *err, *pstr;
+    unsigned long before;
+    clock_t start;
+    int i, n = 20000;
+
+    p = thegame.default_params();
+    if (argc > 1) {
+	thegame.decode_params(p, argv[1]);
+	err = thegame.validate_params(p, TRUE);
+	if (err) {
+	    fprintf(stderr, "%s: %s\n", argv[0], err);
+	    return 1;
+	}
+    }
+    if (argc > 2)
+	n = atoi(argv[2]);
+    if (n <= 0) {
+	fprintf(stderr, "%s: iteration count must be positive\n", argv[0]);
+	return 1;
+    }
+
+    rs = random_new("dupbench", 8);
+    desc = thegame.new_desc(p, rs, &aux, FALSE);
+    s = thegame.new_game(NULL, p, desc);
+
+    pstr = thegame.encode_params(p, TRUE);
+    printf("%s %s, %d iterations\n", thegame.name, pstr, n);
+    sfree(pstr);
+
+    before = smalloc_total();
+    start = clock();
+    for (i = 0; i < n; i++) {
+	t = thegame.dup_game(s);
+	thegame.free_game(t);
+    }
+    report("dup_game", smalloc_total() - before, clock() - start, n);
+
+    move = NULL;
+    if (thegame.can_solve) {
+	err = NULL;
+	move = thegame.solve(s, s, aux, &err);
+    }
+    if (move && (t = thegame.execute_move(s, move)) == NULL) {
+	fprintf(stderr, "%s: solve move did not execute\n", argv[0]);
+	return 1;
+    }
+    if (move) {
+	thegame.free_game(t);
+	before = smalloc_total();
+	start = clock();
+	for (i = 0; i < n; i++) {
+	    t = thegame.execute_move(s, move);
+	    thegame.free_game(t);
+	}
+	report("execute_move", smalloc_total() - before, clock() - start, n);
+	sfree(move);
+    } else
+	printf("execute_move   (no solve move to time)\n");
+
+    thegame.free_game(s);
+    sfree(desc);
+    sfree(aux);
+    random_free(rs);
+    thegame.free_params(p);
+    return 0;
+}
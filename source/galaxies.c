@@ -821,14 +821,23 @@ static void clear_game(game_state *state, int cleardots)
 
 static game_state *dup_game(game_state *state)
 {
-    game_state *ret = blank_game(state->w, state->h);
-
+    game_state *ret = snew(game_state);
+
+    /* Everything in the grid gets overwritten, so there's no need to
+     * go through blank_game() first. */
+    ret->w = state->w;
+    ret->h = state->h;
+    ret->sx = state->sx;
+    ret->sy = state->sy;
+    ret->grid = snewn(ret->sx * ret->sy, struct space);
     ret->completed = state->completed;
     ret->used_solve = state->used_solve;
 
     memcpy(ret->grid, state->grid,
            ret->sx*ret->sy*sizeof(struct space));
 
+    ret->ndots = 0;
+    ret->dots = NULL;
     game_update_dots(ret);
 
     ret->me = state->me;
@@ -3390,11 +3399,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILE_SIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    NULL,				       /* redraw_region */
     game_anim_length,
     game_flash_length,
 #ifdef EDITOR
@@ -5,6 +5,7 @@
 #include "puzzles.h"
 #include "tree234.h"
 #include "maxflow.h"
+#include "bitset.h"
 
 #ifdef STANDALONE_LATIN_TEST
 #define STANDALONE_SOLVER
@@ -24,6 +25,7 @@
 void latin_solver_place(struct latin_solver *solver, int x, int y, int n)
 {
     int i, o = solver->o;
+    bitword others;
 
     assert(n <= o);
     assert(cube(x,y,n));
@@ -31,23 +33,29 @@ void latin_solver_place(struct latin_solver *solver, int x, int y, int n)
     /*
      * Rule out all other numbers in this square.
      */
-    for (i = 1; i <= o; i++)
-	if (i != n)
-            cube(x,y,i) = FALSE;
+    others = solver->cube[x*o+y] & ~BS_BIT(n-1);
+    for (; others; others &= others - 1) {
+        i = bw_first(others);
+        latin_solver_rule_out(solver, x, y, i+1);
+    }
 
     /*
      * Rule out this number in all other positions in the row.
      */
-    for (i = 0; i < o; i++)
-	if (i != y)
-            cube(x,i,n) = FALSE;
+    others = solver->colpos[x*o+n-1] & ~BS_BIT(y);
+    for (; others; others &= others - 1) {
+        i = bw_first(others);
+        latin_solver_rule_out(solver, x, i, n);
+    }
 
     /*
      * Rule out this number in all other positions in the column.
      */
-    for (i = 0; i < o; i++)
-	if (i != x)
-            cube(i,y,n) = FALSE;
+    others = solver->rowpos[y*o+n-1] & ~BS_BIT(x);
+    for (; others; others &= others - 1) {
+        i = bw_first(others);
+        latin_solver_rule_out(solver, i, y, n);
+    }
 
     /*
      * Enter the number in the result grid.
@@ -61,6 +69,55 @@ void latin_solver_place(struct latin_solver *solver, int x, int y, int n)
     solver->row[y*o+n-1] = solver->col[x*o+n-1] = TRUE;
 }
 
+void latin_solver_rule_out(struct latin_solver *solver, int x, int y, int n)
+{
+    int o = solver->o;
+
+    solver->cube[x*o+y] &= ~BS_BIT(n-1);
+    solver->rowpos[y*o+n-1] &= ~BS_BIT(x);
+    solver->colpos[x*o+n-1] &= ~BS_BIT(y);
+}
+
+static void latin_solver_rule_out_pos(struct latin_solver *solver, int fpos)
+{
+    int o = solver->o;
+
+    latin_solver_rule_out(solver, fpos / (o*o), (fpos / o) % o, 1 + fpos % o);
+}
+
+void latin_solver_get_cube(struct latin_solver *solver, unsigned char *cube)
+{
+    int o = solver->o, i;
+
+    for (i = 0; i < o*o*o; i++)
+        cube[i] = (solver->cube[i / o] >> (i % o)) & 1;
+}
+
+/*
+ * Return the possibilities along a line of the cube, as a mask in
+ * which bit i stands for cube position start+i*step. A line runs
+ * the whole length of one axis of the cube, so it is either the
+ * digits of one square, or the positions of one digit in a column
+ * or in a row, and we have a mask of each of those to hand.
+ */
+static bitword latin_solver_line(struct latin_solver *solver,
+                                 int start, int step)
+{
+    int o = solver->o;
+    int n = start % o, y = (start / o) % o, x = start / (o*o);
+
+    if (step == 1) {
+        assert(n == 0);
+        return solver->cube[x*o+y];
+    } else if (step == o) {
+        assert(y == 0);
+        return solver->colpos[x*o+n];
+    } else {
+        assert(step == o*o && x == 0);
+        return solver->rowpos[y*o+n];
+    }
+}
+
 int latin_solver_elim(struct latin_solver *solver, int start, int step
 #ifdef STANDALONE_SOLVER
 		      , char *fmt, ...
@@ -68,23 +125,19 @@ int latin_solver_elim(struct latin_solver *solver, int start, int step
 		      )
 {
     int o = solver->o;
-    int fpos, m, i;
+    int fpos, m;
+    bitword line;
 
     /*
      * Count the number of set bits within this section of the
      * cube.
      */
-    m = 0;
-    fpos = -1;
-    for (i = 0; i < o; i++)
-	if (solver->cube[start+i*step]) {
-	    fpos = start+i*step;
-	    m++;
-	}
+    line = latin_solver_line(solver, start, step);
+    m = bw_count(line);
 
     if (m == 1) {
 	int x, y, n;
-	assert(fpos >= 0);
+	fpos = start + bw_first(line)*step;
 
 	n = 1 + fpos % o;
 	y = fpos / o;
@@ -125,7 +178,8 @@ int latin_solver_elim(struct latin_solver *solver, int start, int step
 }
 
 struct latin_solver_scratch {
-    unsigned char *grid, *rowidx, *colidx, *set;
+    unsigned char *grid, *rowidx, *colidx;
+    bitword *rowbits;		       /* for set elimination */
     int *neighbours, *bfsqueue;
 #ifdef STANDALONE_SOLVER
     int *bfsprev;
@@ -142,10 +196,10 @@ int latin_solver_set(struct latin_solver *solver,
 {
     int o = solver->o;
     int i, j, n, count;
-    unsigned char *grid = scratch->grid;
+    bitword set, all;
+    bitword *grid = scratch->rowbits;
     unsigned char *rowidx = scratch->rowidx;
     unsigned char *colidx = scratch->colidx;
-    unsigned char *set = scratch->set;
 
     /*
      * We are passed a o-by-o matrix of booleans. Our first job
@@ -156,14 +210,12 @@ int latin_solver_set(struct latin_solver *solver,
     memset(rowidx, TRUE, o);
     memset(colidx, TRUE, o);
     for (i = 0; i < o; i++) {
-        int count = 0, first = -1;
-        for (j = 0; j < o; j++)
-            if (solver->cube[start+i*step1+j*step2])
-                first = j, count++;
+        bitword line = latin_solver_line(solver, start+i*step1, step2);
+        int count = bw_count(line);
 
 	if (count == 0) return -1;
         if (count == 1)
-            rowidx[i] = colidx[first] = FALSE;
+            rowidx[i] = colidx[bw_first(line)] = FALSE;
     }
 
     /*
@@ -180,11 +232,19 @@ int latin_solver_set(struct latin_solver *solver,
     assert(n == j);
 
     /*
-     * And create the smaller matrix.
+     * And create the smaller matrix, as a mask per row. Column j
+     * is stored as bit n-1-j, so that counting `set' upwards as a
+     * binary number visits the column subsets in the order of a
+     * counter whose least significant digit is the last column.
      */
-    for (i = 0; i < n; i++)
+    for (i = 0; i < n; i++) {
+        bitword line = latin_solver_line(solver, start+rowidx[i]*step1,
+                                         step2);
+        grid[i] = 0;
         for (j = 0; j < n; j++)
-            grid[i*o+j] = solver->cube[start+rowidx[i]*step1+colidx[j]*step2];
+            if ((line >> colidx[j]) & 1)
+                grid[i] |= BS_BIT(n-1-j);
+    }
 
     /*
      * Having done that, we now have a matrix in which every row
@@ -194,7 +254,8 @@ int latin_solver_set(struct latin_solver *solver,
      * columns) whose width and height add up to n.
      */
 
-    memset(set, 0, n);
+    all = (n == BS_BITS ? ~(bitword)0 : BS_BIT(n) - 1);
+    set = 0;
     count = 0;
     while (1) {
         /*
@@ -208,16 +269,9 @@ int latin_solver_set(struct latin_solver *solver,
              * the positions listed in `set'.
              */
             int rows = 0;
-            for (i = 0; i < n; i++) {
-                int ok = TRUE;
-                for (j = 0; j < n; j++)
-                    if (set[j] && grid[i*o+j]) {
-                        ok = FALSE;
-                        break;
-                    }
-                if (ok)
+            for (i = 0; i < n; i++)
+                if (!(grid[i] & set))
                     rows++;
-            }
 
             /*
              * We expect never to be able to get _more_ than
@@ -258,15 +312,10 @@ int latin_solver_set(struct latin_solver *solver,
                  * positions in the cube to meddle with.
                  */
                 for (i = 0; i < n; i++) {
-                    int ok = TRUE;
-                    for (j = 0; j < n; j++)
-                        if (set[j] && grid[i*o+j]) {
-                            ok = FALSE;
-                            break;
-                        }
-                    if (!ok) {
+                    if (grid[i] & set) {
+                        bitword elim = grid[i] & ~set;
                         for (j = 0; j < n; j++)
-                            if (!set[j] && grid[i*o+j]) {
+                            if (elim & BS_BIT(n-1-j)) {
                                 int fpos = (start+rowidx[i]*step1+
                                             colidx[j]*step2);
 #ifdef STANDALONE_SOLVER
@@ -294,7 +343,7 @@ int latin_solver_set(struct latin_solver *solver,
                                 }
 #endif
                                 progress = TRUE;
-                                solver->cube[fpos] = FALSE;
+                                latin_solver_rule_out_pos(solver, fpos);
                             }
                     }
                 }
@@ -306,16 +355,12 @@ int latin_solver_set(struct latin_solver *solver,
         }
 
         /*
-         * Binary increment: change the rightmost 0 to a 1, and
-         * change all 1s to the right of it to 0s.
+         * Move on to the next subset.
          */
-        i = n;
-        while (i > 0 && set[i-1])
-            set[--i] = 0, count--;
-        if (i > 0)
-            set[--i] = 1, count++;
-        else
+        if (set == all)
             break;                     /* done */
+        set++;
+        count += 1 - bw_first(set);    /* the 1s we carried past are 0s */
     }
 
     return 0;
@@ -371,7 +416,7 @@ int latin_solver_forcing(struct latin_solver *solver,
 
     for (y = 0; y < o; y++)
         for (x = 0; x < o; x++) {
-            int count, t, n;
+            int t, n;
 
             /*
              * If this square doesn't have exactly two candidate
@@ -382,11 +427,12 @@ int latin_solver_forcing(struct latin_solver *solver,
              * `the other one' (since we will shortly know there
              * are exactly two).
              */
-            for (count = t = 0, n = 1; n <= o; n++)
-                if (cube(x, y, n))
-                    count++, t += n;
-            if (count != 2)
+            bitword here = solver->cube[x*o+y];
+
+            if (bw_count(here) != 2)
                 continue;
+            t = bw_first(here) + 1;
+            t += bw_first(here & (here - 1)) + 1;
 
             /*
              * Now attempt a bfs for each candidate.
@@ -430,7 +476,8 @@ int latin_solver_forcing(struct latin_solver *solver,
                          * Try visiting each of those neighbours.
                          */
                         for (i = 0; i < nneighbours; i++) {
-                            int cc, tt, nn;
+                            int tt;
+                            bitword there;
 
                             xt = neighbours[i] % o;
                             yt = neighbours[i] / o;
@@ -457,10 +504,10 @@ int latin_solver_forcing(struct latin_solver *solver,
                              * this square to have exactly two
                              * possible numbers.
                              */
-                            for (cc = tt = 0, nn = 1; nn <= o; nn++)
-                                if (cube(xt, yt, nn))
-                                    cc++, tt += nn;
-                            if (cc == 2) {
+                            there = solver->cube[xt*o+yt];
+                            if (bw_count(there) == 2) {
+                                tt = bw_first(there) + 1;
+                                tt += bw_first(there & (there - 1)) + 1;
                                 bfsqueue[tail++] = yt*o+xt;
 #ifdef STANDALONE_SOLVER
                                 bfsprev[yt*o+xt] = yy*o+xx;
@@ -500,7 +547,7 @@ int latin_solver_forcing(struct latin_solver *solver,
                                            orign, xt, YUNTRANS(yt));
                                 }
 #endif
-                                cube(xt, yt, orign) = FALSE;
+                                latin_solver_rule_out(solver, xt, yt, orign);
                                 return 1;
                             }
                         }
@@ -518,7 +565,7 @@ struct latin_solver_scratch *latin_solver_new_scratch(struct latin_solver *solve
     scratch->grid = snewn(o*o, unsigned char);
     scratch->rowidx = snewn(o, unsigned char);
     scratch->colidx = snewn(o, unsigned char);
-    scratch->set = snewn(o, unsigned char);
+    scratch->rowbits = snewn(o, bitword);
     scratch->neighbours = snewn(3*o, int);
     scratch->bfsqueue = snewn(o*o, int);
 #ifdef STANDALONE_SOLVER
@@ -534,7 +581,7 @@ void latin_solver_free_scratch(struct latin_solver_scratch *scratch)
 #endif
     sfree(scratch->bfsqueue);
     sfree(scratch->neighbours);
-    sfree(scratch->set);
+    sfree(scratch->rowbits);
     sfree(scratch->colidx);
     sfree(scratch->rowidx);
     sfree(scratch->grid);
@@ -544,11 +591,18 @@ void latin_solver_free_scratch(struct latin_solver_scratch *scratch)
 void latin_solver_alloc(struct latin_solver *solver, digit *grid, int o)
 {
     int x, y;
+    bitword all;
+
+    assert(o <= BS_BITS);
+    all = (o == BS_BITS ? ~(bitword)0 : BS_BIT(o) - 1);
 
     solver->o = o;
-    solver->cube = snewn(o*o*o, unsigned char);
+    solver->cube = snewn(o*o, bitword);
+    solver->rowpos = snewn(o*o, bitword);
+    solver->colpos = snewn(o*o, bitword);
     solver->grid = grid;		/* write straight back to the input */
-    memset(solver->cube, TRUE, o*o*o);
+    for (x = 0; x < o*o; x++)
+        solver->cube[x] = solver->rowpos[x] = solver->colpos[x] = all;
 
     solver->row = snewn(o*o, unsigned char);
     solver->col = snewn(o*o, unsigned char);
@@ -564,6 +618,8 @@ void latin_solver_alloc(struct latin_solver *solver, digit *grid, int o)
 void latin_solver_free(struct latin_solver *solver)
 {
     sfree(solver->cube);
+    sfree(solver->rowpos);
+    sfree(solver->colpos);
     sfree(solver->row);
     sfree(solver->col);
 }
@@ -694,10 +750,7 @@ int latin_solver_recurse(struct latin_solver *solver, int recdiff,
                  * An unfilled square. Count the number of
                  * possible digits in it.
                  */
-                count = 0;
-                for (n = 1; n <= o; n++)
-                    if (cube(x,YTRANS(y),n))
-                        count++;
+                count = bw_count(solver->cube[x*o+YTRANS(y)]);
 
                 /*
                  * We should have found any impossibilities
@@ -845,7 +898,15 @@ static int latin_solver_sub(struct latin_solver *solver, int maxdiff, void *ctx)
          * one, so I'm apologetically resorting to a goto.
          */
 	cont:
-        latin_solver_debug(solver->cube, solver->o);
+#ifdef STANDALONE_SOLVER
+        if (solver_show_working) {
+            unsigned char *cube = snewn(solver->o*solver->o*solver->o,
+                                        unsigned char);
+            latin_solver_get_cube(solver, cube);
+            latin_solver_debug(cube, solver->o);
+            sfree(cube);
+        }
+#endif
 
         ret = latin_solver_diff_simple(solver);
         if (ret < 0) {
@@ -955,17 +1016,14 @@ void latin_solver_debug(unsigned char *cube, int o)
 {
 #ifdef STANDALONE_SOLVER
     if (solver_show_working) {
-        struct latin_solver ls, *solver = &ls;
         char *dbg;
         int x, y, i, c = 0;
 
-        ls.cube = cube; ls.o = o; /* for cube() to work */
-
         dbg = snewn(3*o*o*o, char);
         for (y = 0; y < o; y++) {
             for (x = 0; x < o; x++) {
                 for (i = 1; i <= o; i++) {
-                    if (cube(x,y,i))
+                    if (cube[(x*o+y)*o+i-1])
                         dbg[c++] = i + '0';
                     else
                         dbg[c++] = '.';
@@ -1149,6 +1207,132 @@ digit *latin_generate(int o, random_state *rs)
     return sq;
 }
 
+/*
+ * Alternative generator: a random walk over latin squares, using
+ * the Markov chain of Jacobson and Matthews (`Generating uniformly
+ * distributed random latin squares', J. Combinatorial Designs
+ * 1996), whose stationary distribution is uniform.
+ *
+ * A latin square is viewed as an o^3 cube of 0s and 1s, indexed by
+ * row, column and digit, with exactly one 1 on every line parallel
+ * to an axis. The chain also passes through `improper' squares, in
+ * which one cell of the cube holds -1 and the three lines through
+ * it each hold two 1s. A move picks a cell (r,c,s) which is 0 (or
+ * the -1 cell, if improper), finds r', c' and s' such that
+ * (r',c,s), (r,c',s) and (r,c,s') are 1 (choosing at random
+ * between the two candidates on each line when improper), then adds
+ * 1 to (r,c,s), (r,c',s'), (r',c,s') and (r',c',s) and subtracts 1
+ * from (r',c,s), (r,c',s), (r,c,s') and (r',c',s'). If that last
+ * cell goes to -1 the result is improper.
+ *
+ * We start from a cyclic square with its rows, columns and digits
+ * shuffled, make at least `steps' moves, and then carry on until
+ * the square is proper. That last part needs care: stopping at the
+ * very first proper square after an improper stretch favours
+ * squares with many improper neighbours (badly so at order 4), so
+ * if we are improper we only look again every o^2 moves, by which
+ * point the chain has forgotten where the stretch started. If
+ * `steps' is zero or negative we use o^3, which in practice is
+ * ample for the orders the puzzles use; a caller wanting more
+ * confidence in uniformity can pass more.
+ *
+ * latin_generate() is far from uniform: at order 4 some squares
+ * come up several times as often as others, which `latin --stats'
+ * shows. This one is uniform to within what that test can measure,
+ * but each move costs O(o) and a random number, so with the default
+ * budget it is some five times slower at the orders the puzzles use.
+ */
+digit *latin_generate_mcmc(int o, random_state *rs, int steps)
+{
+    signed char *cube;
+    digit *sq, *perm;
+    int improper, r, c, s, r2, c2, s2, i, j;
+
+#define CUBE(r,c,s) cube[((r)*o+(c))*o+(s)]
+
+    sq = snewn(o*o, digit);
+    if (o == 1) {
+        sq[0] = 1;
+        return sq;
+    }
+    if (steps <= 0)
+        steps = o*o*o;
+
+    cube = snewn(o*o*o, signed char);
+    memset(cube, 0, o*o*o);
+    perm = snewn(3*o, digit);
+    for (i = 0; i < 3*o; i++)
+        perm[i] = i % o;
+    shuffle(perm, o, sizeof(*perm), rs);
+    shuffle(perm+o, o, sizeof(*perm), rs);
+    shuffle(perm+2*o, o, sizeof(*perm), rs);
+    for (r = 0; r < o; r++)
+        for (c = 0; c < o; c++)
+            CUBE(perm[r], perm[o+c], perm[2*o + (r+c) % o]) = 1;
+    sfree(perm);
+
+    improper = FALSE;
+    r = c = s = 0;                     /* the -1 cell, when improper */
+    for (i = 0; i < steps || improper || (i - steps) % (o*o); i++) {
+        if (!improper) {
+            /*
+             * Pick a random 0 cell: any row and column, and any
+             * digit other than the one already there.
+             */
+            j = random_upto(rs, o*o*(o-1));
+            r = j % o;
+            c = j / o % o;
+            for (s2 = 0; !CUBE(r,c,s2); s2++);
+            s = j / (o*o);
+            if (s >= s2)
+                s++;
+            for (r2 = 0; !CUBE(r2,c,s); r2++);
+            for (c2 = 0; !CUBE(r,c2,s); c2++);
+        } else {
+            /*
+             * Each line through the -1 cell has two 1s on it; pick
+             * one at random from each.
+             */
+            int which, bits = random_upto(rs, 8);
+
+            which = bits & 1;
+            for (r2 = 0; CUBE(r2,c,s) != 1 || which--; r2++);
+            which = (bits >> 1) & 1;
+            for (c2 = 0; CUBE(r,c2,s) != 1 || which--; c2++);
+            which = bits >> 2;
+            for (s2 = 0; CUBE(r,c,s2) != 1 || which--; s2++);
+        }
+
+        CUBE(r,c,s)++;
+        CUBE(r,c2,s2)++;
+        CUBE(r2,c,s2)++;
+        CUBE(r2,c2,s)++;
+        CUBE(r,c,s2)--;
+        CUBE(r,c2,s)--;
+        CUBE(r2,c,s)--;
+        CUBE(r2,c2,s2)--;
+
+        improper = (CUBE(r2,c2,s2) < 0);
+        if (improper) {
+            r = r2;
+            c = c2;
+            s = s2;
+        }
+    }
+
+    for (r = 0; r < o; r++)
+        for (c = 0; c < o; c++) {
+            for (j = 0; !CUBE(r,c,j); j++);
+            assert(CUBE(r,c,j) == 1);
+            sq[r*o+c] = j+1;
+        }
+
+#undef CUBE
+
+    sfree(cube);
+    return sq;
+}
+
 /* --------------------------------------------------------
  * Checking.
  */
@@ -1220,9 +1404,22 @@ int latin_check(digit *sq, int order)
 
 #include <stdio.h>
 #include <time.h>
+#include <math.h>
 
 const char *quis;
 
+/* Which generator to test: latin_generate(), or if this is
+ * non-negative, latin_generate_mcmc() with this many steps. */
+static int mcmc_steps = -1;
+
+static digit *test_generate(int order, random_state *rs)
+{
+    if (mcmc_steps >= 0)
+        return latin_generate_mcmc(order, rs, mcmc_steps);
+    else
+        return latin_generate(order, rs);
+}
+
 static void latin_print(digit *sq, int order)
 {
     int x, y;
@@ -1242,7 +1439,7 @@ static void gen(int order, random_state *rs, int debug)
 
     solver_show_working = debug;
 
-    sq = latin_generate(order, rs);
+    sq = test_generate(order, rs);
     latin_print(sq, order);
     if (latin_check(sq, order)) {
 	fprintf(stderr, "Square is not a latin square!");
@@ -1262,7 +1459,7 @@ void test_soak(int order, random_state *rs)
     tt_now = tt_start = time(NULL);
 
     while(1) {
-        sq = latin_generate(order, rs);
+        sq = test_generate(order, rs);
         sfree(sq);
         n++;
 
@@ -1275,11 +1472,73 @@ void test_soak(int order, random_state *rs)
     }
 }
 
+struct stats_entry {
+    digit sq[16];                      /* order 4 at most, zero-padded */
+    int count;
+};
+
+static int stats_cmp(void *av, void *bv)
+{
+    struct stats_entry *a = (struct stats_entry *)av;
+    struct stats_entry *b = (struct stats_entry *)bv;
+    return memcmp(a->sq, b->sq, sizeof(a->sq));
+}
+
+/*
+ * Generate n squares of an order small enough for us to know how
+ * many latin squares it has, count how often each one comes up,
+ * and report the chi-squared statistic against a uniform
+ * distribution. Its expected value is the number of squares minus
+ * one, with standard deviation about the square root of twice that.
+ */
+static void test_stats(int order, int n, random_state *rs)
+{
+    static const int nsquares[] = { 0, 1, 2, 12, 576 };
+    tree234 *seen = newtree234(stats_cmp);
+    struct stats_entry *e, *found;
+    double expected, chisq = 0.0;
+    int i;
+
+    if (order < 1 || order > 4) {
+        fprintf(stderr, "%s: --stats needs an order from 1 to 4\n", quis);
+        exit(1);
+    }
+
+    for (i = 0; i < n; i++) {
+        digit *sq = test_generate(order, rs);
+        e = snew(struct stats_entry);
+        memset(e->sq, 0, sizeof(e->sq));
+        memcpy(e->sq, sq, order*order);
+        e->count = 0;
+        sfree(sq);
+        found = add234(seen, e);
+        if (found != e)
+            sfree(e);
+        found->count++;
+    }
+
+    expected = (double)n / nsquares[order];
+    for (i = 0; (e = index234(seen, i)) != NULL; i++) {
+        double d = e->count - expected;
+        chisq += d * d / expected;
+    }
+    chisq += (nsquares[order] - count234(seen)) * expected;
+
+    printf("order %d: %d samples, %d of %d squares seen, "
+           "chi-squared %.1f (expect %d +- %.0f)\n",
+           order, n, count234(seen), nsquares[order], chisq,
+           nsquares[order] - 1, sqrt(2.0 * (nsquares[order] - 1)));
+
+    while ((e = delpos234(seen, 0)) != NULL)
+        sfree(e);
+    freetree234(seen);
+}
+
 void usage_exit(const char *msg)
 {
     if (msg)
         fprintf(stderr, "%s: %s\n", quis, msg);
-    fprintf(stderr, "Usage: %s [--seed SEED] --soak <params> | [game_id [game_id ...]]\n", quis);
+    fprintf(stderr, "Usage: %s [--seed SEED] [--mcmc STEPS] --soak <params> | --stats <order> <n> | [game_id [game_id ...]]\n", quis);
     exit(1);
 }
 
@@ -1294,7 +1553,14 @@ int main(int argc, char *argv[])
 	const char *p = *++argv;
 	if (!strcmp(p, "--soak"))
 	    soak = 1;
-	else if (!strcmp(p, "--seed")) {
+	else if (!strcmp(p, "--stats"))
+	    soak = 2;
+	else if (!strcmp(p, "--mcmc")) {
+	    if (argc == 0)
+		usage_exit("--mcmc needs an argument");
+	    mcmc_steps = atoi(*++argv);
+	    argc--;
+	} else if (!strcmp(p, "--seed")) {
 	    if (argc == 0)
 		usage_exit("--seed needs an argument");
 	    seed = (time_t)atoi(*++argv);
@@ -1310,6 +1576,9 @@ int main(int argc, char *argv[])
     if (soak == 1) {
 	if (argc != 1) usage_exit("only one argument for --soak");
 	test_soak(atoi(*argv), rs);
+    } else if (soak == 2) {
+	if (argc != 2) usage_exit("--stats needs an order and a count");
+	test_stats(atoi(argv[0]), atoi(argv[1]), rs);
     } else {
 	if (argc > 0) {
 	    for (i = 0; i < argc; i++) {
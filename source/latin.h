@@ -2,6 +2,7 @@
 #define LATIN_H
 
 #include "puzzles.h"
+#include "bitset.h"
 
 typedef unsigned char digit;
 
@@ -12,16 +13,33 @@ int solver_show_working, solver_recurse_depth;
 #endif
 
 struct latin_solver {
-  int o;                /* order of latin square */
-  unsigned char *cube;  /* o^3, indexed by x, y, and digit:
-                           TRUE in that position indicates a possibility */
+  int o;                /* order of latin square, at most BS_BITS */
+
+  /*
+   * The possibilities, stored three ways so that each of the
+   * solver's questions is a mask operation. They must only be
+   * changed through latin_solver_rule_out() and friends, which
+   * keep them consistent.
+   */
+  bitword *cube;        /* o^2, indexed by x and y: bit n-1 set if n
+                           is a possibility in that square */
+  bitword *rowpos;      /* o^2: rowpos[y*o+n-1] has bit x set if n is
+                           a possibility at (x,y) */
+  bitword *colpos;      /* o^2: colpos[x*o+n-1] has bit y set if n is
+                           a possibility at (x,y) */
+
   digit *grid;          /* o^2, indexed by x and y: for final deductions */
 
   unsigned char *row;   /* o^2: row[y*cr+n-1] TRUE if n is in row y */
   unsigned char *col;   /* o^2: col[x*cr+n-1] TRUE if n is in col x */
 };
+/*
+ * Positions in the notional o^3 cube of possibilities, indexed by
+ * x, y and digit. latin_solver_elim() and latin_solver_set() are
+ * given lines of this cube by start position and step.
+ */
 #define cubepos(x,y,n) (((x)*solver->o+(y))*solver->o+(n)-1)
-#define cube(x,y,n) (solver->cube[cubepos(x,y,n)])
+#define cube(x,y,n) ((int)(solver->cube[(x)*solver->o+(y)] >> ((n)-1)) & 1)
 
 #define gridpos(x,y) ((y)*solver->o+(x))
 #define grid(x,y) (solver->grid[gridpos(x,y)])
@@ -40,6 +58,13 @@ struct latin_solver {
 /* Place a value at a specific location. */
 void latin_solver_place(struct latin_solver *solver, int x, int y, int n);
 
+/* Rule out a value at a specific location (y transformed, as above). */
+void latin_solver_rule_out(struct latin_solver *solver, int x, int y, int n);
+
+/* Copy the possibilities out as an o^3 array of booleans, indexed
+ * like cubepos() (e.g. for latin_solver_debug()). */
+void latin_solver_get_cube(struct latin_solver *solver, unsigned char *cube);
+
 /* Positional elimination. */
 int latin_solver_elim(struct latin_solver *solver, int start, int step
 #ifdef STANDALONE_SOLVER
@@ -106,6 +131,9 @@ void latin_solver_debug(unsigned char *cube, int o);
 
 digit *latin_generate_quick(int o, random_state *rs);
 digit *latin_generate(int o, random_state *rs);
+/* Markov chain generator: uniform (latin_generate is not), but slower.
+ * `steps' is the minimum number of moves, or <= 0 for a default. */
+digit *latin_generate_mcmc(int o, random_state *rs, int steps);
 
 int latin_check(digit *sq, int order); /* !0 => not a latin square */
 
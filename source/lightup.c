@@ -2101,6 +2101,43 @@ static void tile_redraw(drawing *dr, game_drawstate *ds, game_state *state,
     draw_update(dr, dx, dy, TILE_SIZE, TILE_SIZE);
 }
 
+static int game_redraw_region(game_drawstate *ds, game_state *oldstate,
+			      game_state *state, int dir, game_ui *ui,
+			      float animtime, float flashtime,
+			      int *rx, int *ry, int *rw, int *rh)
+{
+    int flashing = FALSE;
+    int x, y, x0 = ds->w, y0 = ds->h, x1 = -1, y1 = -1;
+
+    if (flashtime) flashing = (int)(flashtime * 3 / FLASH_TIME) != 1;
+
+    if (!ds->started) {
+        *rx = *ry = 0;
+        *rw = TILE_SIZE * ds->w + 2 * BORDER;
+        *rh = TILE_SIZE * ds->h + 2 * BORDER;
+        return TRUE;
+    }
+
+    for (x = 0; x < ds->w; x++) {
+        for (y = 0; y < ds->h; y++) {
+            if (tile_flags(ds, state, ui, x, y, flashing) !=
+                GRID(ds, flags, x, y)) {
+                x0 = min(x0, x); x1 = max(x1, x);
+                y0 = min(y0, y); y1 = max(y1, y);
+            }
+        }
+    }
+
+    if (x1 < 0)
+        return FALSE;
+
+    *rx = COORD(x0);
+    *ry = COORD(y0);
+    *rw = TILE_SIZE * (x1 - x0 + 1);
+    *rh = TILE_SIZE * (y1 - y0 + 1);
+    return TRUE;
+}
+
 static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
 			game_state *state, int dir, game_ui *ui,
 			float animtime, float flashtime)
@@ -2185,11 +2222,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILE_SIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    game_redraw_region,
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
@@ -106,11 +106,22 @@ enum {
     NCOLOURS
 };
 
-struct game_state {
-    grid *game_grid;
+/*
+ * The clues don't change during play, so they live in a block
+ * shared by every state in the game (alongside the grid, which is
+ * refcounted by grid.c). Only the generator writes to it, and only
+ * while it holds the sole reference.
+ */
+struct game_immutable_state {
+    int refcount;
 
     /* Put -1 in a face that doesn't get a clue */
     signed char *clues;
+};
+
+struct game_state {
+    grid *game_grid;
+    struct game_immutable_state *imm;
 
     /* Array of line states, to store whether each line is
      * YES, NO or UNKNOWN */
@@ -161,6 +172,7 @@ typedef struct solver_state {
 
     /* Hard level information */
     int *linedsf;
+    int *linecanon;	/* scratch: canonical line and inverse flag per line */
 } solver_state;
 
 /*
@@ -327,8 +339,8 @@ static game_state *dup_game(game_state *state)
     ret->solved = state->solved;
     ret->cheated = state->cheated;
 
-    ret->clues = snewn(state->game_grid->num_faces, signed char);
-    memcpy(ret->clues, state->clues, state->game_grid->num_faces);
+    ret->imm = state->imm;
+    ret->imm->refcount++;
 
     ret->lines = snewn(state->game_grid->num_edges, char);
     memcpy(ret->lines, state->lines, state->game_grid->num_edges);
@@ -344,7 +356,10 @@ static void free_game(game_state *state)
 {
     if (state) {
         grid_free(state->game_grid);
-        sfree(state->clues);
+        if (--state->imm->refcount <= 0) {
+            sfree(state->imm->clues);
+            sfree(state->imm);
+        }
         sfree(state->lines);
         sfree(state->line_errors);
         sfree(state);
@@ -393,8 +408,10 @@ static solver_state *new_solver_state(game_state *state, int diff) {
 
     if (diff < DIFF_HARD) {
         ret->linedsf = NULL;
+        ret->linecanon = NULL;
     } else {
         ret->linedsf = snew_dsf(state->game_grid->num_edges);
+        ret->linecanon = snewn(2*state->game_grid->num_edges, int);
     }
 
     return ret;
@@ -415,6 +432,7 @@ static void free_solver_state(solver_state *sstate) {
         /* OK, because sfree(NULL) is a no-op */
         sfree(sstate->dlines);
         sfree(sstate->linedsf);
+        sfree(sstate->linecanon);
 
         sfree(sstate);
     }
@@ -466,8 +484,10 @@ static solver_state *dup_solver_state(const solver_state *sstate) {
         ret->linedsf = snewn(num_edges, int);
         memcpy(ret->linedsf, sstate->linedsf,
                num_edges * sizeof(int));
+        ret->linecanon = snewn(2*num_edges, int);
     } else {
         ret->linedsf = NULL;
+        ret->linecanon = NULL;
     }
 
     return ret;
@@ -678,7 +698,7 @@ static char *state_to_text(const game_state *state)
     int i;
 
     for (i = 0; i < num_faces; i++) {
-        if (state->clues[i] < 0) {
+        if (state->imm->clues[i] < 0) {
             if (empty_count > 25) {
                 dp += sprintf(dp, "%c", (int)(empty_count + 'a' - 1));
                 empty_count = 0;
@@ -689,7 +709,7 @@ static char *state_to_text(const game_state *state)
                 dp += sprintf(dp, "%c", (int)(empty_count + 'a' - 1));
                 empty_count = 0;
             }
-            dp += sprintf(dp, "%c", (int)CLUE2CHAR(state->clues[i]));
+            dp += sprintf(dp, "%c", (int)CLUE2CHAR(state->imm->clues[i]));
         }
     }
 
@@ -1023,7 +1043,7 @@ static char *game_text_format(game_state *state)
         /* Midpoint, in canvas coordinates */
         x = x1 + x2;
         y = y1 + y2;
-        ret[y*W + x] = CLUE2CHAR(state->clues[i]);
+        ret[y*W + x] = CLUE2CHAR(state->imm->clues[i]);
     }
     return ret;
 }
@@ -1538,7 +1558,7 @@ static int face_score(grid *g, char *board, grid_face *face,
  */
 static void add_full_clues(game_state *state, random_state *rs)
 {
-    signed char *clues = state->clues;
+    signed char *clues = state->imm->clues;
     char *board;
     grid *g = state->game_grid;
     int i, j;
@@ -1789,15 +1809,16 @@ static int game_has_unique_soln(const game_state *state, int diff)
 }
 
 
-/* Remove clues one at a time at random. */
-static game_state *remove_clues(game_state *state, random_state *rs,
-                                int diff)
+/* Remove clues one at a time at random. The caller must hold the
+ * only reference to state's clues, since they're modified in place. */
+static void remove_clues(game_state *state, random_state *rs, int diff)
 {
     int *face_list;
     int num_faces = state->game_grid->num_faces;
-    game_state *ret = dup_game(state), *saved_ret;
     int n;
 
+    assert(state->imm->refcount == 1);
+
     /* We need to remove some clues.  We'll do this by forming a list of all
      * available clues, shuffling it, then going along one at a
      * time clearing each clue in turn for which doing so doesn't render the
@@ -1810,19 +1831,13 @@ static game_state *remove_clues(game_state *state, random_state *rs,
     shuffle(face_list, num_faces, sizeof(int), rs);
 
     for (n = 0; n < num_faces; ++n) {
-        saved_ret = dup_game(ret);
-        ret->clues[face_list[n]] = -1;
+        int f = face_list[n], clue = state->imm->clues[f];
 
-        if (game_has_unique_soln(ret, diff)) {
-            free_game(saved_ret);
-        } else {
-            free_game(ret);
-            ret = saved_ret;
-        }
+        state->imm->clues[f] = -1;
+        if (!game_has_unique_soln(state, diff))
+            state->imm->clues[f] = clue;
     }
     sfree(face_list);
-
-    return ret;
 }
 
 
@@ -1833,11 +1848,12 @@ static char *new_game_desc(game_params *params, random_state *rs,
     char *retval;
     grid *g;
     game_state *state = snew(game_state);
-    game_state *state_new;
     params_generate_grid(params);
     state->game_grid = g = params->game_grid;
     g->refcount++;
-    state->clues = snewn(g->num_faces, signed char);
+    state->imm = snew(struct game_immutable_state);
+    state->imm->refcount = 1;
+    state->imm->clues = snewn(g->num_faces, signed char);
     state->lines = snewn(g->num_edges, char);
     state->line_errors = snewn(g->num_edges, unsigned char);
 
@@ -1857,9 +1873,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
         add_full_clues(state, rs);
     } while (!game_has_unique_soln(state, params->diff));
 
-    state_new = remove_clues(state, rs, params->diff);
-    free_game(state);
-    state = state_new;
+    remove_clues(state, rs, params->diff);
 
 
     if (params->diff > 0 && game_has_unique_soln(state, params->diff-1)) {
@@ -1894,7 +1908,9 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
     num_faces = g->num_faces;
     num_edges = g->num_edges;
 
-    state->clues = snewn(num_faces, signed char);
+    state->imm = snew(struct game_immutable_state);
+    state->imm->refcount = 1;
+    state->imm->clues = snewn(num_faces, signed char);
     state->lines = snewn(num_edges, char);
     state->line_errors = snewn(num_edges, unsigned char);
 
@@ -1905,18 +1921,18 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
     for (i = 0; i < num_faces; i++) {
         if (empties_to_make) {
             empties_to_make--;
-            state->clues[i] = -1;
+            state->imm->clues[i] = -1;
             continue;
         }
 
         assert(*dp);
         n = *dp - '0';
         if (n >= 0 && n < 10) {
-            state->clues[i] = n;
+            state->imm->clues[i] = n;
         } else {
             n = *dp - 'a' + 1;
             assert(n > 0);
-            state->clues[i] = -1;
+            state->imm->clues[i] = -1;
             empties_to_make = n - 1;
         }
         ++dp;
@@ -2049,7 +2065,7 @@ static int check_completion(game_state *state)
         /* Yes, so check all clues are satisfied */
         int found_clue_violation = FALSE;
         for (i = 0; i < num_faces; i++) {
-            int c = state->clues[i];
+            int c = state->imm->clues[i];
             if (c >= 0) {
                 if (face_order(state, i, LINE_YES) != c) {
                     found_clue_violation = TRUE;
@@ -2424,25 +2440,25 @@ static int trivial_deductions(solver_state *sstate)
             continue;
         }
 
-        if (state->clues[i] < 0)
+        if (state->imm->clues[i] < 0)
             continue;
 
-        if (state->clues[i] < current_yes) {
+        if (state->imm->clues[i] < current_yes) {
             sstate->solver_status = SOLVER_MISTAKE;
             return DIFF_EASY;
         }
-        if (state->clues[i] == current_yes) {
+        if (state->imm->clues[i] == current_yes) {
             if (face_setall(sstate, i, LINE_UNKNOWN, LINE_NO))
                 diff = min(diff, DIFF_EASY);
             sstate->face_solved[i] = TRUE;
             continue;
         }
 
-        if (f->order - state->clues[i] < current_no) {
+        if (f->order - state->imm->clues[i] < current_no) {
             sstate->solver_status = SOLVER_MISTAKE;
             return DIFF_EASY;
         }
-        if (f->order - state->clues[i] == current_no) {
+        if (f->order - state->imm->clues[i] == current_no) {
             if (face_setall(sstate, i, LINE_UNKNOWN, LINE_YES))
                 diff = min(diff, DIFF_EASY);
             sstate->face_solved[i] = TRUE;
@@ -2554,7 +2570,7 @@ static int dline_deductions(solver_state *sstate)
         grid_face *f = g->faces + i;
         int N = f->order;
         int j,m;
-        int clue = state->clues[i];
+        int clue = state->imm->clues[i];
         assert(N <= MAX_FACE_SIZE);
         if (sstate->face_solved[i])
             continue;
@@ -2848,7 +2864,7 @@ static int linedsf_deductions(solver_state *sstate)
 
         if (sstate->face_solved[i])
             continue;
-        clue = state->clues[i];
+        clue = state->imm->clues[i];
         if (clue < 0)
             continue;
 
@@ -2929,11 +2945,14 @@ static int linedsf_deductions(solver_state *sstate)
     /* ------ Edge dsf deductions ------ */
 
     /* If the state of a line is known, deduce the state of its canonical line
-     * too, and vice versa. */
+     * too, and vice versa.  Setting lines doesn't touch the linedsf, so we
+     * can canonify every line in one pass up front. */
+    edsf_canonify_all(sstate->linedsf, g->num_edges,
+                      sstate->linecanon, sstate->linecanon + g->num_edges);
     for (i = 0; i < g->num_edges; i++) {
-        int can, inv;
+        int can = sstate->linecanon[i];
+        int inv = sstate->linecanon[g->num_edges + i];
         enum line_state s;
-        can = edsf_canonify(sstate->linedsf, i, &inv);
         if (can == i)
             continue;
         s = sstate->state->lines[can];
@@ -2981,7 +3000,7 @@ static int loop_deductions(solver_state *sstate)
      * satisfied-minus-one clues.
      */
     for (i = 0; i < g->num_faces; i++) {
-        int c = state->clues[i];
+        int c = state->imm->clues[i];
         if (c >= 0) {
             int o = sstate->face_yes_count[i];
             if (o == c)
@@ -3056,13 +3075,13 @@ static int loop_deductions(solver_state *sstate)
             sm1_nearby = 0;
             if (e->face1) {
                 int f = e->face1 - g->faces;
-                int c = state->clues[f];
+                int c = state->imm->clues[f];
                 if (c >= 0 && sstate->face_yes_count[f] == c - 1)
                     sm1_nearby++;
             }
             if (e->face2) {
                 int f = e->face2 - g->faces;
-                int c = state->clues[f];
+                int c = state->imm->clues[f];
                 if (c >= 0 && sstate->face_yes_count[f] == c - 1)
                     sm1_nearby++;
             }
@@ -3358,6 +3377,56 @@ static game_state *execute_move(game_state *state, char *move)
     return NULL;
 }
 
+/*
+ * Checkpoint encoding of a game state for save files: flags for
+ * solved and cheated, then one character per edge.
+ */
+static char *encode_state(game_state *state)
+{
+    int num_edges = state->game_grid->num_edges;
+    char *ret = snewn(num_edges + 4, char), *p = ret;
+    int i;
+
+    *p++ = state->solved ? 'W' : '-';
+    *p++ = state->cheated ? 'S' : '-';
+    *p++ = ',';
+    for (i = 0; i < num_edges; i++)
+	*p++ = (state->lines[i] == LINE_YES ? 'y' :
+		state->lines[i] == LINE_NO ? 'n' : 'u');
+    *p = '\0';
+
+    return ret;
+}
+
+static game_state *decode_state(game_state *initial, char *encoding)
+{
+    int num_edges = initial->game_grid->num_edges;
+    game_state *ret;
+    int i;
+
+    if (strlen(encoding) != (size_t)num_edges + 3 || encoding[2] != ',')
+	return NULL;
+
+    ret = dup_game(initial);
+    ret->solved = (encoding[0] == 'W');
+    ret->cheated = (encoding[1] == 'S');
+    for (i = 0; i < num_edges; i++) {
+	switch (encoding[i+3]) {
+	  case 'y': ret->lines[i] = LINE_YES; break;
+	  case 'n': ret->lines[i] = LINE_NO; break;
+	  case 'u': ret->lines[i] = LINE_UNKNOWN; break;
+	  default:
+	    free_game(ret);
+	    return NULL;
+	}
+    }
+
+    /* Recompute line_errors; `solved' is sticky, so keep ours. */
+    check_completion(ret);
+
+    return ret;
+}
+
 /* ----------------------------------------------------------------------
  * Drawing routines.
  */
@@ -3466,7 +3535,7 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
 	    grid_face *f;
             int x, y;
 
-            c[0] = CLUE2CHAR(state->clues[i]);
+            c[0] = CLUE2CHAR(state->imm->clues[i]);
             c[1] = '\0';
             f = g->faces + i;
             face_text_pos(ds, g, f, &x, &y);
@@ -3542,7 +3611,7 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
         grid_face *f = g->faces + i;
         int sides = f->order;
         int j;
-        n = state->clues[i];
+        n = state->imm->clues[i];
         if (n < 0)
             continue;
 
@@ -3730,15 +3799,17 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    encode_state, decode_state,
     PREFERRED_TILE_SIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    NULL,				       /* redraw_region */
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
     FALSE /* wants_statusbar */,
     FALSE, game_timing_state,
-    0,                                       /* mouse_priorities */
+    FAST_RANDOM,                             /* flags */
 };
@@ -15,36 +15,87 @@
 // Define this to enable debugging messages for the upper memory area.
 // #define DEBUG_UPPER_MEMORY  // Upper memory access on the GP2X.
 
+// Define this to fill arena memory with junk as it is handed out and
+// again as it is released, so that code reading uninitialised or
+// already-released arena memory fails visibly.
+// #define DEBUG_ARENA
+
+// Define this (or build with -DPROFILE_ALLOC) to keep per-call-site
+// allocation statistics, reported by smalloc_report() and at exit.
+// #define PROFILE_ALLOC
+
 
 #include <stdlib.h>
 #include <string.h>
+#include <assert.h>
 #include "puzzles.h"
 #include "malloc.h"
 
 #include <stdio.h>
 #include <fcntl.h>
-//#include <sys/mman.h>
+#ifdef OPTION_USE_UPPER_MEMORY
+#include <sys/mman.h>
+#endif
 #include <unistd.h>
 
 int Uppermemfd;
 void *UpperMem;
 
-#define BLOCKSIZE 1024
+static int UpperOwns(void *p);
 
-int TakenSize[0x2000000 / BLOCKSIZE];
+#ifdef OPTION_USE_UPPER_MEMORY
+/*
+ * When srealloc has to move a normal-heap block into upper memory it
+ * needs to know how much of the block to copy, and the C library
+ * won't tell us. So with upper memory in use, every normal-heap block
+ * starts with a header recording its size, much as GetUpperSize()
+ * works it out for upper-heap blocks.
+ */
+union normal_header {
+    size_t size;
+    long l;			       /* force worst-case alignment */
+    double d;
+    void *p;
+};
+#define NORMAL_HEADER(p) ((union normal_header *)(p) - 1)
+#endif
 
-#define SetTaken(Start, Size) TakenSize[(Start - 0x2000000) / BLOCKSIZE] = (Size - 1) / BLOCKSIZE + 1
+/*
+ * Running total of bytes requested, for rough footprint measurements.
+ * It is cumulative, not a count of live memory: sfree never reduces
+ * it, and srealloc adds the whole new size, not the growth. The
+ * difference across a call therefore says how much that call asked
+ * for, which is an upper bound on what it left allocated.
+ */
+static unsigned long TotalRequested = 0;
+
+unsigned long smalloc_total(void)
+{
+    return TotalRequested;
+}
 
 
 /*
  * smalloc should guarantee to return a useful pointer - Halibut
  * can do nothing except die when it's out of memory anyway.
  */
-void *smalloc(size_t size)
+static void *smalloc_raw(size_t size)
 {
     void *p=NULL;
+
 #ifndef DEBUG_PRETEND_MEMORY_FULL
+ #ifdef OPTION_USE_UPPER_MEMORY
+    {
+        union normal_header *h = malloc(sizeof(*h) + size);
+        if (h)
+        {
+            h->size = size;
+            p = h + 1;
+        };
+    }
+ #else
     p = malloc(size);
+ #endif
 #endif
 
     if (!p)
@@ -64,24 +115,23 @@ void *smalloc(size_t size)
 /*
  * sfree should guaranteeably deal gracefully with freeing NULL
  */
-void sfree(void *p) {
+static void sfree_raw(void *p) {
     if (p)
     {
 #ifdef OPTION_USE_UPPER_MEMORY
-        int i = (((int)p) - ((int)UpperMem));
-        if (i < 0 || i >= 0x2000000)
+        if (!UpperOwns(p))
         {
  #ifdef DEBUG_UPPER_MEMORY
             printf("Requested free of not UpperMalloced mem: %p\nTrying normal free...", p);
  #endif
-#endif
-            free(p);
-#ifdef OPTION_USE_UPPER_MEMORY
+            free(NORMAL_HEADER(p));
         }
         else
         {
             UpperFree(p);
         };
+#else
+        free(p);
 #endif
     }
 }
@@ -89,107 +139,810 @@ void sfree(void *p) {
 /*
  * srealloc should guaranteeably be able to realloc NULL
  */
-void *srealloc(void *p, size_t size)
+static void *srealloc_raw(void *p, size_t size)
 {
     void *q=NULL;
 
     if (p)
     {
 #ifdef OPTION_USE_UPPER_MEMORY
-        int i = (((int)p) - ((int)UpperMem));
-        if (i < 0 || i >= 0x2000000)
+        int inupper = UpperOwns(p);
+        if (!inupper)
+        {
+            union normal_header *h =
+                realloc(NORMAL_HEADER(p), sizeof(*h) + size);
+            if (h)
+            {
+                h->size = size;
+                q = h + 1;
+            };
+        }
+#else
+        q = realloc(p, size);
 #endif
-            q = realloc(p, size);
         if (!q)
         {
 #ifdef OPTION_USE_UPPER_MEMORY
+            /*
+             * Move the block into upper memory, or within it. Only
+             * as much as the old block held is copied.
+             */
+            size_t oldsize = size;
+            if (inupper && (size_t)GetUpperSize(p) >= size)
+                return p;
             q = UpperMalloc(size);
             if(!q)
                 fatal("Out of memory");
-
-            memcpy(q, p, size);
-            if(memcmp(q,p,size) != 0)
+            if (inupper) {
+                oldsize = GetUpperSize(p);
+                memcpy(q, p, oldsize < size ? oldsize : size);
+                UpperFree(p);
+            } else {
+                oldsize = NORMAL_HEADER(p)->size;
+                memcpy(q, p, oldsize < size ? oldsize : size);
+                free(NORMAL_HEADER(p));
+            }
+#else
+                fatal("Out of memory");
 #endif
-                fatal("Out of memory");    
         };
     }
     else
     {
-	q = smalloc(size);
+	q = smalloc_raw(size);
     };
 
     return q;
 }
 
+#ifdef PROFILE_ALLOC
+
+/*
+ * Allocation profiler. Every block carries a small header recording
+ * its size and the call site that allocated it, so that sfree can
+ * charge the release back to the right site. Call sites are
+ * identified by return address (so a report needs addr2line, or
+ * similar, to turn into source lines; build with -no-pie to make the
+ * addresses stable) and kept in a fixed-size open-addressed table,
+ * so that the profiler never allocates memory itself.
+ *
+ * Sizes are bucketed by powers of two: bucket k counts blocks of at
+ * most 2^k bytes, and the last bucket everything bigger.
+ */
+#ifdef __GNUC__
+#define CALLER_SITE __builtin_return_address(0)
+#else
+#define CALLER_SITE NULL
+#endif
+
+#define PROFILE_SITES 1024	       /* power of two */
+#define PROFILE_BUCKETS 16
+
+struct alloc_site {
+    void *addr;
+    unsigned long count, bytes, live, peak;
+    unsigned long hist[PROFILE_BUCKETS];
+};
+
+union alloc_header {
+    struct {
+        size_t size;
+        struct alloc_site *site;
+    } h;
+    long l;			       /* force worst-case alignment */
+    double d;
+    void *p;
+};
+
+static struct alloc_site AllocSites[PROFILE_SITES];
+static struct alloc_site AllocOverflow;  /* sites beyond the table */
+static unsigned long AllocLive, AllocPeak;
+static int AllocReportRegistered;
+
+static struct alloc_site *profile_site(void *addr)
+{
+    unsigned long h = ((unsigned long)addr >> 2) * 2654435761UL;
+    int i, n;
+
+    for (n = 0; n < PROFILE_SITES; n++) {
+        i = (int)((h + n) & (PROFILE_SITES - 1));
+        if (AllocSites[i].addr == addr && AllocSites[i].count)
+            return &AllocSites[i];
+        if (!AllocSites[i].count) {
+            AllocSites[i].addr = addr;
+            return &AllocSites[i];
+        }
+    }
+    return &AllocOverflow;
+}
+
+static void profile_charge(struct alloc_site *site, size_t size)
+{
+    int k = 0;
+
+    while (k < PROFILE_BUCKETS-1 && ((size_t)1 << k) < size)
+        k++;
+    site->count++;
+    site->hist[k]++;
+    site->bytes += size;
+    site->live += size;
+    if (site->live > site->peak)
+        site->peak = site->live;
+    AllocLive += size;
+    if (AllocLive > AllocPeak)
+        AllocPeak = AllocLive;
+}
+
+static void *profile_alloc(size_t size, void *addr)
+{
+    union alloc_header *hdr = smalloc_raw(sizeof(*hdr) + size);
+
+    if (!AllocReportRegistered) {
+        AllocReportRegistered = TRUE;
+        atexit(smalloc_report);
+    }
+    hdr->h.size = size;
+    hdr->h.site = profile_site(addr);
+    profile_charge(hdr->h.site, size);
+    return hdr + 1;
+}
+
+static void profile_free(void *p)
+{
+    union alloc_header *hdr = (union alloc_header *)p - 1;
+
+    hdr->h.site->live -= hdr->h.size;
+    AllocLive -= hdr->h.size;
+    sfree_raw(hdr);
+}
+
+static void *profile_realloc(void *p, size_t size, void *addr)
+{
+    union alloc_header *hdr = (union alloc_header *)p - 1;
+
+    /* Treated as a free of the old block and a new allocation. */
+    hdr->h.site->live -= hdr->h.size;
+    AllocLive -= hdr->h.size;
+    hdr = srealloc_raw(hdr, sizeof(*hdr) + size);
+    hdr->h.size = size;
+    hdr->h.site = profile_site(addr);
+    profile_charge(hdr->h.site, size);
+    return hdr + 1;
+}
+
+static int profile_cmp(const void *av, const void *bv)
+{
+    const struct alloc_site *a = *(const struct alloc_site *const *)av;
+    const struct alloc_site *b = *(const struct alloc_site *const *)bv;
+
+    if (a->peak != b->peak)
+        return a->peak < b->peak ? +1 : -1;
+    return a->bytes < b->bytes ? +1 : a->bytes > b->bytes ? -1 : 0;
+}
+
+void smalloc_report(void)
+{
+    static struct alloc_site *sorted[PROFILE_SITES + 1];
+    int i, k, n = 0;
+
+    for (i = 0; i < PROFILE_SITES; i++)
+        if (AllocSites[i].count)
+            sorted[n++] = &AllocSites[i];
+    if (AllocOverflow.count)
+        sorted[n++] = &AllocOverflow;
+    qsort(sorted, n, sizeof(*sorted), profile_cmp);
+
+    printf("Allocation profile: %d sites, %lu bytes live, %lu peak\n",
+           n, AllocLive, AllocPeak);
+    printf("%18s %9s %11s %9s %9s  sizes <=1,2,4,...,%d,more\n",
+           "site", "count", "bytes", "live", "peak",
+           1 << (PROFILE_BUCKETS-2));
+    for (i = 0; i < n; i++) {
+        struct alloc_site *site = sorted[i];
+        if (site == &AllocOverflow)
+            printf("%18s", "(others)");
+        else
+            printf("%18p", site->addr);
+        printf(" %9lu %11lu %9lu %9lu ",
+               site->count, site->bytes, site->live, site->peak);
+        for (k = 0; k < PROFILE_BUCKETS; k++)
+            printf(" %lu", site->hist[k]);
+        printf("\n");
+    }
+}
+
+#else
+
+void smalloc_report(void)
+{
+}
+
+#endif
+
+void *smalloc(size_t size)
+{
+    TotalRequested += size;
+#ifdef PROFILE_ALLOC
+    return profile_alloc(size, CALLER_SITE);
+#else
+    return smalloc_raw(size);
+#endif
+}
+
+void sfree(void *p)
+{
+#ifdef PROFILE_ALLOC
+    if (p)
+        profile_free(p);
+#else
+    sfree_raw(p);
+#endif
+}
+
+void *srealloc(void *p, size_t size)
+{
+    TotalRequested += size;
+#ifdef PROFILE_ALLOC
+    if (p)
+        return profile_realloc(p, size, CALLER_SITE);
+    return profile_alloc(size, CALLER_SITE);
+#else
+    return srealloc_raw(p, size);
+#endif
+}
+
 /*
  * dupstr is like strdup, but with the never-return-NULL property
  * of smalloc (and also reliably defined in all environments :-)
  */
 char *dupstr(const char *s) {
-    char *r = smalloc(1+strlen(s));
+    char *r;
+#ifdef PROFILE_ALLOC
+    r = profile_alloc(1+strlen(s), CALLER_SITE);
+    TotalRequested += 1+strlen(s);
+#else
+    r = smalloc(1+strlen(s));
+#endif
     strcpy(r,s);
     return r;
 }
 
+/*
+ * Arena allocator. An arena is a stack of chunks, each carved up from
+ * the bottom; a mark is just a chunk and a fill level within it, so
+ * releasing to a mark is a matter of popping chunks until we get back
+ * to the marked one. Popped chunks are kept on a spare list for reuse
+ * rather than freed, so that a solver which marks and releases on
+ * every call doesn't go back to malloc each time.
+ */
+union arena_align {
+    long l;
+    double d;
+    void *p;
+};
+#define ARENA_ALIGN (sizeof(union arena_align))
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_CHUNK 16384
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size, used;		       /* both exclude the header */
+};
+#define ARENA_HEADER ARENA_ROUND(sizeof(struct arena_chunk))
+#define ARENA_DATA(c) ((char *)(c) + ARENA_HEADER)
+
+struct arena {
+    struct arena_chunk *top;	       /* chunk currently being filled */
+    struct arena_chunk *spare;	       /* released chunks, for reuse */
+};
+
+arena *arena_new(void)
+{
+    arena *a = snew(arena);
+    a->top = a->spare = NULL;
+    return a;
+}
+
+static void arena_freechunks(struct arena_chunk *c)
+{
+    while (c) {
+        struct arena_chunk *next = c->next;
+        sfree(c);
+        c = next;
+    }
+}
+
+void arena_free(arena *a)
+{
+    if (a) {
+        arena_freechunks(a->top);
+        arena_freechunks(a->spare);
+        sfree(a);
+    }
+}
+
+void *arena_alloc(arena *a, size_t size)
+{
+    struct arena_chunk *c = a->top, **cp;
+    void *ret;
+
+    size = ARENA_ROUND(size ? size : 1);
+
+    if (!c || c->size - c->used < size) {
+        /*
+         * Start a new chunk, preferring a spare one that's big
+         * enough. Allocations too big for a standard chunk get a
+         * chunk of their own.
+         */
+        for (cp = &a->spare; *cp; cp = &(*cp)->next)
+            if ((*cp)->size >= size)
+                break;
+        if (*cp) {
+            c = *cp;
+            *cp = c->next;
+        } else {
+            size_t csize = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+            c = smalloc(ARENA_HEADER + csize);
+            c->size = csize;
+        }
+        c->used = 0;
+        c->next = a->top;
+        a->top = c;
+    }
+
+    ret = ARENA_DATA(c) + c->used;
+    c->used += size;
+#ifdef DEBUG_ARENA
+    memset(ret, 0xCD, size);
+#endif
+    return ret;
+}
+
+arena_mark arena_getmark(arena *a)
+{
+    arena_mark mark;
+    mark.chunk = a->top;
+    mark.used = a->top ? a->top->used : 0;
+    return mark;
+}
+
+void arena_release(arena *a, arena_mark mark)
+{
+    while (a->top != mark.chunk) {
+        struct arena_chunk *c = a->top;
+        assert(c);                     /* mark must be from this arena */
+#ifdef DEBUG_ARENA
+        memset(ARENA_DATA(c), 0xDD, c->used);
+#endif
+        a->top = c->next;
+        c->next = a->spare;
+        a->spare = c;
+    }
+    if (mark.chunk) {
+        assert(mark.used <= mark.chunk->used);
+#ifdef DEBUG_ARENA
+        memset(ARENA_DATA(mark.chunk) + mark.used, 0xDD,
+               mark.chunk->used - mark.used);
+#endif
+        mark.chunk->used = mark.used;
+    }
+}
+
+/*
+ * Secondary heap in "upper memory": a single contiguous region,
+ * handed to UpperHeapInit(), from which smalloc satisfies requests
+ * once the normal heap is exhausted. On the GP2X the region is the
+ * top 32Mb of RAM, mapped through /dev/mem; elsewhere it is faked
+ * with an anonymous mapping, which is useful for testing along with
+ * DEBUG_PRETEND_MEMORY_FULL.
+ *
+ * The region is divided into 4Kb pages, managed by a binary buddy
+ * allocator: free blocks of 2^k pages sit on free list k, a bitmap
+ * records which free lists are non-empty, and a freed block is
+ * merged with its buddy for as long as the buddy is also free.
+ * Requests of up to 2Kb are instead served from slab pages, each of
+ * which is devoted to one power-of-two size class and has a bitmap
+ * of its occupied slots.
+ *
+ * All the bookkeeping lives in a table of per-page records at the
+ * start of the region itself, so the heap never needs the normal
+ * heap. A pointer's owning page, and hence everything needed to
+ * free it, is found by arithmetic; deciding whether a pointer
+ * belongs to this heap at all is two comparisons.
+ */
+
+#define UPPER_PAGE_SHIFT 12
+#define UPPER_PAGE (1 << UPPER_PAGE_SHIFT)
+#define UPPER_MIN_SHIFT 4		       /* smallest slab class: 16 bytes */
+#define UPPER_CLASSES (UPPER_PAGE_SHIFT - UPPER_MIN_SHIFT)
+#define UPPER_MAX_ORDER 24
+#define UPPER_BITS (8 * (int)sizeof(unsigned long))
+#define UPPER_MAPWORDS ((UPPER_PAGE >> UPPER_MIN_SHIFT) / UPPER_BITS)
+
+enum {
+    UPPER_TAIL,			       /* inside some larger block */
+    UPPER_FREE,			       /* first page of a free block */
+    UPPER_LARGE,		       /* first page of an allocated block */
+    UPPER_SLAB			       /* page divided into slots */
+};
+
+struct upper_page {
+    unsigned char kind;
+    unsigned char order;	       /* FREE, LARGE: log2 of block pages */
+    unsigned char sclass;	       /* SLAB: slot size is 16 << sclass */
+    unsigned short nfree;	       /* SLAB: number of free slots */
+    int next, prev;		       /* free list, or partial slab list */
+    unsigned long map[UPPER_MAPWORDS]; /* SLAB: bit set if slot in use */
+};
+
+static struct {
+    char *base, *limit;		       /* allocatable pages */
+    int npages;
+    struct upper_page *pages;
+    int freelist[UPPER_MAX_ORDER + 1];
+    unsigned long freeorders;	       /* bit k set if freelist[k] nonempty */
+    int partial[UPPER_CLASSES];	       /* slab pages with a free slot */
+} Upper;
+
+static int UpperOwns(void *p)
+{
+    return Upper.pages && (char *)p >= Upper.base && (char *)p < Upper.limit;
+}
+
+static void upper_push(int *list, int pg)
+{
+    struct upper_page *pages = Upper.pages;
+    pages[pg].prev = -1;
+    pages[pg].next = *list;
+    if (*list >= 0)
+        pages[*list].prev = pg;
+    *list = pg;
+}
+
+static void upper_unlink(int *list, int pg)
+{
+    struct upper_page *pages = Upper.pages;
+    if (pages[pg].prev >= 0)
+        pages[pages[pg].prev].next = pages[pg].next;
+    else
+        *list = pages[pg].next;
+    if (pages[pg].next >= 0)
+        pages[pages[pg].next].prev = pages[pg].prev;
+}
+
+static void upper_addfree(int pg, int order)
+{
+    Upper.pages[pg].kind = UPPER_FREE;
+    Upper.pages[pg].order = order;
+    upper_push(&Upper.freelist[order], pg);
+    Upper.freeorders |= 1UL << order;
+}
+
+static void upper_delfree(int pg)
+{
+    int order = Upper.pages[pg].order;
+    upper_unlink(&Upper.freelist[order], pg);
+    if (Upper.freelist[order] < 0)
+        Upper.freeorders &= ~(1UL << order);
+    Upper.pages[pg].kind = UPPER_TAIL;
+}
+
+/* Returns the first page of a block of 2^order pages, or -1. */
+static int upper_buddy_alloc(int order)
+{
+    unsigned long avail = Upper.freeorders >> order;
+    int k = order, pg;
+
+    if (!avail)
+        return -1;
+    while (!(avail & 1)) {
+        avail >>= 1;
+        k++;
+    }
+
+    pg = Upper.freelist[k];
+    upper_delfree(pg);
+    while (k > order) {		       /* split, freeing the upper halves */
+        k--;
+        upper_addfree(pg + (1 << k), k);
+    }
+    Upper.pages[pg].order = order;
+    return pg;
+}
+
+static void upper_buddy_free(int pg, int order)
+{
+    while (order < UPPER_MAX_ORDER) {
+        int buddy = pg ^ (1 << order);
+        if (buddy >= Upper.npages || Upper.pages[buddy].kind != UPPER_FREE ||
+            Upper.pages[buddy].order != order)
+            break;
+        upper_delfree(buddy);
+        Upper.pages[pg].kind = UPPER_TAIL;
+        pg &= buddy;
+        order++;
+    }
+    upper_addfree(pg, order);
+}
+
+/*
+ * Attach the heap to a region of memory. Everything previously in
+ * the heap is forgotten. Returns FALSE if the region is too small to
+ * be useful.
+ */
+int UpperHeapInit(void *region, size_t size)
+{
+    size_t metabytes;
+    int i, npages, metapages;
+
+    Upper.pages = NULL;
+    npages = (int)(size >> UPPER_PAGE_SHIFT);
+    metabytes = npages * sizeof(struct upper_page);
+    metapages = (int)((metabytes + UPPER_PAGE - 1) >> UPPER_PAGE_SHIFT);
+    if (npages - metapages < 1)
+        return FALSE;
+
+    /* Page records go at the start; the rest is for allocation. */
+    Upper.pages = region;
+    Upper.npages = npages - metapages;
+    Upper.base = (char *)region + ((size_t)metapages << UPPER_PAGE_SHIFT);
+    Upper.limit = Upper.base + ((size_t)Upper.npages << UPPER_PAGE_SHIFT);
+    Upper.freeorders = 0;
+    for (i = 0; i <= UPPER_MAX_ORDER; i++)
+        Upper.freelist[i] = -1;
+    for (i = 0; i < UPPER_CLASSES; i++)
+        Upper.partial[i] = -1;
+
+    /* Free every page singly and let the buddy merging build blocks. */
+    for (i = 0; i < Upper.npages; i++)
+        Upper.pages[i].kind = UPPER_TAIL;
+    for (i = 0; i < Upper.npages; i++)
+        upper_buddy_free(i, 0);
+    return TRUE;
+}
+
+/*
+ * Take a range of the region out of use, e.g. because hardware owns
+ * it. Must be called before anything is allocated.
+ */
+void UpperHeapReserve(void *start, size_t size)
+{
+    int first, last, i, j;
+
+    if (!Upper.pages || (char *)start + size <= Upper.base ||
+        (char *)start >= Upper.limit)
+        return;
+    first = (char *)start < Upper.base ? 0 :
+        (int)(((char *)start - Upper.base) >> UPPER_PAGE_SHIFT);
+    last = (char *)start + size >= Upper.limit ? Upper.npages - 1 :
+        (int)(((char *)start + size - 1 - Upper.base) >> UPPER_PAGE_SHIFT);
+
+    /*
+     * For each free block overlapping the range, remove it and give
+     * back the pages either side of the range.
+     */
+    for (i = 0; i < Upper.npages; i++) {
+        struct upper_page *pg = &Upper.pages[i];
+        if (pg->kind == UPPER_FREE && i <= last &&
+            i + (1 << pg->order) > first) {
+            int end = i + (1 << pg->order);
+            upper_delfree(i);
+            for (j = i; j < end; j++)
+                if (j < first || j > last)
+                    upper_buddy_free(j, 0);
+        }
+    }
+}
+
 void * UpperMalloc(size_t size)
 {
-  int i = 0, j;
-ReDo:
-  for (; TakenSize[i]; i += TakenSize[i]);
-  if (i >= 0x2000000 / BLOCKSIZE) {
-    printf("UpperMalloc out of mem!");
-    return NULL;
-  }
-  int BSize = (size - 1) / BLOCKSIZE + 1;
-  for(j = 1; j < BSize; j++) {
-    if (TakenSize[i + j]) {
-      i += j;
-      goto ReDo; //OMG Goto, kill me.
+    int pg, order;
+
+    if (!Upper.pages)
+        return NULL;
+
+    if (size <= (UPPER_PAGE >> 1)) {
+        int c = 0, w, bit, slot, nslots;
+        struct upper_page *p;
+
+        while (((size_t)1 << (c + UPPER_MIN_SHIFT)) < size)
+            c++;
+        nslots = UPPER_PAGE >> (c + UPPER_MIN_SHIFT);
+
+        pg = Upper.partial[c];
+        if (pg < 0) {
+            pg = upper_buddy_alloc(0);
+            if (pg < 0)
+                goto full;
+            p = &Upper.pages[pg];
+            p->kind = UPPER_SLAB;
+            p->sclass = c;
+            p->nfree = nslots;
+            memset(p->map, 0, sizeof(p->map));
+            upper_push(&Upper.partial[c], pg);
+        }
+        p = &Upper.pages[pg];
+
+        for (w = 0; p->map[w] == ~0UL; w++);
+        for (bit = 0; p->map[w] & (1UL << bit); bit++);
+        slot = w * UPPER_BITS + bit;
+        assert(slot < nslots);
+        p->map[w] |= 1UL << bit;
+        if (--p->nfree == 0)
+            upper_unlink(&Upper.partial[c], pg);
+
+        return Upper.base + ((size_t)pg << UPPER_PAGE_SHIFT) +
+            ((size_t)slot << (c + UPPER_MIN_SHIFT));
     }
-  }
-  
-  TakenSize[i] = BSize;
-  void* mem = ((char*)UpperMem) + i * BLOCKSIZE;
-  memset(mem, 0, size);
-  return mem;
+
+    for (order = 0; ((size_t)UPPER_PAGE << order) < size; order++)
+        if (order == UPPER_MAX_ORDER)
+            goto full;
+    pg = upper_buddy_alloc(order);
+    if (pg < 0)
+        goto full;
+    Upper.pages[pg].kind = UPPER_LARGE;
+    return Upper.base + ((size_t)pg << UPPER_PAGE_SHIFT);
+
+  full:
+#ifdef DEBUG_UPPER_MEMORY
+    printf("UpperMalloc out of mem!\n");
+    UpperHeapReport();
+#endif
+    return NULL;
 }
 
-//Releases UpperMalloced memory
+/* Releases UpperMalloced memory. */
 void UpperFree(void* mem)
 {
-  int i = (((int)mem) - ((int)UpperMem));
+    size_t off;
+    int pg;
+    struct upper_page *p;
 
-  if (i < 0 || i >= 0x2000000)
-  {
-    printf("Requested UpperFree of non-UpperMalloc'd memory\n");
-  }
-  else
-  {
-    if (i % BLOCKSIZE)
-      fprintf(stderr, "delete error: %p\n", mem);
-    TakenSize[i / BLOCKSIZE] = 0;
-  }
+    if (!UpperOwns(mem)) {
+        printf("Requested UpperFree of non-UpperMalloc'd memory\n");
+        return;
+    }
+
+    off = (char *)mem - Upper.base;
+    pg = (int)(off >> UPPER_PAGE_SHIFT);
+    off &= UPPER_PAGE - 1;
+    p = &Upper.pages[pg];
+
+    if (p->kind == UPPER_SLAB) {
+        int shift = p->sclass + UPPER_MIN_SHIFT;
+        int slot = (int)(off >> shift);
+        unsigned long bit = 1UL << (slot % UPPER_BITS);
+
+        if ((off & ((1 << shift) - 1)) || !(p->map[slot / UPPER_BITS] & bit)) {
+            fprintf(stderr, "delete error: %p\n", mem);
+            return;
+        }
+        p->map[slot / UPPER_BITS] &= ~bit;
+        if (p->nfree++ == 0)
+            upper_push(&Upper.partial[p->sclass], pg);
+        if (p->nfree == (UPPER_PAGE >> shift)) {
+            upper_unlink(&Upper.partial[p->sclass], pg);
+            upper_buddy_free(pg, 0);
+        }
+    } else if (p->kind == UPPER_LARGE && off == 0) {
+        upper_buddy_free(pg, p->order);
+    } else {
+        fprintf(stderr, "delete error: %p\n", mem);
+    }
 }
 
-//Returns the size of a UpperMalloced block.
+/* Returns the usable size of an UpperMalloced block, or -1. */
 int GetUpperSize(void* mem)
 {
-  int i = (((int)mem) - ((int)UpperMem));
-  if (i < 0 || i >= 0x2000000)
-  {
-    fprintf(stderr, "GetUpperSize of not UpperMalloced mem: %p\n", mem);
+    struct upper_page *p;
+
+    if (!UpperOwns(mem)) {
+        fprintf(stderr, "GetUpperSize of not UpperMalloced mem: %p\n", mem);
+        return -1;
+    }
+    p = &Upper.pages[((char *)mem - Upper.base) >> UPPER_PAGE_SHIFT];
+    if (p->kind == UPPER_SLAB)
+        return 1 << (p->sclass + UPPER_MIN_SHIFT);
+    if (p->kind == UPPER_LARGE)
+        return UPPER_PAGE << p->order;
     return -1;
-  }
-  return TakenSize[i / BLOCKSIZE] * BLOCKSIZE;
 }
 
+/*
+ * Work out how fragmented the free space is, as the percentage of
+ * free memory in blocks which could still merge with their buddies
+ * if the memory around them were freed. A block can't merge if it
+ * is already the largest order, or if its buddy would run off the
+ * end of the heap, so a freshly initialised heap (whose free blocks
+ * are all like that, since its size needn't be a power of two)
+ * scores 0%. Ranges taken out by UpperHeapReserve() never come back,
+ * so the blocks around them count towards the figure permanently.
+ */
+static int upper_fragmentation(void)
+{
+    unsigned long freebytes = 0, splitbytes = 0;
+    int i;
+
+    for (i = 0; i < Upper.npages; i++) {
+        struct upper_page *p = &Upper.pages[i];
+        if (p->kind == UPPER_FREE) {
+            unsigned long bytes = (unsigned long)UPPER_PAGE << p->order;
+            int buddy = i ^ (1 << p->order);
+            freebytes += bytes;
+            if (p->order < UPPER_MAX_ORDER &&
+                buddy + (1 << p->order) <= Upper.npages)
+                splitbytes += bytes;
+        }
+    }
+    return freebytes ? (int)(splitbytes * 100 / freebytes) : 0;
+}
+
+/*
+ * Print how the heap is being used, and how fragmented its free
+ * space is (see upper_fragmentation()).
+ */
+void UpperHeapReport(void)
+{
+    unsigned long freebytes = 0, largest = 0, largebytes = 0;
+    unsigned long slabpages = 0, slabused = 0;
+    int counts[UPPER_MAX_ORDER + 1];
+    int i, k;
+
+    if (!Upper.pages) {
+        printf("Upper heap not initialised\n");
+        return;
+    }
+
+    for (k = 0; k <= UPPER_MAX_ORDER; k++)
+        counts[k] = 0;
+    for (i = 0; i < Upper.npages; i++) {
+        struct upper_page *p = &Upper.pages[i];
+        unsigned long bytes = (unsigned long)UPPER_PAGE << p->order;
+        if (p->kind == UPPER_FREE) {
+            counts[p->order]++;
+            freebytes += bytes;
+            if (bytes > largest)
+                largest = bytes;
+        } else if (p->kind == UPPER_LARGE) {
+            largebytes += bytes;
+        } else if (p->kind == UPPER_SLAB) {
+            int nslots = UPPER_PAGE >> (p->sclass + UPPER_MIN_SHIFT);
+            slabpages++;
+            slabused += (unsigned long)(nslots - p->nfree) <<
+                (p->sclass + UPPER_MIN_SHIFT);
+        }
+    }
+
+    printf("Upper heap: %lu bytes in %d pages\n",
+           (unsigned long)(Upper.limit - Upper.base), Upper.npages);
+    printf("  large blocks %lu bytes; slabs %lu pages, %lu bytes in use\n",
+           largebytes, slabpages, slabused);
+    printf("  free %lu bytes, largest block %lu, fragmentation %d%%\n",
+           freebytes, largest, upper_fragmentation());
+    printf("  free blocks by order:");
+    for (k = 0; k <= UPPER_MAX_ORDER; k++)
+        if (counts[k])
+            printf(" %d:%d", k, counts[k]);
+    printf("\n");
+}
+
+#define UPPER_SIZE 0x2000000
+
 void InitMemPool() {
 #ifdef OPTION_USE_UPPER_MEMORY
 
  #ifndef TARGET_GP2X
   printf("Faking an upper memory area\n");
-  UpperMem = malloc(0x2000000);
-  if(!UpperMem)
+  #ifdef MAP_ANONYMOUS
+  UpperMem = mmap(0, UPPER_SIZE, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (UpperMem == MAP_FAILED)
+     UpperMem = NULL;
+  #else
+  UpperMem = malloc(UPPER_SIZE);
+  #endif
+  if(!UpperMem || !UpperHeapInit(UpperMem, UPPER_SIZE))
      fatal("Upper memory area failure.\n");
  #else
   //Try to apply MMU hack.
@@ -208,28 +961,173 @@ void InitMemPool() {
   }
 
   Uppermemfd = open("/dev/mem", O_RDWR);
-  UpperMem = mmap(0, 0x2000000, PROT_READ | PROT_WRITE, MAP_SHARED, Uppermemfd, 0x2000000);
- #endif
-
-  memset(TakenSize, 0, sizeof(TakenSize));
+  UpperMem = mmap(0, UPPER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, Uppermemfd, 0x2000000);
+  if (UpperMem == MAP_FAILED || !UpperHeapInit(UpperMem, UPPER_SIZE))
+  {
+    printf("Upper memory unavailable\n");
+    UpperMem = NULL;
+    return;
+  }
 
-  SetTaken(0x3000000, 0x80000); // Video decoder (you could overwrite this, but if you
-                                // don't need the memory then be nice and don't)
-  SetTaken(0x3101000, 153600);  // Primary frame buffer
-  SetTaken(0x3381000, 153600);  // Secondary frame buffer (if you don't use it, uncomment)
-  SetTaken(0x3600000, 0x8000);  // Sound buffer
+  // Physical addresses from 0x2000000 up, so these are offsets into UpperMem.
+  UpperHeapReserve((char *)UpperMem + 0x1000000, 0x80000);  // Video decoder (you could overwrite this, but if you
+                                                            // don't need the memory then be nice and don't)
+  UpperHeapReserve((char *)UpperMem + 0x1101000, 153600);   // Primary frame buffer
+  UpperHeapReserve((char *)UpperMem + 0x1381000, 153600);   // Secondary frame buffer (if you don't use it, uncomment)
+  UpperHeapReserve((char *)UpperMem + 0x1600000, 0x8000);   // Sound buffer
+ #endif
 #endif
 }
 
 void DestroyMemPool()
 {
 #ifdef OPTION_USE_UPPER_MEMORY
+    Upper.pages = NULL;
  #ifndef TARGET_GP2X
     printf("Destroying fake upper memory\n");
+  #ifdef MAP_ANONYMOUS
+    if (UpperMem)
+        munmap(UpperMem, UPPER_SIZE);
+  #else
     free(UpperMem);
+  #endif
  #else
+    if (UpperMem)
+        munmap(UpperMem, UPPER_SIZE);
     close (Uppermemfd);
  #endif
     UpperMem = NULL;
 #endif
 }
+
+#ifdef TEST_UPPER_HEAP
+
+/*
+ * Test code for the upper memory heap. Build with
+ *
+ *   cc -DTEST_UPPER_HEAP -I. -o uppertest malloc.c
+ *
+ * This gives the heap a region (of a size which isn't a power of two
+ * pages, and with a range reserved out of the middle), allocates and
+ * frees blocks of assorted sizes at random while checking that no
+ * two live blocks overlap and none strays into the reserved range,
+ * and finally frees everything and checks that the heap has merged
+ * itself back into the blocks it started with.
+ */
+
+#include <stdarg.h>
+
+#define TEST_REGION (3 << 20 | 5 << UPPER_PAGE_SHIFT)
+#define TEST_RESERVE_AT (1 << 20)
+#define TEST_RESERVE_SIZE 153600
+#define TEST_BLOCKS 4000
+
+void fatal(char *fmt, ...)
+{
+    va_list ap;
+    printf("FATAL: ");
+    va_start(ap, fmt);
+    vfprintf(stdout, fmt, ap);
+    va_end(ap);
+    printf("\n");
+    exit(1);
+}
+
+static int errors;
+
+static void error(char *fmt, ...)
+{
+    va_list ap;
+    printf("ERROR: ");
+    va_start(ap, fmt);
+    vfprintf(stdout, fmt, ap);
+    va_end(ap);
+    printf("\n");
+    errors++;
+}
+
+static void count_free(int *counts)
+{
+    int i;
+
+    for (i = 0; i <= UPPER_MAX_ORDER; i++)
+        counts[i] = 0;
+    for (i = 0; i < Upper.npages; i++)
+        if (Upper.pages[i].kind == UPPER_FREE)
+            counts[Upper.pages[i].order]++;
+}
+
+int main(void)
+{
+    static char region[TEST_REGION];
+    static unsigned char *blocks[TEST_BLOCKS];
+    static size_t sizes[TEST_BLOCKS];
+    char *reserve = region + TEST_RESERVE_AT;
+    int before[UPPER_MAX_ORDER + 1], after[UPPER_MAX_ORDER + 1];
+    unsigned long r = 1;
+    size_t k;
+    int i, j, iter;
+
+    if (!UpperHeapInit(region, sizeof(region))) {
+        error("UpperHeapInit failed");
+        return 1;
+    }
+    if (upper_fragmentation() != 0)
+        error("empty heap reports %d%% fragmentation",
+              upper_fragmentation());
+
+    UpperHeapReserve(reserve, TEST_RESERVE_SIZE);
+    count_free(before);
+    UpperHeapReport();
+
+    for (iter = 0; iter < 200000; iter++) {
+        r = r * 1103515245 + 12345;
+        i = (int)((r >> 8) % TEST_BLOCKS);
+
+        if (blocks[i]) {
+            for (k = 0; k < sizes[i]; k++)
+                if (blocks[i][k] != (unsigned char)i) {
+                    error("block %d overwritten at offset %lu",
+                          i, (unsigned long)k);
+                    break;
+                }
+            UpperFree(blocks[i]);
+            blocks[i] = NULL;
+            continue;
+        }
+
+        r = r * 1103515245 + 12345;
+        sizes[i] = (r >> 16) % 8 == 0 ? (r >> 4) % 40000 : (r >> 4) % 300;
+        blocks[i] = UpperMalloc(sizes[i]);
+        if (!blocks[i])
+            continue;		       /* heap full: not an error */
+
+        if ((char *)blocks[i] < Upper.base ||
+            (char *)blocks[i] + sizes[i] > Upper.limit)
+            error("block %d outside the heap", i);
+        if ((char *)blocks[i] < reserve + TEST_RESERVE_SIZE &&
+            (char *)blocks[i] + sizes[i] > reserve)
+            error("block %d overlaps the reserved range", i);
+        if ((size_t)GetUpperSize(blocks[i]) < sizes[i])
+            error("block %d: GetUpperSize %d < %lu", i,
+                  GetUpperSize(blocks[i]), (unsigned long)sizes[i]);
+        memset(blocks[i], (unsigned char)i, sizes[i]);
+    }
+
+    UpperHeapReport();
+    for (i = 0; i < TEST_BLOCKS; i++)
+        if (blocks[i])
+            UpperFree(blocks[i]);
+    UpperHeapReport();
+
+    count_free(after);
+    for (j = 0; j <= UPPER_MAX_ORDER; j++)
+        if (before[j] != after[j])
+            error("order %d: %d free blocks before, %d after",
+                  j, before[j], after[j]);
+
+    printf("%d errors\n", errors);
+    return errors != 0;
+}
+
+#endif
@@ -1,6 +1,9 @@
 #define scalloc(A, B)    smalloc((A)*(B))
 
 
+int UpperHeapInit(void *region, size_t size);
+void UpperHeapReserve(void *start, size_t size);
+void UpperHeapReport(void);
 void * UpperMalloc(size_t size);
 void UpperFree(void* mem);
 int GetUpperSize(void* mem);
@@ -1,13 +1,8 @@
 /*
- * Edmonds-Karp algorithm for finding a maximum flow and minimum
- * cut in a network. Almost identical to the Ford-Fulkerson
- * algorithm, but apparently using breadth-first search to find the
- * _shortest_ augmenting path is a good way to guarantee
- * termination and ensure the time complexity is not dependent on
- * the actual value of the maximum flow. I don't understand why
- * that should be, but it's claimed on the Internet that it's been
- * proved, and that's good enough for me. I prefer BFS to DFS
- * anyway :-)
+ * Dinic's algorithm for finding a maximum flow and minimum cut in a
+ * network, plus a persistent form of the network whose capacities
+ * can be changed between runs without starting again from zero
+ * flow.
  */
 
 #include <assert.h>
@@ -18,21 +13,36 @@
 
 #include "puzzles.h"		       /* for snewn/sfree */
 
-int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
-			 int ne, const int *edges, const int *backedges,
-			 const int *capacity, int *flow, int *cut)
+/*
+ * Residual arcs are numbered as in the `prev' encoding the
+ * Edmonds-Karp version of this code used: arc 2*i runs forwards
+ * along edge i, and arc 2*i+1 runs backwards along it (i.e. cancels
+ * flow). With edges stored as (source, dest) pairs, that makes the
+ * tail of arc a simply edges[a], and its head edges[a^1].
+ *
+ * Returns the spare capacity of an arc, or -1 for unlimited.
+ */
+static int residual(int a, const int *capacity, const int *flow)
 {
-    int *todo = (int *)scratch;
-    int *prev = todo + nv;
-    int *firstedge = todo + 2*nv;
-    int *firstbackedge = todo + 3*nv;
-    int i, j, head, tail, from, to;
-    int totalflow;
+    if (a & 1)
+	return flow[a / 2];
+    else if (capacity[a / 2] >= 0)
+	return capacity[a / 2] - flow[a / 2];
+    else
+	return -1;
+}
+
+/*
+ * Fill in firstedge[v] and firstbackedge[v], the indices of the
+ * first edge out of and into each vertex in `edges' and `backedges'
+ * respectively.
+ */
+static void maxflow_index(int nv, int ne, const int *edges,
+			  const int *backedges, int *firstedge,
+			  int *firstbackedge)
+{
+    int i, j;
 
-    /*
-     * Scan the edges array to find the index of the first edge
-     * from each node.
-     */
     j = 0;
     for (i = 0; i < ne; i++)
 	while (j <= edges[2*i])
@@ -41,10 +51,6 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
 	firstedge[j++] = ne;
     assert(j == nv);
 
-    /*
-     * Scan the backedges array to find the index of the first edge
-     * _to_ each node.
-     */
     j = 0;
     for (i = 0; i < ne; i++)
 	while (j <= edges[2*backedges[i]+1])
@@ -52,175 +58,184 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
     while (j < nv)
 	firstbackedge[j++] = ne;
     assert(j == nv);
+}
 
-    /*
-     * Start the flow off at zero on every edge.
-     */
-    for (i = 0; i < ne; i++)
-	flow[i] = 0;
-    totalflow = 0;
+/*
+ * Dinic's algorithm: repeatedly build the level graph of shortest
+ * residual paths from the source by BFS, and saturate it with a
+ * blocking flow found by DFS, until the sink becomes unreachable.
+ * Each phase strictly lengthens the shortest augmenting path, so
+ * there are at most nv phases; within a phase, each vertex keeps a
+ * cursor into its arc lists which only ever moves forwards, so that
+ * no arc is examined twice once it has proved useless.
+ *
+ * The flow is augmented from whatever it is on entry, which must be
+ * a valid flow. `work' is 5*nv integers. Returns the amount by which
+ * the total flow increased.
+ */
+static int dinic(int nv, int source, int sink, int ne,
+		 const int *edges, const int *backedges,
+		 const int *firstedge, const int *firstbackedge,
+		 const int *capacity, int *flow, int *cut, int *work)
+{
+    int *level = work;
+    int *todo = work + nv;
+    int *curedge = work + 2*nv;
+    int *curback = work + 3*nv;
+    int *path = work + 4*nv;
+    int i, j, head, tail, from, to, a, depth;
+    int added = 0;
 
-    /*
-     * Repeatedly look for an augmenting path, and follow it.
-     */
     while (1) {
-
 	/*
-	 * Set up the prev array.
+	 * Build the level graph.
 	 */
 	for (i = 0; i < nv; i++)
-	    prev[i] = -1;
-
-	/*
-	 * Initialise the to-do list for BFS.
-	 */
+	    level[i] = -1;
 	head = tail = 0;
 	todo[tail++] = source;
-
-	/*
-	 * Now do the BFS loop.
-	 */
-	while (head < tail && prev[sink] <= 0) {
+	level[source] = 0;
+	while (head < tail) {
 	    from = todo[head++];
-
-	    /*
-	     * Try all the forward edges out of node `from'. For a
-	     * forward edge to be valid, it must have flow
-	     * currently less than its capacity.
-	     */
 	    for (i = firstedge[from]; i < ne && edges[2*i] == from; i++) {
 		to = edges[2*i+1];
-		if (to == source || prev[to] >= 0)
-		    continue;
-		if (capacity[i] >= 0 && flow[i] >= capacity[i])
-		    continue;
-		/*
-		 * This is a valid augmenting edge. Visit node `to'.
-		 */
-		prev[to] = 2*i;
-		todo[tail++] = to;
+		if (level[to] < 0 && residual(2*i, capacity, flow) != 0) {
+		    level[to] = level[from] + 1;
+		    todo[tail++] = to;
+		}
 	    }
-
-	    /*
-	     * Try all the backward edges into node `from'. For a
-	     * backward edge to be valid, it must have flow
-	     * currently greater than zero.
-	     */
 	    for (i = firstbackedge[from];
-		 j = backedges[i], i < ne && edges[2*j+1]==from; i++) {
+		 i < ne && (j = backedges[i], edges[2*j+1] == from); i++) {
 		to = edges[2*j];
-		if (to == source || prev[to] >= 0)
-		    continue;
-		if (flow[j] <= 0)
-		    continue;
-		/*
-		 * This is a valid augmenting edge. Visit node `to'.
-		 */
-		prev[to] = 2*j+1;
-		todo[tail++] = to;
+		if (level[to] < 0 && flow[j] > 0) {
+		    level[to] = level[from] + 1;
+		    todo[tail++] = to;
+		}
 	    }
 	}
 
 	/*
-	 * If prev[sink] is non-null, we have found an augmenting
-	 * path.
+	 * If the sink can't be reached, we're done, and the
+	 * reachable vertices are exactly one side of a minimum cut.
 	 */
-	if (prev[sink] >= 0) {
-	    int max;
-
-	    /*
-	     * Work backwards along the path figuring out the
-	     * maximum flow we can add.
-	     */
-	    to = sink;
-	    max = -1;
-	    while (to != source) {
-		int spare;
+	if (level[sink] < 0)
+	    break;
 
-		/*
-		 * Find the edge we're currently moving along.
-		 */
-		i = prev[to];
-		from = edges[i];
-		assert(from != to);
+	/*
+	 * Find a blocking flow. `path' holds the arcs from the
+	 * source to the current vertex `from'.
+	 */
+	for (i = 0; i < nv; i++) {
+	    curedge[i] = firstedge[i];
+	    curback[i] = firstbackedge[i];
+	}
+	depth = 0;
+	from = source;
+	while (1) {
+	    if (from == sink) {
+		int max = -1, spare;
 
 		/*
-		 * Determine the spare capacity of this edge.
+		 * Push as much as the path will take along it, and
+		 * retreat to the tail of the first arc that leaves
+		 * saturated.
 		 */
-		if (i & 1)
-		    spare = flow[i / 2];   /* backward edge */
-		else if (capacity[i / 2] >= 0)
-		    spare = capacity[i / 2] - flow[i / 2];   /* forward edge */
-		else
-		    spare = -1;	       /* unlimited forward edge */
-
-		assert(spare != 0);
-
-		if (max < 0 || (spare >= 0 && spare < max))
-		    max = spare;
-
-		to = from;
+		for (i = 0; i < depth; i++) {
+		    spare = residual(path[i], capacity, flow);
+		    if (max < 0 || (spare >= 0 && spare < max))
+			max = spare;
+		}
+		/* An entirely unlimited path from source to sink is
+		 * an error; see maxflow.h. */
+		assert(max > 0);
+		for (i = 0; i < depth; i++) {
+		    a = path[i];
+		    if (a & 1)
+			flow[a / 2] -= max;
+		    else
+			flow[a / 2] += max;
+		}
+		added += max;
+		for (i = 0; i < depth; i++)
+		    if (residual(path[i], capacity, flow) == 0)
+			break;
+		depth = i;
+		from = edges[path[i]];
+		continue;
 	    }
-	    /*
-	     * Fail an assertion if max is still < 0, i.e. there is
-	     * an entirely unlimited path from source to sink. Also
-	     * max should not _be_ zero, because by construction
-	     * this _should_ be an augmenting path.
-	     */
-	    assert(max > 0);
 
 	    /*
-	     * Now work backwards along the path again, this time
-	     * actually adjusting the flow.
+	     * Advance along the first admissible arc out of `from':
+	     * one with spare capacity leading one level deeper.
 	     */
-	    to = sink;
-	    while (to != source) {
-		/*
-		 * Find the edge we're currently moving along.
-		 */
-		i = prev[to];
-		from = edges[i];
-		assert(from != to);
+	    a = -1;
+	    for (; (i = curedge[from]) < ne && edges[2*i] == from;
+		 curedge[from]++) {
+		if (level[edges[2*i+1]] == level[from] + 1 &&
+		    residual(2*i, capacity, flow) != 0) {
+		    a = 2*i;
+		    break;
+		}
+	    }
+	    if (a < 0) {
+		for (; (i = curback[from]) < ne &&
+			 (j = backedges[i], edges[2*j+1] == from);
+		     curback[from]++) {
+		    if (level[edges[2*j]] == level[from] + 1 &&
+			flow[j] > 0) {
+			a = 2*j+1;
+			break;
+		    }
+		}
+	    }
 
+	    if (a >= 0) {
+		path[depth++] = a;
+		from = edges[a^1];
+	    } else {
 		/*
-		 * Adjust the edge.
+		 * Dead end. Take this vertex out of the level graph
+		 * and back up a step.
 		 */
-		if (i & 1)
-		    flow[i / 2] -= max;  /* backward edge */
-		else
-		    flow[i / 2] += max;  /* forward edge */
-
-		to = from;
+		level[from] = -1;
+		if (depth == 0)
+		    break;	       /* the source itself is exhausted */
+		from = edges[path[--depth]];
 	    }
-
-	    /*
-	     * And adjust the overall flow counter.
-	     */
-	    totalflow += max;
-
-	    continue;
 	}
+    }
 
-	/*
-	 * If we reach here, we have failed to find an augmenting
-	 * path, which means we're done. Output the `cut' array if
-	 * required, and leave.
-	 */
-	if (cut) {
-	    for (i = 0; i < nv; i++) {
-		if (i == source || prev[i] >= 0)
-		    cut[i] = 0;
-		else
-		    cut[i] = 1;
-	    }
-	}
-	return totalflow;
+    if (cut) {
+	for (i = 0; i < nv; i++)
+	    cut[i] = (level[i] >= 0 ? 0 : 1);
     }
+    return added;
+}
+
+int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
+			 int ne, const int *edges, const int *backedges,
+			 const int *capacity, int *flow, int *cut)
+{
+    int *firstedge = (int *)scratch;
+    int *firstbackedge = firstedge + nv;
+    int i;
+
+    maxflow_index(nv, ne, edges, backedges, firstedge, firstbackedge);
+
+    /*
+     * Start the flow off at zero on every edge.
+     */
+    for (i = 0; i < ne; i++)
+	flow[i] = 0;
+
+    return dinic(nv, source, sink, ne, edges, backedges,
+		 firstedge, firstbackedge, capacity, flow, cut,
+		 firstbackedge + nv);
 }
 
 int maxflow_scratch_size(int nv)
 {
-    return (nv * 4) * sizeof(int);
+    return (nv * 7) * sizeof(int);
 }
 
 void maxflow_setup_backedges(int ne, const int *edges, int *backedges)
@@ -383,6 +398,186 @@ int maxflow(int nv, int source, int sink,
     return ret;
 }
 
+/* ----------------------------------------------------------------------
+ * Persistent networks.
+ */
+
+struct maxflow_state {
+    int nv, ne, source, sink;
+    int *edges, *backedges, *firstedge, *firstbackedge;
+    int *capacity, *flow;
+    int *work;			       /* 5*nv, for dinic() and cancelling */
+};
+
+maxflow_state *maxflow_state_new(int nv, int source, int sink,
+				 int ne, const int *edges)
+{
+    maxflow_state *mf = snew(maxflow_state);
+    int i;
+
+    mf->nv = nv;
+    mf->ne = ne;
+    mf->source = source;
+    mf->sink = sink;
+    mf->edges = snewn(2*ne, int);
+    for (i = 0; i < 2*ne; i++)
+	mf->edges[i] = edges[i];
+    mf->backedges = snewn(ne, int);
+    maxflow_setup_backedges(ne, edges, mf->backedges);
+    mf->firstedge = snewn(nv, int);
+    mf->firstbackedge = snewn(nv, int);
+    maxflow_index(nv, ne, mf->edges, mf->backedges,
+		  mf->firstedge, mf->firstbackedge);
+    mf->capacity = snewn(ne, int);
+    mf->flow = snewn(ne, int);
+    for (i = 0; i < ne; i++)
+	mf->capacity[i] = mf->flow[i] = 0;
+    mf->work = snewn(5*nv, int);
+
+    return mf;
+}
+
+void maxflow_state_free(maxflow_state *mf)
+{
+    sfree(mf->work);
+    sfree(mf->flow);
+    sfree(mf->capacity);
+    sfree(mf->firstbackedge);
+    sfree(mf->firstedge);
+    sfree(mf->backedges);
+    sfree(mf->edges);
+    sfree(mf);
+}
+
+/*
+ * Find a path of flow-carrying edges from vertex v back towards the
+ * source (if `backwards') or on towards the sink, stopping at the
+ * source or sink or at vertex `alt', whichever comes first; reduce
+ * the flow along it by as much as possible up to `amount', and
+ * return how much that was. *end is set to the vertex the path
+ * stopped at.
+ *
+ * Such a path always exists when v has a surplus (backwards) or
+ * deficit (forwards) of inflow and `alt' is the only other vertex
+ * out of balance, because otherwise the set of vertices which the
+ * search could reach would have to create or absorb flow.
+ */
+static int maxflow_cancel(maxflow_state *mf, int v, int backwards,
+			  int alt, int amount, int *end)
+{
+    int nv = mf->nv, ne = mf->ne;
+    const int *edges = mf->edges;
+    int *seen = mf->work;
+    int *stack = mf->work + nv;
+    int *cursor = mf->work + 2*nv;
+    int *pathedge = mf->work + 3*nv;
+    int target = backwards ? mf->source : mf->sink;
+    int depth, u, i, e, other;
+
+    for (i = 0; i < nv; i++)
+	seen[i] = FALSE;
+    depth = 0;
+    stack[0] = v;
+    seen[v] = TRUE;
+    cursor[v] = backwards ? mf->firstbackedge[v] : mf->firstedge[v];
+
+    while ((u = stack[depth]) != target && (u != alt || depth == 0)) {
+	other = -1;
+	for (; (i = cursor[u]) < ne; cursor[u]++) {
+	    if (backwards) {
+		e = mf->backedges[i];
+		if (edges[2*e+1] != u)
+		    break;
+		other = edges[2*e];
+	    } else {
+		e = i;
+		if (edges[2*e] != u)
+		    break;
+		other = edges[2*e+1];
+	    }
+	    if (mf->flow[e] > 0 && !seen[other])
+		break;
+	    other = -1;
+	}
+
+	if (other >= 0) {
+	    cursor[u]++;
+	    pathedge[depth++] = e;
+	    stack[depth] = other;
+	    seen[other] = TRUE;
+	    cursor[other] = (backwards ? mf->firstbackedge[other] :
+			     mf->firstedge[other]);
+	} else {
+	    assert(depth > 0);	       /* see comment above */
+	    depth--;
+	}
+    }
+
+    for (i = 0; i < depth; i++)
+	if (mf->flow[pathedge[i]] < amount)
+	    amount = mf->flow[pathedge[i]];
+    for (i = 0; i < depth; i++)
+	mf->flow[pathedge[i]] -= amount;
+    *end = u;
+    return amount;
+}
+
+void maxflow_set_capacity(maxflow_state *mf, int e, int capacity)
+{
+    int from = mf->edges[2*e], to = mf->edges[2*e+1];
+    int excess, surplus, deficit, end;
+
+    mf->capacity[e] = capacity;
+    if (capacity < 0 || mf->flow[e] <= capacity)
+	return;
+
+    /*
+     * The edge is now carrying more than it may. Take the excess
+     * off it, which leaves `from' with that much too much flow in
+     * and `to' with that much too little; then cancel flow back to
+     * the source from `from' (or round to `to', if the excess was
+     * going round a cycle) and on to the sink from `to'.
+     */
+    excess = mf->flow[e] - capacity;
+    mf->flow[e] = capacity;
+    surplus = deficit = excess;
+    while (surplus > 0 && from != mf->source) {
+	int n = maxflow_cancel(mf, from, TRUE, to, surplus, &end);
+	surplus -= n;
+	if (end == to)
+	    deficit -= n;
+    }
+    while (deficit > 0 && to != mf->sink) {
+	deficit -= maxflow_cancel(mf, to, FALSE, -1, deficit, &end);
+    }
+}
+
+int maxflow_run(maxflow_state *mf, int *cut)
+{
+    int i, total;
+
+    dinic(mf->nv, mf->source, mf->sink, mf->ne, mf->edges, mf->backedges,
+	  mf->firstedge, mf->firstbackedge, mf->capacity, mf->flow, cut,
+	  mf->work);
+
+    /*
+     * The total is the net flow out of the source.
+     */
+    total = 0;
+    for (i = mf->firstedge[mf->source];
+	 i < mf->ne && mf->edges[2*i] == mf->source; i++)
+	total += mf->flow[i];
+    for (i = mf->firstbackedge[mf->source];
+	 i < mf->ne && mf->edges[2*mf->backedges[i]+1] == mf->source; i++)
+	total -= mf->flow[mf->backedges[i]];
+    return total;
+}
+
+const int *maxflow_flow(maxflow_state *mf)
+{
+    return mf->flow;
+}
+
 #ifdef TESTMODE
 
 #define MAXEDGES 256
@@ -455,6 +650,71 @@ int main(void)
 	if (cut[i] == 0)
 	    printf("difficult set includes %d\n", i);
 
+    /*
+     * Now check the persistent version against the one-shot one on
+     * random networks, changing a few capacities at a time, and
+     * check that every flow it returns is a valid one whose value
+     * matches its cut.
+     */
+    srand(1);
+    for (p = 0; p < 2000; p++) {
+	maxflow_state *mf;
+	const int *pflow;
+	int pret, balance[MAXVERTICES], cutcap;
+
+	nv = 2 + rand() % 30;
+	source = 0;
+	sink = nv-1;
+	ne = 0;
+	for (i = 0; i < nv; i++)
+	    for (j = 0; j < nv; j++)
+		if (i != j && i != sink && j != source &&
+		    ne < MAXEDGES && rand() % 4 == 0)
+		    ADDEDGE(i, j);
+	qsort(edges, ne, 2*sizeof(int), compare_edge);
+
+	mf = maxflow_state_new(nv, source, sink, ne, edges);
+	for (i = 0; i < ne; i++)
+	    capacity[i] = 0;
+	for (q = 0; q < 20; q++) {
+	    for (i = 0; i < ne; i++)
+		if (q == 0 || rand() % 8 == 0) {
+		    capacity[i] = rand() % 5;
+		    maxflow_set_capacity(mf, i, capacity[i]);
+		}
+
+	    ret = maxflow(nv, source, sink, ne, edges, capacity, flow, NULL);
+	    pret = maxflow_run(mf, cut);
+	    pflow = maxflow_flow(mf);
+
+	    for (i = 0; i < nv; i++)
+		balance[i] = 0;
+	    cutcap = 0;
+	    for (i = 0; i < ne; i++) {
+		assert(pflow[i] >= 0 && pflow[i] <= capacity[i]);
+		balance[edges[2*i]] -= pflow[i];
+		balance[edges[2*i+1]] += pflow[i];
+		if (!cut[edges[2*i]] && cut[edges[2*i+1]]) {
+		    assert(pflow[i] == capacity[i]);
+		    cutcap += capacity[i];
+		}
+		if (cut[edges[2*i]] && !cut[edges[2*i+1]])
+		    assert(pflow[i] == 0);
+	    }
+	    for (i = 0; i < nv; i++)
+		if (i != source && i != sink)
+		    assert(balance[i] == 0);
+
+	    if (ret != pret || balance[sink] != pret || cutcap != pret) {
+		printf("mismatch on network %d round %d: %d %d %d %d\n",
+		       p, q, ret, pret, balance[sink], cutcap);
+		return 1;
+	    }
+	}
+	maxflow_state_free(mf);
+    }
+    printf("persistent networks ok\n");
+
     return 0;
 }
 
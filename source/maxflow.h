@@ -1,13 +1,9 @@
 /*
- * Edmonds-Karp algorithm for finding a maximum flow and minimum
- * cut in a network. Almost identical to the Ford-Fulkerson
- * algorithm, but apparently using breadth-first search to find the
- * _shortest_ augmenting path is a good way to guarantee
- * termination and ensure the time complexity is not dependent on
- * the actual value of the maximum flow. I don't understand why
- * that should be, but it's claimed on the Internet that it's been
- * proved, and that's good enough for me. I prefer BFS to DFS
- * anyway :-)
+ * Dinic's algorithm for finding a maximum flow and minimum cut in a
+ * network: each phase finds the shortest augmenting paths by BFS
+ * and saturates all of them at once by DFS, so that the number of
+ * phases is bounded by the number of vertices rather than by the
+ * value of the flow.
  */
 
 #ifndef MAXFLOW_MAXFLOW_H
@@ -92,4 +88,26 @@ int maxflow(int nv, int source, int sink,
 	    int ne, const int *edges, const int *capacity,
 	    int *flow, int *cut);
 
+/*
+ * Persistent version, for callers which solve the same network
+ * repeatedly with different capacities. The graph structure is set
+ * up once, and the flow found by each run is kept as the starting
+ * point for the next: changing a capacity only disturbs the flow if
+ * the edge was carrying more than its new capacity, in which case
+ * just that excess is cancelled back along the paths it came by.
+ *
+ * `edges' has the same meaning as above, and is copied. All
+ * capacities start at zero, so there is no flow until some are set.
+ * maxflow_run() returns the total flow and optionally fills in
+ * `cut' as above; maxflow_flow() gives the flow along each edge,
+ * valid until the next change to the network.
+ */
+typedef struct maxflow_state maxflow_state;
+maxflow_state *maxflow_state_new(int nv, int source, int sink,
+				 int ne, const int *edges);
+void maxflow_state_free(maxflow_state *mf);
+void maxflow_set_capacity(maxflow_state *mf, int e, int capacity);
+int maxflow_run(maxflow_state *mf, int *cut);
+const int *maxflow_flow(maxflow_state *mf);
+
 #endif /* MAXFLOW_MAXFLOW_H */
@@ -20,11 +20,48 @@ enum { NEWGAME, MOVE, SOLVE, RESTART };/* for midend_state_entry.movetype */
 #define special(type) ( (type) != MOVE )
 
 struct midend_state_entry {
-    game_state *state;
+    game_state *state;		       /* NULL if evicted (see below) */
     char *movestr;
     int movetype;
 };
 
+/*
+ * Undo history compression. Holding a complete game_state for
+ * every entry in states[] is the dominant memory cost of a long
+ * Solo, Loopy or Mines session, so instead we keep a full
+ * `keyframe' state only every UNDO_KEYFRAME moves (and for any
+ * entry which can't be rebuilt from its predecessor, i.e. the
+ * initial state and Restart moves), plus a window of UNDO_WINDOW
+ * materialised states either side of the current position. Every
+ * other entry keeps just its movestr, and is rebuilt on demand by
+ * replaying execute_move() forward from the nearest state we do
+ * have. Once built, a keyframe is never evicted.
+ *
+ * Because the window always covers statepos-2 and statepos, a
+ * single undo or redo never has to wait for a replay; the replay
+ * needed to refill the window afterwards costs at most
+ * UNDO_KEYFRAME-1 calls to execute_move().
+ *
+ * Defining UNDO_KEYFRAME as 1 restores the old keep-everything
+ * behaviour.
+ */
+#ifndef UNDO_KEYFRAME
+#define UNDO_KEYFRAME 16
+#endif
+#ifndef UNDO_WINDOW
+#define UNDO_WINDOW 4
+#endif
+
+/*
+ * For games which can encode their own states, save files also
+ * carry CHECKPNT records: the state every CHECKPOINT_INTERVAL
+ * moves, and each state from the bottom of the undo window up to
+ * the current position. Loading then only has to decode those
+ * instead of replaying the entire move list, and the rest of the
+ * history is rebuilt lazily if the user undoes past them.
+ */
+#define CHECKPOINT_INTERVAL (UNDO_KEYFRAME * 16)
+
 struct midend {
     frontend *frontend;
     random_state *random;
@@ -62,6 +99,12 @@ struct midend {
 
     int nstates, statesize, statepos;
     struct midend_state_entry *states;
+    int nevicted;		       /* entries in states[] with no state */
+    int undo_floor;		       /* undo may not go below this entry */
+    unsigned long state_bytes;	       /* approx footprint of one state */
+
+    void (*journal)(void *ctx, char *buf, int len);
+    void *journal_ctx;
 
     game_params *params, *curparams;
     game_drawstate *drawstate;
@@ -81,6 +124,11 @@ struct midend {
     int pressed_mouse_button;
 
     int preferred_tilesize, tilesize, winwidth, winheight;
+
+    int redraws_made, redraws_avoided; /* since last midend_redraw_stats */
+
+    int selftest, selftest_one_in;     /* see midend_set_selftest */
+    int selftest_count, selftest_pending;
 };
 
 #define ensure(me) do { \
@@ -105,6 +153,11 @@ midend *midend_new(frontend *fe, const game *ourgame,
     me->random = random_new(randseed, randseedsize);
     me->nstates = me->statesize = me->statepos = 0;
     me->states = NULL;
+    me->nevicted = 0;
+    me->undo_floor = 0;
+    me->state_bytes = 0;
+    me->journal = NULL;
+    me->journal_ctx = NULL;
     me->params = ourgame->default_params();
     me->curparams = NULL;
     me->desc = me->privdesc = NULL;
@@ -126,6 +179,15 @@ midend *midend_new(frontend *fe, const game *ourgame,
     me->timing = FALSE;
     me->elapsed = 0.0F;
     me->tilesize = me->winwidth = me->winheight = 0;
+    me->redraws_made = me->redraws_avoided = 0;
+#ifdef NDEBUG
+    me->selftest = SELFTEST_OFF;
+#else
+    me->selftest = SELFTEST_ALWAYS;
+#endif
+    me->selftest_one_in = 1;
+    me->selftest_count = 0;
+    me->selftest_pending = FALSE;
     if (drapi)
 	me->drawing = drawing_new(drapi, me, drhandle);
     else
@@ -151,18 +213,263 @@ midend *midend_new(frontend *fe, const game *ourgame,
 	    me->preferred_tilesize = ts;
     }
 
+    {
+        /*
+         * And likewise for the new-game self-test policy, with
+         * PUZZLES_SELFTEST set to `always', `off', or a number N
+         * meaning one game in N.
+         */
+        char *e = getenv("PUZZLES_SELFTEST");
+        int n;
+
+        if (e && !strcmp(e, "always"))
+            midend_set_selftest(me, SELFTEST_ALWAYS, 1);
+        else if (e && !strcmp(e, "off"))
+            midend_set_selftest(me, SELFTEST_OFF, 1);
+        else if (e && sscanf(e, "%d", &n) == 1 && n > 0)
+            midend_set_selftest(me, SELFTEST_SAMPLED, n);
+    }
+
     sfree(randseed);
 
     return me;
 }
 
-static void midend_free_game(midend *me)
+/*
+ * Throw away all history entries from `n' onwards.
+ */
+static void midend_truncate_states(midend *me, int n)
 {
-    while (me->nstates > 0) {
+    while (me->nstates > n) {
         me->nstates--;
-	me->ourgame->free_game(me->states[me->nstates].state);
+	if (me->states[me->nstates].state)
+	    me->ourgame->free_game(me->states[me->nstates].state);
+	else
+	    me->nevicted--;
 	sfree(me->states[me->nstates].movestr);
     }
+}
+
+static int midend_is_keyframe(midend *me, int i)
+{
+    return (i % UNDO_KEYFRAME == 0 ||
+	    me->states[i].movetype == NEWGAME ||
+	    me->states[i].movetype == RESTART);
+}
+
+/*
+ * Called when the move in history entry j fails to replay. That
+ * can't happen with moves we executed ourselves, but can with a
+ * damaged save file whose evicted moves weren't all checked on
+ * loading. Nothing from j up to the next held state can be rebuilt:
+ * if that gap lies after the current position we discard the redo
+ * history from j, and otherwise we stop undo at the first held
+ * state after the gap.
+ */
+static void midend_history_broken(midend *me, int j)
+{
+    int k;
+
+    if (j > me->statepos - 1) {
+	midend_truncate_states(me, j);
+	return;
+    }
+
+    for (k = j; !me->states[k].state; k++)
+	assert(k < me->statepos - 1);  /* the current state is held */
+    if (me->undo_floor < k)
+	me->undo_floor = k;
+}
+
+/*
+ * Return the game state for history entry i, rebuilding it if
+ * necessary by replaying forward from the nearest held state. Of
+ * the intermediate states produced on the way, keyframes are kept
+ * (so that the next replay further back is short) and the rest are
+ * discarded again as we go.
+ *
+ * Returns NULL if the entry can't be rebuilt, having first called
+ * midend_history_broken() so that nothing asks for it again.
+ */
+static game_state *midend_get_state(midend *me, int i)
+{
+    game_state *s;
+    int j;
+
+    assert(i >= 0 && i < me->nstates);
+
+    if (me->states[i].state)
+	return me->states[i].state;
+    if (i < me->undo_floor)
+	return NULL;
+
+    for (j = i; !me->states[j].state; j--)
+	assert(j > 0);		       /* states[0] is never evicted */
+
+    s = me->states[j].state;
+    for (j++; j <= i; j++) {
+	game_state *prev = s;
+
+	assert(me->states[j].movetype == MOVE ||
+	       me->states[j].movetype == SOLVE);
+	s = me->ourgame->execute_move(prev, me->states[j].movestr);
+	if (!s) {
+	    /* Keep the last good state, so the work isn't repeated. */
+	    if (!me->states[j-1].state) {
+		me->states[j-1].state = prev;
+		me->nevicted--;
+	    }
+	    midend_history_broken(me, j);
+	    return NULL;
+	}
+	if (!me->states[j-1].state)
+	    me->ourgame->free_game(prev);
+	if (j == i || midend_is_keyframe(me, j)) {
+	    me->states[j].state = s;
+	    me->nevicted--;
+	}
+    }
+
+    return me->states[i].state;
+}
+
+/*
+ * Re-establish the history invariant for entries in [lo,hi]: every
+ * entry within UNDO_WINDOW of the current position is held, and
+ * everything else except keyframes is evicted. Keyframes are kept
+ * if we have them, but not rebuilt just for the sake of it (after
+ * loading a checkpointed save file, most of them never will be).
+ */
+static void midend_trim_states(midend *me, int lo, int hi)
+{
+    int cur = me->statepos - 1;
+    int i;
+
+#define inwindow(i) ( (i) >= cur - UNDO_WINDOW && (i) <= cur + UNDO_WINDOW )
+
+    if (lo < 1)
+	lo = 1;
+    if (hi > me->nstates - 1)
+	hi = me->nstates - 1;
+
+    /*
+     * Materialise first and evict second, so that any replay can
+     * start from a state we're about to throw away.
+     */
+    for (i = lo; i <= hi && i < me->nstates; i++)
+	if (inwindow(i))
+	    midend_get_state(me, i);
+    if (hi > me->nstates - 1)
+	hi = me->nstates - 1;	       /* a failed replay may truncate */
+    for (i = lo; i <= hi; i++)
+	if (!inwindow(i) && !midend_is_keyframe(me, i) &&
+	    me->states[i].state) {
+	    me->ourgame->free_game(me->states[i].state);
+	    me->states[i].state = NULL;
+	    me->nevicted++;
+	}
+
+#undef inwindow
+}
+
+/*
+ * Measure roughly how much memory one state occupies, so that
+ * midend_undo_stats() can report what the history is saving. This
+ * is what dup_game() asks the allocator for, which overstates the
+ * footprint a little if it reallocates anything along the way.
+ */
+static void midend_measure_state(midend *me)
+{
+    unsigned long before = smalloc_total();
+    game_state *s = me->ourgame->dup_game(me->states[0].state);
+
+    me->state_bytes = smalloc_total() - before;
+    me->ourgame->free_game(s);
+}
+
+/*
+ * Called whenever statepos has moved by one: only the entry just
+ * leaving the window and those just entering it can have changed.
+ */
+#define midend_settle_states(me) \
+    midend_trim_states((me), (me)->statepos - 2 - UNDO_WINDOW, \
+		       (me)->statepos + UNDO_WINDOW)
+
+/*
+ * Report how much of the undo history is currently held only as
+ * move strings. Returns an estimate of the memory saved, in bytes.
+ */
+unsigned long midend_undo_stats(midend *me, int *nheld, int *nevicted)
+{
+    if (nheld)
+	*nheld = me->nstates - me->nevicted;
+    if (nevicted)
+	*nevicted = me->nevicted;
+    return me->nevicted * me->state_bytes;
+}
+
+/*
+ * Journalling. If the front end has asked for it, every change to
+ * the history is reported as it happens, as a short text record
+ * which midend_replay_journal() can later apply to a midend that
+ * has been deserialised from an earlier save. The records are
+ *
+ *   M:<pos>:<elapsed>:<uilen>:<ui><movestr>
+ *                        a move appended at states[pos]
+ *   S:...                likewise for a Solve move
+ *   R:...                likewise for a Restart (movestr is the desc)
+ *   P:<statepos>:<elapsed>:<uilen>:<ui>
+ *                        an undo or redo
+ *
+ * where <ui> is the output of encode_ui() at the time, since some
+ * games (Mines' death count, for instance) keep state there which
+ * a save file preserves.
+ *
+ * A call with a NULL buffer means the history has been replaced
+ * wholesale (new game, or a save file loaded), and the front end
+ * will need a full save before any further record is useful.
+ */
+void midend_set_journal(midend *me,
+                        void (*journal)(void *ctx, char *buf, int len),
+                        void *ctx)
+{
+    me->journal = journal;
+    me->journal_ctx = ctx;
+}
+
+static void midend_journal(midend *me, char type, int pos, char *str)
+{
+    char *buf, *ui;
+    int len;
+
+    if (!me->journal)
+        return;
+
+    ui = me->ui ? me->ourgame->encode_ui(me->ui) : NULL;
+    len = (ui ? strlen(ui) : 0);
+    buf = snewn(len + (str ? strlen(str) : 0) + 80, char);
+    sprintf(buf, "%c:%d:%g:%d:%s%s", type, pos, me->elapsed, len,
+            ui ? ui : "", str ? str : "");
+    me->journal(me->journal_ctx, buf, strlen(buf));
+    sfree(buf);
+    sfree(ui);
+}
+
+static void midend_journal_appended(midend *me)
+{
+    static const char types[] = { '?', 'M', 'S', 'R' };
+    struct midend_state_entry *e = &me->states[me->nstates - 1];
+
+    midend_journal(me, types[e->movetype], me->nstates - 1, e->movestr);
+}
+
+#define midend_journal_reset(me) do { \
+    if ((me)->journal) (me)->journal((me)->journal_ctx, NULL, 0); \
+} while (0)
+
+static void midend_free_game(midend *me)
+{
+    midend_truncate_states(me, 0);
 
     if (me->drawstate)
         me->ourgame->free_drawstate(me->drawing, me->drawstate);
@@ -333,13 +640,24 @@ void midend_new_game(midend *me)
              * I'll avoid putting a leading zero on the number,
              * just in case it confuses anybody who thinks it's
              * processed as an integer rather than a string.
+             *
+             * Games which ask for it (or all games, in a build with
+             * FAST_RANDOM_SEEDS defined) get the fast generator,
+             * which is selected by a prefix on the seed itself so
+             * that older seeds still mean what they always did.
              */
-            char newseed[16];
+            char newseed[17], *p = newseed;
+            int digits[14];
             int i;
-            newseed[15] = '\0';
-            newseed[0] = '1' + (char)random_upto(me->random, 9);
+#ifndef FAST_RANDOM_SEEDS
+            if (me->ourgame->flags & FAST_RANDOM)
+#endif
+                *p++ = RANDOM_FAST_PREFIX;
+            p[15] = '\0';
+            p[0] = '1' + (char)random_upto(me->random, 9);
+            random_upto_array(me->random, 10, digits, 14);
             for (i = 1; i < 15; i++)
-                newseed[i] = '0' + (char)random_upto(me->random, 10);
+                p[i] = '0' + (char)digits[i-1];
             sfree(me->seedstr);
             me->seedstr = dupstr(newseed);
 
@@ -386,28 +704,26 @@ void midend_new_game(midend *me)
 	me->ourgame->new_game(me, me->params, me->desc);
 
     /*
-     * As part of our commitment to self-testing, test the aux
-     * string to make sure nothing ghastly went wrong.
+     * As part of our commitment to self-testing, we test the aux
+     * string to make sure nothing ghastly went wrong. Some solvers
+     * are slow enough for that to hold up the first frame
+     * noticeably, so it's only queued here; the front end runs it
+     * later via midend_selftest().
      */
-    if (me->ourgame->can_solve && me->aux_info) {
-	game_state *s;
-	char *msg, *movestr;
-
-	msg = NULL;
-	movestr = me->ourgame->solve(me->states[0].state,
-				     me->states[0].state,
-				     me->aux_info, &msg);
-	assert(movestr && !msg);
-	s = me->ourgame->execute_move(me->states[0].state, movestr);
-	assert(s);
-	me->ourgame->free_game(s);
-	sfree(movestr);
-    }
+    me->selftest_pending = FALSE;
+    if (me->ourgame->can_solve && me->aux_info &&
+        (me->selftest == SELFTEST_ALWAYS ||
+         (me->selftest == SELFTEST_SAMPLED &&
+          me->selftest_count++ % me->selftest_one_in == 0)))
+        me->selftest_pending = TRUE;
 
     me->states[me->nstates].movestr = NULL;
     me->states[me->nstates].movetype = NEWGAME;
     me->nstates++;
     me->statepos = 1;
+    me->undo_floor = 0;
+    midend_measure_state(me);
+
     me->drawstate = me->ourgame->new_drawstate(me->drawing,
 					       me->states[0].state);
     midend_size_new_drawstate(me);
@@ -417,17 +733,65 @@ void midend_new_game(midend *me)
     me->ui = me->ourgame->new_ui(me->states[0].state);
     midend_set_timer(me);
     me->pressed_mouse_button = 0;
+    midend_journal_reset(me);
+}
+
+/*
+ * Choose which newly generated games get their aux_info checked:
+ * all of them, one in `one_in', or none.
+ */
+void midend_set_selftest(midend *me, int policy, int one_in)
+{
+    me->selftest = policy;
+    me->selftest_one_in = (one_in > 0 ? one_in : 1);
+    me->selftest_count = 0;
+}
+
+/*
+ * Run the self-test queued by midend_new_game(), if any: solve the
+ * initial state using the aux_info the generator left us, and
+ * check the resulting move executes. Returns NULL if there was
+ * nothing to do or the test passed, or else a description of what
+ * went wrong, for the front end to log.
+ */
+char *midend_selftest(midend *me)
+{
+    game_state *s;
+    char *msg, *movestr;
+
+    if (!me->selftest_pending)
+        return NULL;
+    me->selftest_pending = FALSE;
+
+    msg = NULL;
+    movestr = me->ourgame->solve(me->states[0].state,
+                                 me->states[0].state,
+                                 me->aux_info, &msg);
+    if (!movestr)
+        return "Solving from aux_info failed";
+    if (msg) {
+        sfree(movestr);
+        return "Solving from aux_info gave an error message";
+    }
+    s = me->ourgame->execute_move(me->states[0].state, movestr);
+    sfree(movestr);
+    if (!s)
+        return "Move generated from aux_info did not execute";
+    me->ourgame->free_game(s);
+    return NULL;
 }
 
 static int midend_undo(midend *me)
 {
-    if (me->statepos > 1) {
+    if (me->statepos > me->undo_floor + 1) {
         if (me->ui)
             me->ourgame->changed_state(me->ui,
                                        me->states[me->statepos-1].state,
                                        me->states[me->statepos-2].state);
 	me->statepos--;
         me->dir = -1;
+        midend_settle_states(me);
+        midend_journal(me, 'P', me->statepos, NULL);
         return 1;
     } else
         return 0;
@@ -442,6 +806,8 @@ static int midend_redo(midend *me)
                                        me->states[me->statepos].state);
 	me->statepos++;
         me->dir = +1;
+        midend_settle_states(me);
+        midend_journal(me, 'P', me->statepos, NULL);
         return 1;
     } else
         return 0;
@@ -511,17 +877,18 @@ void midend_restart_game(midend *me)
      * Now enter the restarted state as the next move.
      */
     midend_stop_anim(me);
-    while (me->nstates > me->statepos)
-	me->ourgame->free_game(me->states[--me->nstates].state);
+    midend_truncate_states(me, me->statepos);
     ensure(me);
     me->states[me->nstates].state = s;
     me->states[me->nstates].movestr = dupstr(me->desc);
     me->states[me->nstates].movetype = RESTART;
     me->statepos = ++me->nstates;
+    midend_settle_states(me);
     if (me->ui)
         me->ourgame->changed_state(me->ui,
                                    me->states[me->statepos-2].state,
                                    me->states[me->statepos-1].state);
+    midend_journal_appended(me);
     me->anim_time = 0.0;
     midend_finish_move(me);
     midend_redraw(me);
@@ -587,19 +954,20 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
             goto done;
         } else if (s) {
 	    midend_stop_anim(me);
-            while (me->nstates > me->statepos)
-                me->ourgame->free_game(me->states[--me->nstates].state);
+            midend_truncate_states(me, me->statepos);
             ensure(me);
             assert(movestr != NULL);
             me->states[me->nstates].state = s;
             me->states[me->nstates].movestr = movestr;
             me->states[me->nstates].movetype = MOVE;
             me->statepos = ++me->nstates;
+            midend_settle_states(me);
             me->dir = +1;
 	    if (me->ui)
 		me->ourgame->changed_state(me->ui,
 					   me->states[me->statepos-2].state,
 					   me->states[me->statepos-1].state);
+            midend_journal_appended(me);
         } else {
             goto done;
         }
@@ -773,22 +1141,60 @@ void midend_redraw(midend *me)
     assert(me->drawing);
 
     if (me->statepos > 0 && me->drawstate) {
-        start_draw(me->drawing);
+        game_state *oldstate = NULL;
+        int dir = +1 /*shrug*/;
+        float anim_pos = 0.0;
+        int x, y, w, h;
+
         if (me->oldstate && me->anim_time > 0 &&
             me->anim_pos < me->anim_time) {
             assert(me->dir != 0);
-            me->ourgame->redraw(me->drawing, me->drawstate, me->oldstate,
-				me->states[me->statepos-1].state, me->dir,
-				me->ui, me->anim_pos, me->flash_pos);
-        } else {
-            me->ourgame->redraw(me->drawing, me->drawstate, NULL,
-				me->states[me->statepos-1].state, +1 /*shrug*/,
-				me->ui, 0.0, me->flash_pos);
+            oldstate = me->oldstate;
+            dir = me->dir;
+            anim_pos = me->anim_pos;
+        }
+
+        /*
+         * If the back end can tell us in advance what a redraw
+         * would touch, skip it altogether when the answer is
+         * nothing, and otherwise confine it to that area.
+         */
+        if (me->ourgame->redraw_region &&
+            !me->ourgame->redraw_region(me->drawstate, oldstate,
+                                        me->states[me->statepos-1].state,
+                                        dir, me->ui, anim_pos,
+                                        me->flash_pos, &x, &y, &w, &h)) {
+            me->redraws_avoided++;
+            return;
         }
+        me->redraws_made++;
+
+        start_draw(me->drawing);
+        if (me->ourgame->redraw_region)
+            draw_restrict(me->drawing, x, y, w, h);
+        me->ourgame->redraw(me->drawing, me->drawstate, oldstate,
+                            me->states[me->statepos-1].state, dir,
+                            me->ui, anim_pos, me->flash_pos);
+        if (me->ourgame->redraw_region)
+            draw_unrestrict(me->drawing);
         end_draw(me->drawing);
     }
 }
 
+/*
+ * Report how many calls to the back end's redraw function have
+ * been made, and how many avoided because redraw_region() said
+ * there was nothing to draw, since the last call to this function.
+ */
+void midend_redraw_stats(midend *me, int *made, int *avoided)
+{
+    if (made)
+        *made = me->redraws_made;
+    if (avoided)
+        *avoided = me->redraws_avoided;
+    me->redraws_made = me->redraws_avoided = 0;
+}
+
 /*
  * Nasty hacky function used to implement the --redo option in
  * gtk.c. Only used for generating the puzzles' icons.
@@ -1282,20 +1688,18 @@ char *midend_solve(midend *me)
      * Now enter the solved state as the next move.
      */
     midend_stop_anim(me);
-    while (me->nstates > me->statepos) {
-	me->ourgame->free_game(me->states[--me->nstates].state);
-        if (me->states[me->nstates].movestr)
-            sfree(me->states[me->nstates].movestr);
-    }
+    midend_truncate_states(me, me->statepos);
     ensure(me);
     me->states[me->nstates].state = s;
     me->states[me->nstates].movestr = movestr;
     me->states[me->nstates].movetype = SOLVE;
     me->statepos = ++me->nstates;
+    midend_settle_states(me);
     if (me->ui)
         me->ourgame->changed_state(me->ui,
                                    me->states[me->statepos-2].state,
                                    me->states[me->statepos-1].state);
+    midend_journal_appended(me);
     me->dir = +1;
     if (me->ourgame->flags & SOLVE_ANIMATES) {
 	me->oldstate = me->ourgame->dup_game(me->states[me->statepos-2].state);
@@ -1346,12 +1750,82 @@ char *midend_rewrite_statusbar(midend *me, char *text)
 #define SERIALISE_MAGIC "Simon Tatham's Portable Puzzle Collection"
 #define SERIALISE_VERSION "1"
 
+/*
+ * Define this to write the move list as a single MOVEPACK record
+ * instead of one MOVE/SOLVE/RESTART line per move. Each move in the
+ * pack is a type byte, then the length of the prefix it shares with
+ * the previous move string and the length of the remainder (both as
+ * little-endian base-128 varints), then the remainder itself. This
+ * drops the 15-odd bytes of header per move and most of the
+ * repetition between consecutive moves. The loader always
+ * understands MOVEPACK, but older builds don't, so it's off by
+ * default.
+ */
+/* #define SERIALISE_MOVEPACK */
+
+/*
+ * The whole save file is assembled in memory and then handed to
+ * the front end's write function in one call, so that the front end
+ * can write it out with a single system call (and atomically
+ * replace the old file, if it likes).
+ */
+struct serialise_buf {
+    char *data;
+    int len, size;
+};
+
+static void serialise_append(struct serialise_buf *sb, const void *p, int len)
+{
+    if (sb->len + len > sb->size) {
+	sb->size = (sb->len + len) * 5 / 4 + 1024;
+	sb->data = sresize(sb->data, sb->size, char);
+    }
+    memcpy(sb->data + sb->len, p, len);
+    sb->len += len;
+}
+
+#ifdef SERIALISE_MOVEPACK
+static void serialise_varint(struct serialise_buf *sb, unsigned int n)
+{
+    unsigned char c;
+
+    do {
+	c = n & 0x7F;
+	n >>= 7;
+	if (n)
+	    c |= 0x80;
+	serialise_append(sb, &c, 1);
+    } while (n);
+}
+#endif
+
+static int deserialise_varint(const unsigned char **p,
+			      const unsigned char *end, int *n)
+{
+    unsigned int ret = 0;
+    int shift = 0;
+
+    do {
+	if (*p >= end || shift > 28)
+	    return FALSE;
+	ret |= (**p & 0x7F) << shift;
+	shift += 7;
+    } while (*(*p)++ & 0x80);
+
+    *n = (int)ret;
+    return TRUE;
+}
+
 void midend_serialise(midend *me,
                       void (*write)(void *ctx, void *buf, int len),
                       void *wctx)
 {
+    struct serialise_buf sb;
     int i;
 
+    sb.data = NULL;
+    sb.len = sb.size = 0;
+
     /*
      * Each line of the save file contains three components. First
      * exactly 8 characters of header word indicating what type of
@@ -1361,13 +1835,17 @@ void midend_serialise(midend *me,
      * many bytes as previously specified, no matter what they
      * contain). Then a newline (of reasonably flexible form).
      */
-#define wr(h,s) do { \
+#define wrlen(h,s,n) do { \
     char hbuf[80]; \
+    int len = (n); \
+    sprintf(hbuf, "%-8.8s:%d:", (h), len); \
+    serialise_append(&sb, hbuf, strlen(hbuf)); \
+    serialise_append(&sb, (s), len); \
+    serialise_append(&sb, "\n", 1); \
+} while (0)
+#define wr(h,s) do { \
     char *str = (s); \
-    sprintf(hbuf, "%-8.8s:%d:", (h), (int)strlen(str)); \
-    write(wctx, hbuf, strlen(hbuf)); \
-    write(wctx, str, strlen(str)); \
-    write(wctx, "\n", 1); \
+    wrlen(h, str, strlen(str)); \
 } while (0)
 
     /*
@@ -1468,12 +1946,68 @@ void midend_serialise(midend *me,
         wr("STATEPOS", buf);
     }
 
+    /*
+     * Checkpoints. These must come before the move list, because
+     * the loader stops reading as soon as it has all the moves.
+     * Older loaders don't recognise the record and skip it.
+     */
+    if (me->ourgame->encode_state) {
+        int cur = me->statepos - 1;
+
+        for (i = 1; i < me->nstates; i++) {
+            char *enc, *buf;
+
+            if (!me->states[i].state ||
+                (i % CHECKPOINT_INTERVAL &&
+                 (i < cur - UNDO_WINDOW || i > cur)))
+                continue;
+
+            enc = me->ourgame->encode_state(me->states[i].state);
+            buf = snewn(strlen(enc) + 40, char);
+            sprintf(buf, "%d:%s", i, enc);
+            wr("CHECKPNT", buf);
+            sfree(buf);
+            sfree(enc);
+        }
+    }
+
     /*
      * For each state after the initial one (which we know is
      * constructed from either privdesc or desc), enough
      * information for execute_move() to reconstruct it from the
      * previous one.
      */
+#ifdef SERIALISE_MOVEPACK
+    if (me->nstates > 1) {
+        struct serialise_buf pack;
+        const char *prev = "";
+
+        pack.data = NULL;
+        pack.len = pack.size = 0;
+
+        for (i = 1; i < me->nstates; i++) {
+            const char *str = me->states[i].movestr;
+            int common = 0, rest;
+            char type;
+
+            assert(me->states[i].movetype != NEWGAME);   /* only state 0 */
+            type = (me->states[i].movetype == SOLVE ? 'S' :
+                    me->states[i].movetype == RESTART ? 'R' : 'M');
+            while (prev[common] && prev[common] == str[common])
+                common++;
+            rest = strlen(str + common);
+
+            serialise_append(&pack, &type, 1);
+            serialise_varint(&pack, common);
+            serialise_varint(&pack, rest);
+            serialise_append(&pack, str + common, rest);
+            prev = str;
+        }
+
+        wrlen("MOVEPACK", pack.data, pack.len);
+        sfree(pack.data);
+    }
+#else
     for (i = 1; i < me->nstates; i++) {
         assert(me->states[i].movetype != NEWGAME);   /* only state 0 */
         switch (me->states[i].movetype) {
@@ -1488,8 +2022,13 @@ void midend_serialise(midend *me,
             break;
         }
     }
+#endif
 
 #undef wr
+#undef wrlen
+
+    write(wctx, sb.data, sb.len);
+    sfree(sb.data);
 }
 
 /*
@@ -1515,6 +2054,8 @@ char *midend_deserialise(midend *me,
      */
     char *seed = NULL, *parstr = NULL, *desc = NULL, *privdesc = NULL;
     char *auxinfo = NULL, *uistr = NULL, *cparstr = NULL;
+    char **checkpoints = NULL;
+    int ncheckpoints = 0, lazy = FALSE;
     float elapsed = 0.0F;
     game_params *params = NULL, *cparams = NULL;
     game_ui *ui = NULL;
@@ -1644,13 +2185,26 @@ char *midend_deserialise(midend *me,
                     goto cleanup;
                 }
                 states = snewn(nstates, struct midend_state_entry);
+                checkpoints = snewn(nstates, char *);
+                ncheckpoints = nstates;
                 for (i = 0; i < nstates; i++) {
                     states[i].state = NULL;
                     states[i].movestr = NULL;
                     states[i].movetype = NEWGAME;
+                    checkpoints[i] = NULL;
                 }
             } else if (!strcmp(key, "STATEPOS")) {
                 statepos = atoi(val);
+            } else if (!strcmp(key, "CHECKPNT")) {
+                char *p = val + strspn(val, "0123456789");
+                int index = atoi(val);
+
+                if (!states || *p != ':' || index <= 0 || index >= nstates) {
+                    ret = "Save file contained an invalid checkpoint";
+                    goto cleanup;
+                }
+                sfree(checkpoints[index]);
+                checkpoints[index] = dupstr(p + 1);
             } else if (!strcmp(key, "MOVE")) {
                 gotstates++;
                 states[gotstates].movetype = MOVE;
@@ -1666,6 +2220,42 @@ char *midend_deserialise(midend *me,
                 states[gotstates].movetype = RESTART;
                 states[gotstates].movestr = val;
                 val = NULL;
+            } else if (!strcmp(key, "MOVEPACK")) {
+                const unsigned char *p = (const unsigned char *)val;
+                const unsigned char *end = p + len;
+                const char *prev = "";
+
+                if (!states) {
+                    ret = "Save file contained moves before a state count";
+                    goto cleanup;
+                }
+                while (p < end) {
+                    int type, common, rest;
+                    char *str;
+
+                    type = *p++;
+                    if (gotstates + 1 >= nstates ||
+                        !deserialise_varint(&p, end, &common) ||
+                        !deserialise_varint(&p, end, &rest) ||
+                        common > (int)strlen(prev) || rest > end - p ||
+                        (type != 'M' && type != 'S' && type != 'R')) {
+                        ret = "Save file contained a corrupt move list";
+                        goto cleanup;
+                    }
+
+                    str = snewn(common + rest + 1, char);
+                    memcpy(str, prev, common);
+                    memcpy(str + common, p, rest);
+                    str[common + rest] = '\0';
+                    p += rest;
+
+                    gotstates++;
+                    states[gotstates].movetype = (type == 'S' ? SOLVE :
+                                                  type == 'R' ? RESTART :
+                                                  MOVE);
+                    states[gotstates].movestr = str;
+                    prev = str;
+                }
             }
         }
 
@@ -1710,11 +2300,43 @@ char *midend_deserialise(midend *me,
 
     states[0].state = me->ourgame->new_game(me, params,
                                             privdesc ? privdesc : desc);
+
+    /*
+     * Decode any checkpoints. If we got at least one, the move list
+     * is only replayed where it's cheap (forward from a state we
+     * already have, within the undo window); everything else is
+     * left for midend_get_state() to rebuild on demand. A
+     * checkpoint the game doesn't like is simply ignored.
+     *
+     * Moves we don't replay here aren't checked either, except
+     * those leading up to the current position, which we must be
+     * able to rebuild before accepting the file. If any other one
+     * later fails to replay, midend_get_state() reports it and
+     * midend_history_broken() fences it off, rather than the load
+     * failing as it would have done with a full replay.
+     */
+    if (me->ourgame->decode_state) {
+        for (i = 1; i < nstates; i++)
+            if (checkpoints[i] && states[i].movetype != RESTART) {
+                states[i].state =
+                    me->ourgame->decode_state(states[0].state,
+                                              checkpoints[i]);
+                if (states[i].state)
+                    lazy = TRUE;
+            }
+    }
+
     for (i = 1; i < nstates; i++) {
         assert(states[i].movetype != NEWGAME);
+        if (states[i].state)
+            continue;                  /* got it from a checkpoint */
         switch (states[i].movetype) {
           case MOVE:
           case SOLVE:
+            if (lazy && !(states[i-1].state &&
+                          i >= statepos - 1 - UNDO_WINDOW &&
+                          i <= statepos - 1 + UNDO_WINDOW))
+                break;
             states[i].state = me->ourgame->execute_move(states[i-1].state,
                                                         states[i].movestr);
             if (states[i].state == NULL) {
@@ -1733,6 +2355,34 @@ char *midend_deserialise(midend *me,
         }
     }
 
+    /*
+     * If the current position wasn't in reach of a checkpoint,
+     * rebuild it now from the nearest state we do have, so that a
+     * bad move on the way is reported as it would have been by a
+     * full replay. The states in between are thrown away again.
+     */
+    if (lazy && statepos >= 1 && statepos <= nstates &&
+        !states[statepos-1].state) {
+        game_state *s;
+        int j;
+
+        for (j = statepos - 1; !states[j].state; j--)
+            assert(j > 0);             /* states[0] is always present */
+        s = states[j].state;
+        for (j++; j <= statepos - 1; j++) {
+            game_state *prev = s;
+
+            s = me->ourgame->execute_move(prev, states[j].movestr);
+            if (!states[j-1].state)
+                me->ourgame->free_game(prev);
+            if (!s) {
+                ret = "Save file contained an invalid move";
+                goto cleanup;
+            }
+        }
+        states[statepos-1].state = s;
+    }
+
     ui = me->ourgame->new_ui(states[0].state);
     me->ourgame->decode_ui(ui, uistr);
 
@@ -1764,6 +2414,7 @@ char *midend_deserialise(midend *me,
     }
 
     me->genmode = GOT_NOTHING;
+    me->selftest_pending = FALSE;
 
     me->statesize = nstates;
     nstates = me->nstates;
@@ -1775,6 +2426,13 @@ char *midend_deserialise(midend *me,
         states = tmp;
     }
     me->statepos = statepos;
+    me->undo_floor = 0;
+    me->nevicted = 0;
+    for (i = 0; i < me->nstates; i++)
+        if (!me->states[i].state)
+            me->nevicted++;
+    midend_trim_states(me, 1, me->nstates - 1);
+    midend_measure_state(me);
 
     {
         game_params *tmp;
@@ -1811,6 +2469,7 @@ char *midend_deserialise(midend *me,
         me->ourgame->new_drawstate(me->drawing,
 				   me->states[me->statepos-1].state);
     midend_size_new_drawstate(me);
+    midend_journal_reset(me);
 
     ret = NULL;                        /* success! */
 
@@ -1829,6 +2488,11 @@ char *midend_deserialise(midend *me,
         me->ourgame->free_params(cparams);
     if (ui)
         me->ourgame->free_ui(ui);
+    if (checkpoints) {
+        for (i = 0; i < ncheckpoints; i++)
+            sfree(checkpoints[i]);
+        sfree(checkpoints);
+    }
     if (states) {
         int i;
 
@@ -1843,3 +2507,111 @@ char *midend_deserialise(midend *me,
     return ret;
 }
 
+/*
+ * Apply one record produced by the journal callback (see
+ * midend_set_journal) to the current history. Returns an error
+ * string if the record doesn't fit, in which case the midend is
+ * left as it was before the call.
+ */
+char *midend_replay_journal(midend *me, char *record, int len)
+{
+    char *buf, *p, *ui, *str;
+    char type;
+    int pos, uilen;
+    float elapsed;
+    game_state *s = NULL, *oldstate = NULL;
+    char *ret = NULL;
+
+    if (me->nstates < 1)
+        return "No game to replay journal into";
+
+    buf = snewn(len + 1, char);
+    memcpy(buf, record, len);
+    buf[len] = '\0';
+
+    type = buf[0];
+    p = buf + 1;
+    if (*p++ != ':') {
+        ret = "Malformed journal record";
+        goto done;
+    }
+    pos = atoi(p);
+    p += strspn(p, "0123456789");
+    if (*p++ != ':') {
+        ret = "Malformed journal record";
+        goto done;
+    }
+    elapsed = (float)atof(p);
+    p = strchr(p, ':');
+    if (!p || (uilen = atoi(++p)) < 0 || !(p = strchr(p, ':')) ||
+        uilen > (int)strlen(++p)) {
+        ret = "Malformed journal record";
+        goto done;
+    }
+    ui = p;
+    str = p + uilen;
+    if (type == 'P' && *str) {
+        ret = "Malformed journal record";
+        goto done;
+    }
+
+    midend_stop_anim(me);
+    oldstate = me->ourgame->dup_game(me->states[me->statepos-1].state);
+
+    if (type == 'P') {
+        if (pos < me->undo_floor + 1 || pos > me->nstates) {
+            ret = "Journal record out of range";
+            goto done;
+        }
+        me->statepos = pos;
+    } else if (type == 'M' || type == 'S' || type == 'R') {
+        if (pos < 1 || pos > me->nstates) {
+            ret = "Journal record out of range";
+            goto done;
+        }
+        if (type == 'R') {
+            if (me->ourgame->validate_desc(me->params, str)) {
+                ret = "Journal contained an invalid restart move";
+                goto done;
+            }
+            s = me->ourgame->new_game(me, me->params, str);
+        } else {
+            s = midend_get_state(me, pos - 1);
+            if (s)
+                s = me->ourgame->execute_move(s, str);
+            if (!s) {
+                ret = "Journal contained an invalid move";
+                goto done;
+            }
+        }
+        midend_truncate_states(me, pos);
+        ensure(me);
+        me->states[me->nstates].state = s;
+        me->states[me->nstates].movestr = dupstr(str);
+        me->states[me->nstates].movetype = (type == 'M' ? MOVE :
+                                            type == 'S' ? SOLVE : RESTART);
+        me->statepos = ++me->nstates;
+    } else {
+        ret = "Unrecognised journal record";
+        goto done;
+    }
+
+    midend_trim_states(me, 1, me->nstates - 1);
+    if (me->ui) {
+        me->ourgame->changed_state(me->ui, oldstate,
+                                   me->states[me->statepos-1].state);
+        if (uilen) {
+            ui[uilen] = '\0';
+            me->ourgame->decode_ui(me->ui, ui);
+        }
+    }
+    me->elapsed = elapsed;
+    midend_set_timer(me);
+
+    done:
+    if (oldstate)
+        me->ourgame->free_game(oldstate);
+    sfree(buf);
+    return ret;
+}
+
@@ -327,6 +327,17 @@ static int setcmp(void *av, void *bv)
 	return 0;
 }
 
+/*
+ * Key for the set tree: the coordinates alone, in the same order
+ * as setcmp, leaving it to break ties between masks.
+ */
+static long setkey(void *av)
+{
+    struct set *a = (struct set *)av;
+
+    return (long)a->y * 65536L + (a->x + 32768L);
+}
+
 struct setstore {
     tree234 *sets;
     struct set *todo_head, *todo_tail;
@@ -335,7 +346,7 @@ struct setstore {
 static struct setstore *ss_new(void)
 {
     struct setstore *ss = snew(struct setstore);
-    ss->sets = newtree234(setcmp);
+    ss->sets = newtree234_wide(setcmp, setkey);
     ss->todo_head = ss->todo_tail = NULL;
     return ss;
 }
@@ -495,6 +506,7 @@ static struct set **ss_overlap(struct setstore *ss, int x, int y, int mask)
     for (xx = x-3; xx < x+3; xx++)
 	for (yy = y-3; yy < y+3; yy++) {
 	    struct set stmp, *s;
+	    cursor234 c;
 	    int pos;
 
 	    /*
@@ -505,8 +517,8 @@ static struct set **ss_overlap(struct setstore *ss, int x, int y, int mask)
 	    stmp.mask = 0;
 
 	    if (findrelpos234(ss->sets, &stmp, NULL, REL234_GE, &pos)) {
-		while ((s = index234(ss->sets, pos)) != NULL &&
-		       s->x == xx && s->y == yy) {
+		for (s = seek234(ss->sets, &c, pos);
+		     s && s->x == xx && s->y == yy; s = next234(&c)) {
 		    /*
 		     * This set potentially overlaps the input one.
 		     * Compute the intersection to see if they
@@ -523,8 +535,6 @@ static struct set **ss_overlap(struct setstore *ss, int x, int y, int mask)
 			}
 			ret[nret++] = s;
 		    }
-
-		    pos++;
 		}
 	    }
 	}
@@ -1014,8 +1024,10 @@ static int minesolve(int w, int h, int n, signed char *grid,
 		 *    give up.
 		 */
 		struct set *sets[lenof(setused)];
-		for (i = 0; i < nsets; i++)
-		    sets[i] = index234(ss->sets, i);
+		cursor234 c;
+		sets[0] = seek234(ss->sets, &c, 0);
+		for (i = 1; i < nsets; i++)
+		    sets[i] = next234(&c);
 
 		cursor = 0;
 		while (1) {
@@ -2671,6 +2683,64 @@ static game_state *execute_move(game_state *from, char *move)
     }
 }
 
+/*
+ * Checkpoint encoding of a game state for save files: the three
+ * status flags, then the player's knowledge grid in hex.
+ */
+static char *encode_state(game_state *state)
+{
+    int wh = state->w * state->h;
+    char *hex, *ret;
+
+    hex = bin2hex((unsigned char *)state->grid, wh);
+    ret = snewn(strlen(hex) + 40, char);
+    sprintf(ret, "%d,%d,%d,%s", state->dead, state->won,
+	    state->used_solve, hex);
+    sfree(hex);
+
+    return ret;
+}
+
+static game_state *decode_state(game_state *initial, char *encoding)
+{
+    int wh = initial->w * initial->h;
+    int dead, won, used_solve, n, i;
+    unsigned char *grid;
+    game_state *ret;
+
+    if (!initial->layout->mines)
+	return NULL;		       /* layout not generated yet */
+    if (sscanf(encoding, "%d,%d,%d,%n", &dead, &won, &used_solve, &n) < 3 ||
+	strlen(encoding + n) != (size_t)wh * 2 ||
+	strspn(encoding + n, "0123456789abcdefABCDEF") != (size_t)wh * 2)
+	return NULL;
+    if ((dead & ~1) || (won & ~1) || (used_solve & ~1))
+	return NULL;
+
+    /*
+     * Only accept the values described in struct game_state, so
+     * that a damaged checkpoint can't give the drawing and move
+     * code something no sequence of moves could have produced.
+     */
+    grid = hex2bin(encoding + n, wh);
+    for (i = 0; i < wh; i++) {
+	signed char v = (signed char)grid[i];
+	if (!((v >= -3 && v <= 8) || (v >= 64 && v <= 66))) {
+	    sfree(grid);
+	    return NULL;
+	}
+    }
+    ret = dup_game(initial);
+    for (i = 0; i < wh; i++)
+	ret->grid[i] = (signed char)grid[i];
+    sfree(grid);
+    ret->dead = dead;
+    ret->won = won;
+    ret->used_solve = used_solve;
+
+    return ret;
+}
+
 /* ----------------------------------------------------------------------
  * Drawing routines.
  */
@@ -2971,6 +3041,94 @@ static void draw_tile(drawing *dr, game_drawstate *ds,
     draw_update(dr, x, y, TILE_SIZE, TILE_SIZE);
 }
 
+static int flash_background(game_ui *ui, float flashtime)
+{
+    if (flashtime) {
+	int frame = (int)(flashtime / FLASH_FRAME);
+	if (frame % 2)
+	    return (ui->flash_is_death ? COL_BACKGROUND : COL_LOWLIGHT);
+	else
+	    return (ui->flash_is_death ? COL_BANG : COL_HIGHLIGHT);
+    } else
+	return COL_BACKGROUND;
+}
+
+/*
+ * Work out what draw_tile() should show for square (x,y): the grid
+ * value, with flag-count errors and the pressed-square highlight
+ * folded in.
+ */
+static int tile_value(game_state *state, game_ui *ui, int x, int y)
+{
+    int v = state->grid[y*state->w+x];
+
+    if (v >= 0 && v <= 8) {
+	/*
+	 * Count up the flags around this tile, and if
+	 * there are too _many_, highlight the tile.
+	 */
+	int dx, dy, flags = 0;
+
+	for (dy = -1; dy <= +1; dy++)
+	    for (dx = -1; dx <= +1; dx++) {
+		int nx = x+dx, ny = y+dy;
+		if (nx >= 0 && nx < state->w &&
+		    ny >= 0 && ny < state->h &&
+		    state->grid[ny*state->w+nx] == -1)
+		    flags++;
+	    }
+
+	if (flags > v)
+	    v |= 32;
+    }
+
+    if ((v == -2 || v == -3) &&
+	(abs(x-ui->hx) <= ui->hradius && abs(y-ui->hy) <= ui->hradius))
+	v -= 20;
+
+    return v;
+}
+
+static int game_redraw_region(game_drawstate *ds, game_state *oldstate,
+			      game_state *state, int dir, game_ui *ui,
+			      float animtime, float flashtime,
+			      int *rx, int *ry, int *rw, int *rh)
+{
+    int x, y, x0 = ds->w, y0 = ds->h, x1 = -1, y1 = -1;
+    int cx = -1, cy = -1, cmoved, bg = flash_background(ui, flashtime);
+
+    if (!ds->started) {
+	*rx = *ry = 0;
+	*rw = TILE_SIZE * state->w + 2 * BORDER;
+	*rh = TILE_SIZE * state->h + 2 * BORDER;
+	return TRUE;
+    }
+
+    if (ui->cur_visible) cx = ui->cur_x;
+    if (ui->cur_visible) cy = ui->cur_y;
+    cmoved = (cx != ds->cur_x || cy != ds->cur_y);
+
+    /* This must agree exactly with the tile loop in game_redraw. */
+    for (y = 0; y < ds->h; y++)
+	for (x = 0; x < ds->w; x++)
+	    if (ds->grid[y*ds->w+x] != tile_value(state, ui, x, y) ||
+		bg != ds->bg ||
+		(cmoved && ((x == cx && y == cy) ||
+			    (x == ds->cur_x && y == ds->cur_y)))) {
+		x0 = min(x0, x); x1 = max(x1, x);
+		y0 = min(y0, y); y1 = max(y1, y);
+	    }
+
+    if (x1 < 0)
+	return FALSE;
+
+    *rx = COORD(x0);
+    *ry = COORD(y0);
+    *rw = (x1 - x0 + 1) * TILE_SIZE;
+    *rh = (y1 - y0 + 1) * TILE_SIZE;
+    return TRUE;
+}
+
 static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
 			game_state *state, int dir, game_ui *ui,
 			float animtime, float flashtime)
@@ -2979,14 +3137,7 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
     int mines, markers, bg;
     int cx = -1, cy = -1, cmoved;
 
-    if (flashtime) {
-	int frame = (int)(flashtime / FLASH_FRAME);
-	if (frame % 2)
-	    bg = (ui->flash_is_death ? COL_BACKGROUND : COL_LOWLIGHT);
-	else
-	    bg = (ui->flash_is_death ? COL_BANG : COL_HIGHLIGHT);
-    } else
-	bg = COL_BACKGROUND;
+    bg = flash_background(ui, flashtime);
 
     if (!ds->started) {
         int coords[10];
@@ -3031,37 +3182,13 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
     mines = markers = 0;
     for (y = 0; y < ds->h; y++)
 	for (x = 0; x < ds->w; x++) {
-	    int v = state->grid[y*ds->w+x], cc = 0;
+	    int v = tile_value(state, ui, x, y), cc = 0;
 
 	    if (v == -1)
 		markers++;
 	    if (state->layout->mines && state->layout->mines[y*ds->w+x])
 		mines++;
 
-            if (v >= 0 && v <= 8) {
-                /*
-                 * Count up the flags around this tile, and if
-                 * there are too _many_, highlight the tile.
-                 */
-                int dx, dy, flags = 0;
-
-                for (dy = -1; dy <= +1; dy++)
-                    for (dx = -1; dx <= +1; dx++) {
-                        int nx = x+dx, ny = y+dy;
-                        if (nx >= 0 && nx < ds->w &&
-                            ny >= 0 && ny < ds->h &&
-                            state->grid[ny*ds->w+nx] == -1)
-                            flags++;
-                    }
-
-                if (flags > v)
-                    v |= 32;
-            }
-
-	    if ((v == -2 || v == -3) &&
-		(abs(x-ui->hx) <= ui->hradius && abs(y-ui->hy) <= ui->hradius))
-		v -= 20;
-
             if (cmoved && /* if cursor has moved, force redraw of curr and prev pos */
                 ((x == cx && y == cy) || (x == ds->cur_x && y == ds->cur_y)))
               cc = 1;
@@ -3160,11 +3287,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    encode_state, decode_state,
     PREFERRED_TILE_SIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    game_redraw_region,
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
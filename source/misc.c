@@ -220,10 +220,36 @@ void shuffle(void *array, int nelts, int eltsize, random_state *rs)
     char *carray = (char *)array;
     int i;
 
-    for (i = nelts; i-- > 1 ;) {
-        int j = random_upto(rs, i+1);
-        if (j != i)
-            memswap(carray + eltsize * i, carray + eltsize * j, eltsize);
+    /*
+     * Arrays of int-sized and single-byte elements are by far the
+     * commonest, so they get their own loops rather than going
+     * through memswap(). All three loops draw exactly the same
+     * random numbers.
+     */
+    if (eltsize == sizeof(int)) {
+        for (i = nelts; i-- > 1 ;) {
+            int j = random_upto(rs, i+1);
+            if (j != i) {
+                int tmp;
+                memcpy(&tmp, carray + sizeof(int) * i, sizeof(int));
+                memcpy(carray + sizeof(int) * i, carray + sizeof(int) * j,
+                       sizeof(int));
+                memcpy(carray + sizeof(int) * j, &tmp, sizeof(int));
+            }
+        }
+    } else if (eltsize == 1) {
+        for (i = nelts; i-- > 1 ;) {
+            int j = random_upto(rs, i+1);
+            char tmp = carray[i];
+            carray[i] = carray[j];
+            carray[j] = tmp;
+        }
+    } else {
+        for (i = nelts; i-- > 1 ;) {
+            int j = random_upto(rs, i+1);
+            if (j != i)
+                memswap(carray + eltsize * i, carray + eltsize * j, eltsize);
+        }
     }
 }
 
@@ -41,6 +41,10 @@
 #define D 0x08
 #define LOCKED 0x10
 #define ACTIVE 0x20
+/* Used only in game_drawstate.visible, to record how a tile was drawn */
+#define DRAWN_SRC 0x40
+#define DRAWN_CURSOR 0x80
+#define DRAWN_UNKNOWN (-1)	       /* not any combination of the above */
 
 /* Rotations: Anticlockwise, Clockwise, Flip, general rotate */
 #define A(x) ( (((x) & 0x07) << 1) | (((x) & 0x08) >> 3) )
@@ -96,12 +100,21 @@ struct game_params {
     float barrier_probability;
 };
 
+/*
+ * The barriers never change once a game has been set up, so all
+ * the states in a game share one copy of them.
+ */
+struct game_immutable_state {
+    int refcount;
+    unsigned char *barriers;
+};
+
 struct game_state {
     int width, height, wrapping, completed;
     int last_rotate_x, last_rotate_y, last_rotate_dir;
     int used_solve;
     unsigned char *tiles;
-    unsigned char *barriers;
+    struct game_immutable_state *imm;
 };
 
 #define OFFSETWH(x2,y2,x1,y1,dir,width,height) \
@@ -113,7 +126,7 @@ struct game_state {
 
 #define index(state, a, x, y) ( a[(y) * (state)->width + (x)] )
 #define tile(state, x, y)     index(state, (state)->tiles, x, y)
-#define barrier(state, x, y)  index(state, (state)->barriers, x, y)
+#define barrier(state, x, y)  index(state, (state)->imm->barriers, x, y)
 
 struct xyd {
     int x, y, direction;
@@ -1130,6 +1143,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
     tree234 *possibilities, *barriertree;
     int w, h, x, y, cx, cy, nbarriers;
     unsigned char *tiles, *barriers;
+    int *rots;
     char *desc, *p;
 
     w = params->width;
@@ -1140,6 +1154,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
 
     tiles = snewn(w * h, unsigned char);
     barriers = snewn(w * h, unsigned char);
+    rots = snewn(w * h, int);
 
     begin_generation:
 
@@ -1371,19 +1386,27 @@ static char *new_game_desc(game_params *params, random_state *rs,
     }
 
     /*
-     * Now compute a list of the possible barrier locations.
+     * Now compute a list of the possible barrier locations. We
+     * generate them in the order xyd_cmp sorts them into, so that
+     * the tree can be built in one go.
      */
-    barriertree = newtree234(xyd_cmp_nc);
-    for (y = 0; y < h; y++) {
-	for (x = 0; x < w; x++) {
+    {
+	void **blist = snewn(2 * w * h, void *);
+	int nb = 0;
 
-	    if (!(index(params, tiles, x, y) & R) &&
-                (params->wrapping || x < w-1))
-		add234(barriertree, new_xyd(x, y, R));
-	    if (!(index(params, tiles, x, y) & D) &&
-                (params->wrapping || y < h-1))
-		add234(barriertree, new_xyd(x, y, D));
+	for (x = 0; x < w; x++) {
+	    for (y = 0; y < h; y++) {
+
+		if (!(index(params, tiles, x, y) & R) &&
+		    (params->wrapping || x < w-1))
+		    blist[nb++] = new_xyd(x, y, R);
+		if (!(index(params, tiles, x, y) & D) &&
+		    (params->wrapping || y < h-1))
+		    blist[nb++] = new_xyd(x, y, D);
+	    }
 	}
+	barriertree = newtree234_from_sorted(xyd_cmp_nc, blist, nb);
+	sfree(blist);
     }
 
     /*
@@ -1426,10 +1449,11 @@ static char *new_game_desc(game_params *params, random_state *rs,
     while (1) {
         int mismatches;
 
+        random_upto_array(rs, 4, rots, w * h);
         for (y = 0; y < h; y++) {
             for (x = 0; x < w; x++) {
                 int orig = index(params, tiles, x, y);
-                int rot = random_upto(rs, 4);
+                int rot = index(params, rots, x, y);
                 index(params, tiles, x, y) = ROT(orig, rot);
             }
         }
@@ -1539,6 +1563,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
 
     sfree(tiles);
     sfree(barriers);
+    sfree(rots);
 
     return desc;
 }
@@ -1592,8 +1617,10 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
     state->completed = state->used_solve = FALSE;
     state->tiles = snewn(state->width * state->height, unsigned char);
     memset(state->tiles, 0, state->width * state->height);
-    state->barriers = snewn(state->width * state->height, unsigned char);
-    memset(state->barriers, 0, state->width * state->height);
+    state->imm = snew(struct game_immutable_state);
+    state->imm->refcount = 1;
+    state->imm->barriers = snewn(state->width * state->height, unsigned char);
+    memset(state->imm->barriers, 0, state->width * state->height);
 
     /*
      * Parse the game description into the grid.
@@ -1674,16 +1701,19 @@ static game_state *dup_game(game_state *state)
     ret->last_rotate_y = state->last_rotate_y;
     ret->tiles = snewn(state->width * state->height, unsigned char);
     memcpy(ret->tiles, state->tiles, state->width * state->height);
-    ret->barriers = snewn(state->width * state->height, unsigned char);
-    memcpy(ret->barriers, state->barriers, state->width * state->height);
+    ret->imm = state->imm;
+    ret->imm->refcount++;
 
     return ret;
 }
 
 static void free_game(game_state *state)
 {
+    if (--state->imm->refcount <= 0) {
+	sfree(state->imm->barriers);
+	sfree(state->imm);
+    }
     sfree(state->tiles);
-    sfree(state->barriers);
     sfree(state);
 }
 
@@ -1704,7 +1734,7 @@ static char *solve_game(game_state *state, game_state *currstate,
 	 */
 	memcpy(tiles, state->tiles, state->width * state->height);
 	net_solver(state->width, state->height, tiles,
-		   state->barriers, state->wrapping);
+		   state->imm->barriers, state->wrapping);
     } else {
         for (i = 0; i < state->width * state->height; i++) {
             int c = aux[i];
@@ -1914,7 +1944,8 @@ struct game_drawstate {
     int width, height;
     int org_x, org_y;
     int tilesize;
-    unsigned char *visible;
+    int *visible;
+    int status;			       /* completed/used_solve as last shown */
 };
 
 /* ----------------------------------------------------------------------
@@ -2287,14 +2318,17 @@ static game_state *execute_move(game_state *from, char *move)
 static game_drawstate *game_new_drawstate(drawing *dr, game_state *state)
 {
     game_drawstate *ds = snew(game_drawstate);
+    int i;
 
     ds->started = FALSE;
     ds->width = state->width;
     ds->height = state->height;
     ds->org_x = ds->org_y = -1;
-    ds->visible = snewn(state->width * state->height, unsigned char);
+    ds->status = -1;
+    ds->visible = snewn(state->width * state->height, int);
     ds->tilesize = 0;                  /* undecided yet */
-    memset(ds->visible, 0xFF, state->width * state->height);
+    for (i = 0; i < state->width * state->height; i++)
+        ds->visible[i] = DRAWN_UNKNOWN;
 
     return ds;
 }
@@ -2662,12 +2696,116 @@ static void draw_tile(drawing *dr, game_state *state, game_drawstate *ds,
     draw_update(dr, bx, by, TILE_SIZE+TILE_BORDER, TILE_SIZE+TILE_BORDER);
 }
 
+/*
+ * If we're part way through animating a single tile rotation, find
+ * the turning tile and its angle, and return the state the rest of
+ * the grid should be drawn from. Otherwise return `state' itself.
+ */
+static game_state *rotating_tile(game_state *oldstate, game_state *state,
+                                 int dir, float t, int *tx, int *ty,
+                                 float *angle)
+{
+    int last_rotate_dir;
+
+    *tx = *ty = -1;
+    *angle = 0.0;
+    last_rotate_dir = dir==-1 ? oldstate->last_rotate_dir :
+                                state->last_rotate_dir;
+    if (oldstate && (t < ROTATE_TIME) && last_rotate_dir) {
+        *tx = (dir==-1 ? oldstate->last_rotate_x : state->last_rotate_x);
+        *ty = (dir==-1 ? oldstate->last_rotate_y : state->last_rotate_y);
+        *angle = last_rotate_dir * dir * 90.0F * (t / ROTATE_TIME);
+        state = oldstate;
+    }
+    return state;
+}
+
+/*
+ * Work out how the tile at display position (x,y) should look, in
+ * the form kept in ds->visible.
+ */
+static int tile_appearance(game_drawstate *ds, game_state *state,
+                           game_ui *ui, unsigned char *active,
+                           int frame, int x, int y)
+{
+    int c = tile(state, GX(x), GY(y)) | index(state, active, GX(x), GY(y));
+
+    /*
+     * In a completion flash, we adjust the LOCKED bit
+     * depending on our distance from the centre point and
+     * the frame number.
+     */
+    if (frame >= 0) {
+        int rcx = RX(ui->cx), rcy = RY(ui->cy);
+        int xdist, ydist, dist;
+        xdist = (x < rcx ? rcx - x : x - rcx);
+        ydist = (y < rcy ? rcy - y : y - rcy);
+        dist = (xdist > ydist ? xdist : ydist);
+
+        if (frame >= dist && frame < dist+4) {
+            int lock = (frame - dist) & 1;
+            lock = lock ? LOCKED : 0;
+            c = (c &~ LOCKED) | lock;
+        }
+    }
+
+    if (GX(x) == ui->cx && GY(y) == ui->cy)
+        c |= DRAWN_SRC;
+    if (ui->cur_visible && GX(x) == ui->cur_x && GY(y) == ui->cur_y)
+        c |= DRAWN_CURSOR;
+
+    return c;
+}
+
+static int game_redraw_region(game_drawstate *ds, game_state *oldstate,
+                              game_state *state, int dir, game_ui *ui,
+                              float t, float ft,
+                              int *rx, int *ry, int *rw, int *rh)
+{
+    int x, y, tx, ty, frame;
+    int x0 = ds->width, y0 = ds->height, x1 = -1, y1 = -1;
+    unsigned char *active;
+    float angle;
+
+    state = rotating_tile(oldstate, state, dir, t, &tx, &ty, &angle);
+
+    if (!ds->started || ui->org_x != ds->org_x || ui->org_y != ds->org_y ||
+        ds->status != state->completed + 2 * state->used_solve) {
+        *rx = *ry = 0;
+        *rw = WINDOW_OFFSET * 2 + TILE_SIZE * state->width + TILE_BORDER;
+        *rh = WINDOW_OFFSET * 2 + TILE_SIZE * state->height + TILE_BORDER;
+        return TRUE;
+    }
+    frame = (ft > 0 ? (int)(ft / FLASH_FRAME) : -1);
+
+    /* This must agree exactly with the tile loop in game_redraw. */
+    active = compute_active(state, ui->cx, ui->cy);
+    for (x = 0; x < ds->width; x++)
+        for (y = 0; y < ds->height; y++)
+            if (index(state, ds->visible, x, y) !=
+                    tile_appearance(ds, state, ui, active, frame, x, y) ||
+                (GX(x) == tx && GY(y) == ty)) {
+                x0 = min(x0, x); x1 = max(x1, x);
+                y0 = min(y0, y); y1 = max(y1, y);
+            }
+    sfree(active);
+
+    if (x1 < 0)
+        return FALSE;
+
+    *rx = WINDOW_OFFSET + TILE_SIZE * x0;
+    *ry = WINDOW_OFFSET + TILE_SIZE * y0;
+    *rw = TILE_SIZE * (x1 - x0 + 1) + TILE_BORDER;
+    *rh = TILE_SIZE * (y1 - y0 + 1) + TILE_BORDER;
+    return TRUE;
+}
+
 static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
                  game_state *state, int dir, game_ui *ui, float t, float ft)
 {
-    int x, y, tx, ty, frame, last_rotate_dir, moved_origin = FALSE;
+    int x, y, tx, ty, frame, moved_origin = FALSE;
     unsigned char *active;
-    float angle = 0.0;
+    float angle;
 
     /*
      * Clear the screen, and draw the exterior barrier lines, if
@@ -2733,19 +2871,11 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
         }
     }
 
-    tx = ty = -1;
-    last_rotate_dir = dir==-1 ? oldstate->last_rotate_dir :
-                                state->last_rotate_dir;
-    if (oldstate && (t < ROTATE_TIME) && last_rotate_dir) {
-        /*
-         * We're animating a single tile rotation. Find the turning
-         * tile.
-         */
-        tx = (dir==-1 ? oldstate->last_rotate_x : state->last_rotate_x);
-        ty = (dir==-1 ? oldstate->last_rotate_y : state->last_rotate_y);
-        angle = last_rotate_dir * dir * 90.0F * (t / ROTATE_TIME);
-        state = oldstate;
-    }
+    /*
+     * If we're animating a single tile rotation, find the turning
+     * tile.
+     */
+    state = rotating_tile(oldstate, state, dir, t, &tx, &ty, &angle);
 
     frame = -1;
     if (ft > 0) {
@@ -2763,40 +2893,25 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
 
     for (x = 0; x < ds->width; x++)
         for (y = 0; y < ds->height; y++) {
-            unsigned char c = tile(state, GX(x), GY(y)) |
-                              index(state, active, GX(x), GY(y));
-            int is_src = GX(x) == ui->cx && GY(y) == ui->cy;
+            int c = tile_appearance(ds, state, ui, active, frame, x, y);
             int is_anim = GX(x) == tx && GY(y) == ty;
-            int is_cursor = ui->cur_visible &&
-                            GX(x) == ui->cur_x && GY(y) == ui->cur_y;
 
             /*
-             * In a completion flash, we adjust the LOCKED bit
-             * depending on our distance from the centre point and
-             * the frame number.
+             * Whether the tile is the source or under the cursor
+             * is recorded in ds->visible along with its contents,
+             * so neither needs redrawing unless it changes. A
+             * rotating tile is redrawn on every frame.
              */
-            if (frame >= 0) {
-                int rcx = RX(ui->cx), rcy = RY(ui->cy);
-                int xdist, ydist, dist;
-                xdist = (x < rcx ? rcx - x : x - rcx);
-                ydist = (y < rcy ? rcy - y : y - rcy);
-                dist = (xdist > ydist ? xdist : ydist);
-
-                if (frame >= dist && frame < dist+4) {
-                    int lock = (frame - dist) & 1;
-                    lock = lock ? LOCKED : 0;
-                    c = (c &~ LOCKED) | lock;
-                }
-            }
-
             if (moved_origin ||
                 index(state, ds->visible, x, y) != c ||
-                index(state, ds->visible, x, y) == 0xFF ||
-                is_src || is_anim || is_cursor) {
-                draw_tile(dr, state, ds, x, y, c,
-                          is_src, (is_anim ? angle : 0.0F), is_cursor);
-                if (is_src || is_anim || is_cursor)
-                    index(state, ds->visible, x, y) = 0xFF;
+                is_anim) {
+                draw_tile(dr, state, ds, x, y,
+                          c & ~(DRAWN_SRC | DRAWN_CURSOR),
+                          (c & DRAWN_SRC) != 0,
+                          (is_anim ? angle : 0.0F),
+                          (c & DRAWN_CURSOR) != 0);
+                if (is_anim)
+                    index(state, ds->visible, x, y) = DRAWN_UNKNOWN;
                 else
                     index(state, ds->visible, x, y) = c;
             }
@@ -2822,6 +2937,7 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
 		 state->completed ? "COMPLETED! " : ""), a, n2);
 
 	status_bar(dr, statusbuf);
+	ds->status = state->completed + 2 * state->used_solve;
     }
 
     sfree(active);
@@ -2896,15 +3012,17 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILE_SIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    game_redraw_region,
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    0,				       /* flags */
+    FAST_RANDOM,		       /* flags */
 };
@@ -514,19 +514,27 @@ static char *new_game_desc(game_params *params, random_state *rs,
     freetree234(possibilities);
 
     /*
-     * Now compute a list of the possible barrier locations.
+     * Now compute a list of the possible barrier locations. We
+     * generate them in the order xyd_cmp sorts them into, so that
+     * the tree can be built in one go.
      */
-    barriertree = newtree234(xyd_cmp);
-    for (y = 0; y < h; y++) {
-	for (x = 0; x < w; x++) {
+    {
+	void **blist = snewn(2 * w * h, void *);
+	int nb = 0;
 
-	    if (!(index(params, tiles, x, y) & R) &&
-                (params->wrapping || x < w-1))
-		add234(barriertree, new_xyd(x, y, R));
-	    if (!(index(params, tiles, x, y) & D) &&
-                (params->wrapping || y < h-1))
-		add234(barriertree, new_xyd(x, y, D));
+	for (x = 0; x < w; x++) {
+	    for (y = 0; y < h; y++) {
+
+		if (!(index(params, tiles, x, y) & R) &&
+		    (params->wrapping || x < w-1))
+		    blist[nb++] = new_xyd(x, y, R);
+		if (!(index(params, tiles, x, y) & D) &&
+		    (params->wrapping || y < h-1))
+		    blist[nb++] = new_xyd(x, y, D);
+	    }
 	}
+	barriertree = newtree234_from_sorted(xyd_cmp, blist, nb);
+	sfree(blist);
     }
 
     /*
@@ -1863,11 +1871,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILE_SIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    NULL,				       /* redraw_region */
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
@@ -38,6 +38,13 @@ int print_rgb_hatched_colour(drawing *dr, float r, float g, float b, int hatch)
 void print_line_width(drawing *dr, int width) {}
 void midend_supersede_game_desc(midend *me, char *desc, char *privdesc) {}
 void status_bar(drawing *dr, char *text) {}
+void game_completed() {}
+void get_random_seed(void **randseed, int *randseedsize)
+{
+    *randseed = snewn(1, char);
+    **(char **)randseed = 0;
+    *randseedsize = 1;
+}
 
 void fatal(char *fmt, ...)
 {
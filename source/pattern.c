@@ -44,11 +44,19 @@ struct game_params {
 #define GRID_FULL 1
 #define GRID_EMPTY 0
 
+/*
+ * The clues are fixed for the whole game, so all states share them.
+ */
+struct game_immutable_state {
+    int refcount;
+    int *rowdata, *rowlen;
+};
+
 struct game_state {
     int w, h;
     unsigned char *grid;
     int rowsize;
-    int *rowdata, *rowlen;
+    struct game_immutable_state *imm;
     int completed, cheated;
 };
 
@@ -610,18 +618,20 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
     memset(state->grid, GRID_UNKNOWN, state->w * state->h);
 
     state->rowsize = max(state->w, state->h);
-    state->rowdata = snewn(state->rowsize * (state->w + state->h), int);
-    state->rowlen = snewn(state->w + state->h, int);
+    state->imm = snew(struct game_immutable_state);
+    state->imm->refcount = 1;
+    state->imm->rowdata = snewn(state->rowsize * (state->w + state->h), int);
+    state->imm->rowlen = snewn(state->w + state->h, int);
 
     state->completed = state->cheated = FALSE;
 
     for (i = 0; i < params->w + params->h; i++) {
-        state->rowlen[i] = 0;
+        state->imm->rowlen[i] = 0;
         if (*desc && isdigit((unsigned char)*desc)) {
             do {
                 p = desc;
                 while (desc && isdigit((unsigned char)*desc)) desc++;
-                state->rowdata[state->rowsize * i + state->rowlen[i]++] =
+                state->imm->rowdata[state->rowsize * i + state->imm->rowlen[i]++] =
                     atoi(p);
             } while (*desc++ == '.');
         } else {
@@ -643,12 +653,8 @@ static game_state *dup_game(game_state *state)
     memcpy(ret->grid, state->grid, ret->w * ret->h);
 
     ret->rowsize = state->rowsize;
-    ret->rowdata = snewn(ret->rowsize * (ret->w + ret->h), int);
-    ret->rowlen = snewn(ret->w + ret->h, int);
-    memcpy(ret->rowdata, state->rowdata,
-           ret->rowsize * (ret->w + ret->h) * sizeof(int));
-    memcpy(ret->rowlen, state->rowlen,
-           (ret->w + ret->h) * sizeof(int));
+    ret->imm = state->imm;
+    ret->imm->refcount++;
 
     ret->completed = state->completed;
     ret->cheated = state->cheated;
@@ -658,8 +664,11 @@ static game_state *dup_game(game_state *state)
 
 static void free_game(game_state *state)
 {
-    sfree(state->rowdata);
-    sfree(state->rowlen);
+    if (--state->imm->refcount <= 0) {
+	sfree(state->imm->rowdata);
+	sfree(state->imm->rowlen);
+	sfree(state->imm);
+    }
     sfree(state->grid);
     sfree(state);
 }
@@ -691,15 +700,15 @@ static char *solve_game(game_state *state, game_state *currstate,
     do {
         done_any = 0;
         for (i=0; i<h; i++) {
-            memcpy(rowdata, state->rowdata + state->rowsize*(w+i),
+            memcpy(rowdata, state->imm->rowdata + state->rowsize*(w+i),
                    max*sizeof(int));
-            rowdata[state->rowlen[w+i]] = 0;
+            rowdata[state->imm->rowlen[w+i]] = 0;
             done_any |= do_row(workspace, workspace+max, workspace+2*max,
                                matrix+i*w, w, 1, rowdata);
         }
         for (i=0; i<w; i++) {
-            memcpy(rowdata, state->rowdata + state->rowsize*i, max*sizeof(int));
-            rowdata[state->rowlen[i]] = 0;
+            memcpy(rowdata, state->imm->rowdata + state->rowsize*i, max*sizeof(int));
+            rowdata[state->imm->rowlen[i]] = 0;
             done_any |= do_row(workspace, workspace+max, workspace+2*max,
                                matrix+i, h, w, rowdata);
         }
@@ -967,8 +976,8 @@ static game_state *execute_move(game_state *from, char *move)
 	    for (i=0; i<ret->w; i++) {
 		len = compute_rowdata(rowdata,
 				      ret->grid+i, ret->h, ret->w);
-		if (len != ret->rowlen[i] ||
-		    memcmp(ret->rowdata+i*ret->rowsize, rowdata,
+		if (len != ret->imm->rowlen[i] ||
+		    memcmp(ret->imm->rowdata+i*ret->rowsize, rowdata,
 			   len * sizeof(int))) {
 		    ret->completed = FALSE;
 		    break;
@@ -977,8 +986,8 @@ static game_state *execute_move(game_state *from, char *move)
 	    for (i=0; i<ret->h; i++) {
 		len = compute_rowdata(rowdata,
 				      ret->grid+i*ret->w, ret->w, 1);
-		if (len != ret->rowlen[i+ret->w] ||
-		    memcmp(ret->rowdata+(i+ret->w)*ret->rowsize, rowdata,
+		if (len != ret->imm->rowlen[i+ret->w] ||
+		    memcmp(ret->imm->rowdata+(i+ret->w)*ret->rowsize, rowdata,
 			   len * sizeof(int))) {
 		    ret->completed = FALSE;
 		    break;
@@ -1095,8 +1104,8 @@ static void draw_numbers(drawing *dr, game_drawstate *ds, game_state *state,
      * Draw the numbers.
      */
     for (i = 0; i < state->w + state->h; i++) {
-	int rowlen = state->rowlen[i];
-	int *rowdata = state->rowdata + state->rowsize * i;
+	int rowlen = state->imm->rowlen[i];
+	int *rowdata = state->imm->rowdata + state->rowsize * i;
 	int nfit;
 
 	/*
@@ -1270,11 +1279,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILE_SIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    NULL,				       /* redraw_region */
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
@@ -80,6 +80,8 @@ enum {
 #define REQUIRE_LARGE_SCREEN ( 1 << 12 )
 /* GP2X: Can't use cursor-key emulation */
 #define REQUIRE_MOUSE_INPUT ( 1 << 13 )
+/* New random seeds should use the fast generator (see random.c) */
+#define FAST_RANDOM ( 1 << 14 )
 /* end of `flags' word definitions */
 
 #ifdef _WIN32_WCE
@@ -106,6 +108,7 @@ typedef struct document document;
 typedef struct drawing_api drawing_api;
 typedef struct drawing drawing;
 typedef struct psdata psdata;
+typedef struct rdsf rdsf;
 
 #define ALIGN_VNORMAL 0x000
 #define ALIGN_VCENTRE 0x100
@@ -190,6 +193,8 @@ void draw_circle(drawing *dr, int cx, int cy, int radius,
                  int fillcolour, int outlinecolour);
 void clip(drawing *dr, int x, int y, int w, int h);
 void unclip(drawing *dr);
+void draw_restrict(drawing *dr, int x, int y, int w, int h);
+void draw_unrestrict(drawing *dr);
 void start_draw(drawing *dr);
 void draw_update(drawing *dr, int x, int y, int w, int h);
 void end_draw(drawing *dr);
@@ -264,6 +269,15 @@ char *midend_deserialise(midend *me,
 /* Printing functions supplied by the mid-end */
 char *midend_print_puzzle(midend *me, document *doc, int with_soln);
 int midend_tilesize(midend *me);
+unsigned long midend_undo_stats(midend *me, int *nheld, int *nevicted);
+void midend_redraw_stats(midend *me, int *made, int *avoided);
+enum { SELFTEST_OFF, SELFTEST_SAMPLED, SELFTEST_ALWAYS };
+void midend_set_selftest(midend *me, int policy, int one_in);
+char *midend_selftest(midend *me);
+void midend_set_journal(midend *me,
+                        void (*journal)(void *ctx, char *buf, int len),
+                        void *ctx);
+char *midend_replay_journal(midend *me, char *record, int len);
 
 /*
  * malloc.c
@@ -272,6 +286,11 @@ void *smalloc(size_t size);
 void *srealloc(void *p, size_t size);
 void sfree(void *p);
 char *dupstr(const char *s);
+/* Cumulative bytes requested so far; see malloc.c. */
+unsigned long smalloc_total(void);
+/* Print per-call-site allocation statistics to stdout, if malloc.c was
+ * built with PROFILE_ALLOC; otherwise does nothing. */
+void smalloc_report(void);
 #define snew(type) \
     ( (type *) smalloc (sizeof (type)) )
 #define snewn(number, type) \
@@ -279,6 +298,28 @@ char *dupstr(const char *s);
 #define sresize(array, number, type) \
     ( (type *) srealloc ((array), (number) * sizeof (type)) )
 
+/*
+ * Arena allocation, for scratch space with a well-defined lifetime.
+ * Take a mark with arena_getmark(), allocate freely, then
+ * arena_release() back to the mark to discard everything allocated
+ * since in one go. Marks must be released in LIFO order. Memory from
+ * an arena must never be passed to sfree() or srealloc().
+ */
+typedef struct arena arena;
+typedef struct arena_mark {
+    struct arena_chunk *chunk;
+    size_t used;
+} arena_mark;
+arena *arena_new(void);
+void arena_free(arena *a);
+void *arena_alloc(arena *a, size_t size);
+arena_mark arena_getmark(arena *a);
+void arena_release(arena *a, arena_mark mark);
+#define anew(a, type) \
+    ( (type *) arena_alloc ((a), sizeof (type)) )
+#define anewn(a, number, type) \
+    ( (type *) arena_alloc ((a), (number) * sizeof (type)) )
+
 /*
  * misc.c
  */
@@ -341,6 +382,22 @@ void edsf_merge(int *dsf, int v1, int v2, int inverse);
 void dsf_merge(int *dsf, int v1, int v2);
 void dsf_init(int *dsf, int len);
 
+/* Fill in canon[i] (and inverse[i], if 'inverse' is non-NULL) for every
+ * element of the dsf at once, flattening the forest as it goes. */
+void edsf_canonify_all(int *dsf, int size, int *canon, int *inverse);
+
+/* A resettable dsf: the same operations as above, but rdsf_reset() puts
+ * every element back in a class of its own in constant time, which suits
+ * solvers that are rerun many times on the same scratch space. */
+rdsf *rdsf_new(int size);
+void rdsf_free(rdsf *r);
+void rdsf_reset(rdsf *r);
+int erdsf_canonify(rdsf *r, int val, int *inverse);
+int rdsf_canonify(rdsf *r, int val);
+int rdsf_size(rdsf *r, int val);
+void erdsf_merge(rdsf *r, int v1, int v2, int inverse);
+void rdsf_merge(rdsf *r, int v1, int v2);
+
 /*
  * version.c
  */
@@ -349,10 +406,14 @@ extern char ver[];
 /*
  * random.c
  */
+/* Seed strings starting with this character use the fast generator. */
+#define RANDOM_FAST_PREFIX '~'
 random_state *random_new(char *seed, int len);
 random_state *random_copy(random_state *tocopy);
 unsigned long random_bits(random_state *state, int bits);
 unsigned long random_upto(random_state *state, unsigned long limit);
+void random_upto_array(random_state *state, unsigned long limit,
+		       int *out, int n);
 void random_free(random_state *state);
 char *random_state_encode(random_state *state);
 random_state *random_state_decode(char *input);
@@ -453,6 +514,8 @@ struct game {
     char *(*interpret_move)(game_state *state, game_ui *ui, game_drawstate *ds,
 			    int x, int y, int button);
     game_state *(*execute_move)(game_state *state, char *move);
+    char *(*encode_state)(game_state *state);
+    game_state *(*decode_state)(game_state *initial, char *encoding);
     int preferred_tilesize;
     void (*compute_size)(game_params *params, int tilesize, int *x, int *y);
     void (*set_size)(drawing *dr, game_drawstate *ds,
@@ -463,6 +526,10 @@ struct game {
     void (*redraw)(drawing *dr, game_drawstate *ds, game_state *oldstate,
 		   game_state *newstate, int dir, game_ui *ui, float anim_time,
 		   float flash_time);
+    int (*redraw_region)(game_drawstate *ds, game_state *oldstate,
+			 game_state *newstate, int dir, game_ui *ui,
+			 float anim_time, float flash_time,
+			 int *x, int *y, int *w, int *h);
     float (*anim_length)(game_state *oldstate, game_state *newstate, int dir,
 			 game_ui *ui);
     float (*flash_length)(game_state *oldstate, game_state *newstate, int dir,
@@ -8,6 +8,14 @@
  * The generator is based on SHA-1. This is almost certainly
  * overkill, but I had the SHA-1 code kicking around and it was
  * easier to reuse it than to do anything else!
+ *
+ * Since SHA-1 turned out to be a sizeable fraction of the time
+ * taken by some generators, there's also a fast mode, used for any
+ * seed string beginning with RANDOM_FAST_PREFIX. The seed is still
+ * hashed with SHA-1, but the output is then streamed from
+ * xoshiro128**, which costs a handful of instructions per 32 bits.
+ * Seeds without the prefix produce exactly the same stream as they
+ * always did.
  */
 
 #include <assert.h>
@@ -201,18 +209,63 @@ void SHA_Simple(void *p, int len, unsigned char *output)
  * The random number generator.
  */
 
+enum { RANDOM_SHA1, RANDOM_XOSHIRO };
+
 struct random_state {
+    int version;		       /* RANDOM_SHA1 or RANDOM_XOSHIRO */
     unsigned char seedbuf[40];
     unsigned char databuf[20];
     int pos;
+    uint32 xs[4];		       /* xoshiro128** state */
 };
 
+#define U32(x) ( (uint32)(x) & 0xFFFFFFFFUL )
+#define rol32(x,y) ( U32((x) << (y)) | (U32(x) >> (32-(y))) )
+
+static uint32 xoshiro_next(random_state *state)
+{
+    uint32 *s = state->xs;
+    uint32 ret = U32(rol32(U32(s[1] * 5), 7) * 9);
+    uint32 t = U32(s[1] << 9);
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rol32(s[3], 11);
+
+    return ret;
+}
+
 random_state *random_new(char *seed, int len)
 {
     random_state *state;
 
     state = snew(random_state);
 
+    if (len > 0 && seed[0] == RANDOM_FAST_PREFIX) {
+	unsigned char digest[20];
+	int i;
+
+	/*
+	 * Hash the whole seed string (prefix included) and use the
+	 * first 128 bits of the digest as the xoshiro state. The
+	 * all-zero state is a fixed point, so avoid it, however
+	 * unlikely.
+	 */
+	SHA_Simple(seed, len, digest);
+	for (i = 0; i < 4; i++)
+	    state->xs[i] = ((uint32)digest[4*i] << 24) |
+		((uint32)digest[4*i+1] << 16) |
+		((uint32)digest[4*i+2] << 8) | (uint32)digest[4*i+3];
+	if (!(state->xs[0] | state->xs[1] | state->xs[2] | state->xs[3]))
+	    state->xs[0] = 1;
+	state->version = RANDOM_XOSHIRO;
+	return state;
+    }
+
+    state->version = RANDOM_SHA1;
     SHA_Simple(seed, len, state->seedbuf);
     SHA_Simple(state->seedbuf, 20, state->seedbuf + 20);
     SHA_Simple(state->seedbuf, 40, state->databuf);
@@ -225,9 +278,7 @@ random_state *random_copy(random_state *tocopy)
 {
     random_state *result;
     result = snew(random_state);
-    memcpy(result->seedbuf, tocopy->seedbuf, sizeof(result->seedbuf));
-    memcpy(result->databuf, tocopy->databuf, sizeof(result->databuf));
-    result->pos = tocopy->pos;
+    *result = *tocopy;
     return result;
 }
 
@@ -236,6 +287,15 @@ unsigned long random_bits(random_state *state, int bits)
     unsigned long ret = 0;
     int n;
 
+    if (state->version == RANDOM_XOSHIRO) {
+	/*
+	 * Take the top bits of each output word, which are the
+	 * best-mixed ones.
+	 */
+	assert(bits > 0 && bits <= 32);
+	return xoshiro_next(state) >> (32 - bits);
+    }
+
     for (n = 0; n < bits; n += 8) {
 	if (state->pos >= 20) {
 	    int i;
@@ -263,10 +323,15 @@ unsigned long random_bits(random_state *state, int bits)
     return ret;
 }
 
-unsigned long random_upto(random_state *state, unsigned long limit)
+/*
+ * Work out how random_upto() should sample a number below `limit':
+ * draw `bits' random bits, reject anything at or above `max', and
+ * divide the rest by `divisor'. Returns `bits'.
+ */
+static int random_upto_setup(unsigned long limit, unsigned long *max,
+			     unsigned long *divisor)
 {
     int bits = 0;
-    unsigned long max, divisor, data;
 
     while ((limit >> bits) != 0)
 	bits++;
@@ -274,9 +339,19 @@ unsigned long random_upto(random_state *state, unsigned long limit)
     bits += 3;
     assert(bits < 32);
 
-    max = 1L << bits;
-    divisor = max / limit;
-    max = limit * divisor;
+    *max = 1L << bits;
+    *divisor = *max / limit;
+    *max = limit * *divisor;
+
+    return bits;
+}
+
+unsigned long random_upto(random_state *state, unsigned long limit)
+{
+    int bits;
+    unsigned long max, divisor, data;
+
+    bits = random_upto_setup(limit, &max, &divisor);
 
     do {
 	data = random_bits(state, bits);
@@ -285,6 +360,39 @@ unsigned long random_upto(random_state *state, unsigned long limit)
     return data / divisor;
 }
 
+/*
+ * Fill in `n' numbers below `limit', giving exactly the same
+ * results (and leaving the state exactly as) `n' successive calls
+ * to random_upto() would, so that callers can switch to it without
+ * changing what any existing seed generates. The rejection bounds
+ * are only computed once, and in fast mode the generator is run
+ * inline rather than through random_bits().
+ */
+void random_upto_array(random_state *state, unsigned long limit,
+		       int *out, int n)
+{
+    int bits, i;
+    unsigned long max, divisor, data;
+
+    bits = random_upto_setup(limit, &max, &divisor);
+
+    if (state->version == RANDOM_XOSHIRO) {
+	for (i = 0; i < n; i++) {
+	    do {
+		data = xoshiro_next(state) >> (32 - bits);
+	    } while (data >= max);
+	    out[i] = (int)(data / divisor);
+	}
+    } else {
+	for (i = 0; i < n; i++) {
+	    do {
+		data = random_bits(state, bits);
+	    } while (data >= max);
+	    out[i] = (int)(data / divisor);
+	}
+    }
+}
+
 void random_free(random_state *state)
 {
     sfree(state);
@@ -295,6 +403,13 @@ char *random_state_encode(random_state *state)
     char retbuf[256];
     int len = 0, i;
 
+    if (state->version == RANDOM_XOSHIRO) {
+	len += sprintf(retbuf+len, "%c", RANDOM_FAST_PREFIX);
+	for (i = 0; i < 4; i++)
+	    len += sprintf(retbuf+len, "%08lx", (unsigned long)state->xs[i]);
+	return dupstr(retbuf);
+    }
+
     for (i = 0; i < lenof(state->seedbuf); i++)
 	len += sprintf(retbuf+len, "%02x", state->seedbuf[i]);
     for (i = 0; i < lenof(state->databuf); i++)
@@ -311,6 +426,25 @@ random_state *random_state_decode(char *input)
 
     state = snew(random_state);
 
+    if (*input == RANDOM_FAST_PREFIX) {
+	int i;
+
+	input++;
+	state->version = RANDOM_XOSHIRO;
+	for (i = 0; i < 4; i++) {
+	    unsigned long v = 0;
+	    if (sscanf(input, "%8lx", &v) == 1 && strlen(input) >= 8)
+		input += 8;
+	    else
+		input += strlen(input);
+	    state->xs[i] = U32(v);
+	}
+	if (!(state->xs[0] | state->xs[1] | state->xs[2] | state->xs[3]))
+	    state->xs[0] = 1;
+	return state;
+    }
+
+    state->version = RANDOM_SHA1;
     memset(state->seedbuf, 0, sizeof(state->seedbuf));
     memset(state->databuf, 0, sizeof(state->databuf));
     state->pos = 0;
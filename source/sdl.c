@@ -14,6 +14,7 @@
 // #define DEBUG_TIMER         // Timers, etc.
 // #define DEBUG_MISC          // Config options, etc.
 // #define DEBUG_FUNCTIONS     // Function calls
+// #define DEBUG_REDRAWS       // Game redraws made and avoided, once a second
 
 //#define SCALELARGESCREEN
 #define BACKGROUND_MUSIC
@@ -83,7 +84,7 @@ typedef unsigned int uint;
 #include <sys/time.h>
 #include <sys/types.h>     // For readdir()
 #include <dirent.h>        // For readdir()
-#include <unistd.h>        // For sync() call.
+#include <unistd.h>        // For fsync() call.
 
 // Puzzle collection include
 // =========================
@@ -170,6 +171,10 @@ enum { RUN_GAME_TIMER_LOOP, RUN_MOUSE_TIMER_LOOP, RUN_SECOND_TIMER_LOOP};
 // Number of seconds that a statusbar message should stay on the screen.
 #define STATUSBAR_TIMEOUT (3)
 
+// Number of seconds without further changes before changed configuration is
+// written back to disk.
+#define CONFIG_WRITEBACK_DELAY (3)
+
 #define ANIMATION_DELAY          (200) // Interval in milliseconds for the delay
                                        // between frames in the loading animation.
 
@@ -434,10 +439,11 @@ struct frontend
     struct config_window_option *config_window_options;
 					// The games configuration options, with extra information
 					// used for determining the position on screen.
-    dictionary *ini_dict;		// In-memory INI "dictionary"
     char* sanitised_game_name;          // A copy of the game name suitable for use in filenames
     uint first_preset_showing;          // The preset currently at the top of the preset menu.
     struct timeval last_statusbar_update;		// Last time the status bar was updated.    
+    FILE *journal;			// Autosave journal, open for appending
+    uint journal_needs_base;		// True if the autosave no longer matches the game
 };
 
 struct button_status *bs;
@@ -607,12 +613,6 @@ void cleanup(frontend *fe)
 #endif
     printf("Cleaning up...\n");
 
-    if(fe->ini_dict != NULL)
-    {
-        iniparser_freedict(fe->ini_dict);
-        fe->ini_dict=NULL;
-    };
-
     if(fe->sanitised_game_name != NULL)
         sfree(fe->sanitised_game_name);
 
@@ -622,6 +622,8 @@ void cleanup(frontend *fe)
         fe->me=NULL;
     };
 
+    journal_close(fe);
+
     if(fe->sdlcolours != NULL)
         sfree(fe->sdlcolours);
 
@@ -659,6 +661,9 @@ void cleanup_and_exit(frontend *fe, int return_value)
     sfree(loading_flag);
     if(loading_screen != NULL)
         SDL_FreeSurface(loading_screen);
+    // Write back any configuration changes still waiting for the timer.
+    ini_store_flush(NULL, TRUE);
+    ini_store_free();
     cleanup(fe);
     sfree(fe);
     DestroyMemPool();
@@ -1745,7 +1750,6 @@ static frontend *new_window(char *arg, int argtype, char **error)
     memset(fe, 0, sizeof(struct frontend));
 
     // Probably redundant now because of the memset.
-    fe->ini_dict=NULL;
     fe->cfg=NULL;
     fe->config_window_options=NULL;
 
@@ -2245,6 +2249,10 @@ void game_pause(frontend *fe)
 #ifdef DEBUG_MISC
         printf("Game paused.\n");
 #endif
+        // Dump allocation statistics if asked to (only does anything if malloc.c was built with
+        // PROFILE_ALLOC).  Off by default so that a profiling build doesn't spam the console.
+        if(getenv("STPPC2X_ALLOC_REPORT"))
+            smalloc_report();
         draw_menu(fe, GAMEMENU);
     }
     else
@@ -2263,14 +2271,13 @@ void game_quit()
     printf("game_quit()\n");
 #endif
 
+    // Write back any configuration changes still waiting for the timer.  This
+    // runs from atexit(), so it catches the plain exit() calls too.
+    ini_store_flush(NULL, TRUE);
+
     // Turn the cursor off to stop it lingering after program exit (e.g. in the GP2X menu)
     SDL_ShowCursor(SDL_DISABLE);
 
-    // Flush all files to disk (just in case).
-#ifndef WIN32    
-    sync();
-#endif
-
     // We *could* also run the menu again, but it's preferable for this program to just
     // terminate.  This way, GMenu2x etc. users don't get thrown back into the GP2X menu
     // and GP2X menu users can use a basic wrapper script to run the game and then re-execute 
@@ -2651,6 +2658,23 @@ void Main_SDL_Loop(void *handle)
                                     clear_statusbar(fe);
                                 if(debounce_start_button > 0)
                                     debounce_start_button--;
+
+                                // Check the solution of any newly generated game.
+                                run_selftest(fe);
+
+                                // Write back any configuration that has stopped changing.
+                                ini_store_flush(fe, FALSE);
+
+#ifdef DEBUG_REDRAWS
+                                // Report how many redraws the game's redraw_region hook saved us.
+                                if(fe->me != NULL)
+                                {
+                                    int redraws_made, redraws_avoided;
+                                    midend_redraw_stats(fe->me, &redraws_made, &redraws_avoided);
+                                    if(redraws_made || redraws_avoided)
+                                        printf("Redraws in the last second: %d made, %d avoided.\n", redraws_made, redraws_avoided);
+                                };
+#endif
 	                        break; // switch( event.user.code ) case RUN_SECOND_TIMER_LOOP
 
                         }; // switch( event.user.code)
@@ -4177,6 +4201,179 @@ char* sanitise_game_name(char *unclean_game_name)
     return(game_name);
 };
 
+// The configuration store
+// =======================
+// Each INI file is parsed the first time it is wanted and then kept in memory
+// for the rest of the session, so that starting a game or opening a menu
+// never has to go back to the SD card.  Saving a configuration only changes
+// the copy in memory and marks it dirty.  Dirty files are written back by the
+// once-a-second timer when they have not changed for CONFIG_WRITEBACK_DELAY
+// seconds, and unconditionally on exit, so a burst of changes costs a single
+// write.  Like savefiles, INI files are written under a temporary name and
+// then renamed over the old one, so a crash or power loss part-way through
+// never leaves a truncated INI file behind.
+
+struct ini_store_entry
+{
+    char *filename;			// Full path of the INI file
+    dictionary *dict;			// In-memory INI "dictionary"
+    uint present;			// True if the file was parsed or has been saved to since
+    uint dirty;				// True if the file on disk is out of date
+    uint write_failed;			// True if the last write-back failed
+    struct timeval last_change;		// When the dictionary was last changed
+};
+
+// Entries are allocated individually, so that pointers to them stay valid
+// as the store grows.
+struct ini_store_entry **ini_store=NULL;
+uint ini_store_count=0;
+
+// Find the in-memory copy of an INI file, loading it if this is the first
+// time it has been asked for.  A missing or unparseable file gives an empty
+// dictionary, so that there is something to save into.
+struct ini_store_entry *ini_store_find(char *filename)
+{
+    struct ini_store_entry *entry;
+    uint i;
+
+    for(i=0;i<ini_store_count;i++)
+    {
+        if(!strcmp(ini_store[i]->filename, filename))
+            return(ini_store[i]);
+    };
+
+    entry=snew(struct ini_store_entry);
+    ini_store=sresize(ini_store, ini_store_count+1, struct ini_store_entry *);
+    ini_store[ini_store_count++]=entry;
+    entry->filename=dupstr(filename);
+    entry->dict=iniparser_load(filename);
+    entry->present=(entry->dict!=NULL);
+    entry->dirty=FALSE;
+    entry->write_failed=FALSE;
+
+    // If we didn't succeed
+    if(entry->dict==NULL)
+    {
+#ifdef DEBUG_FILE_ACCESS
+        printf("Cannot parse INI file: %s\n", filename);
+#endif
+        // Allocate an empty INI structure, just to make the thing work.
+        entry->dict=dictionary_new(0);
+    };
+
+    return(entry);
+};
+
+// Note that an INI dictionary has been changed and needs writing back.
+void ini_store_changed(struct ini_store_entry *entry)
+{
+    entry->present=TRUE;
+    entry->dirty=TRUE;
+    gettimeofday(&entry->last_change, NULL);
+};
+
+// Write one INI dictionary back to disk.  Returns TRUE on success.
+uint ini_store_write(struct ini_store_entry *entry)
+{
+#ifdef DEBUG_FUNCTIONS
+    printf("ini_store_write()\n");
+#endif
+    char *temp_filename;
+    FILE *inifile;
+    uint result;
+
+    temp_filename=snewn(strlen(entry->filename) + 5, char);
+    sprintf(temp_filename, "%s.tmp", entry->filename);
+
+#ifdef DEBUG_FILE_ACCESS
+    printf("INI: Attempting to open %s for writing.\n", temp_filename);
+#endif
+    inifile = fopen(temp_filename, "w");
+    if(!inifile)
+    {
+#ifdef DEBUG_FILE_ACCESS
+        printf("INI: Error opening %s for writing.\n", temp_filename);
+#endif
+        sfree(temp_filename);
+        return(FALSE);
+    };
+
+    // Write the in-memory INI "dictionary" to disk as an INI file.
+    iniparser_dump_ini(entry->dict, inifile);
+
+    // Make sure the new contents are on disk before they replace the old.
+    flush_file_to_disk(inifile);
+    result = !ferror(inifile);
+    if(fclose(inifile) != 0)
+        result = FALSE;
+
+    if(result)
+        result = (rename(temp_filename, entry->filename) == 0);
+    if(!result)
+        remove(temp_filename);
+
+#ifdef DEBUG_FILE_ACCESS
+    if(result)
+        printf("INI: %s written to disk.\n", entry->filename);
+    else
+        printf("INI: Error writing %s.\n", entry->filename);
+#endif
+    sfree(temp_filename);
+
+    if(result)
+        entry->dirty=FALSE;
+    entry->write_failed=!result;
+    return(result);
+};
+
+// Write back every dirty INI dictionary that has not changed for
+// CONFIG_WRITEBACK_DELAY seconds, or every dirty one if force is set.
+// Failures are reported on the statusbar if fe is not NULL, and retried
+// after another delay.
+void ini_store_flush(frontend *fe, uint force)
+{
+    struct timeval now;
+    float elapsed;
+    uint i;
+
+    gettimeofday(&now, NULL);
+    for(i=0;i<ini_store_count;i++)
+    {
+        if(!ini_store[i]->dirty)
+            continue;
+
+        elapsed = ((now.tv_usec - ini_store[i]->last_change.tv_usec) * 0.000001F + (now.tv_sec - ini_store[i]->last_change.tv_sec));
+        if(!force && (elapsed < CONFIG_WRITEBACK_DELAY))
+            continue;
+
+        if(!ini_store_write(ini_store[i]))
+        {
+            printf("Configuration could not be written to %s\n", ini_store[i]->filename);
+            if(fe != NULL)
+                sdl_status_bar(fe, "Config could not be saved.");
+            ini_store[i]->last_change=now;
+        };
+    };
+};
+
+// Free the configuration store.  Anything still dirty is lost, so flush first.
+// (game_quit also flushes, for the exit() calls that bypass cleanup_and_exit.)
+void ini_store_free()
+{
+    uint i;
+
+    for(i=0;i<ini_store_count;i++)
+    {
+        iniparser_freedict(ini_store[i]->dict);
+        sfree(ini_store[i]->filename);
+        sfree(ini_store[i]);
+    };
+    if(ini_store != NULL)
+        sfree(ini_store);
+    ini_store=NULL;
+    ini_store_count=0;
+};
+
 // Load a game configuration from the game's INI file.
 int load_config_from_INI(frontend *fe)
 {
@@ -4190,6 +4387,7 @@ int load_config_from_INI(frontend *fe)
     int boolean_value;
     int int_value;
     int j=0;
+    struct ini_store_entry *ini;
 
     // Dynamically allocate space for a filename and add .ini to the end of the 
     // sanitised game name to get the filename we will use.
@@ -4202,27 +4400,15 @@ int load_config_from_INI(frontend *fe)
     printf("Attempting to load game INI file: %s\n",filename);
 #endif
 
-    // If we have an INI file already loaded into RAM
-    if(fe->ini_dict)
-    {
-        // Free it.
-        iniparser_freedict(fe->ini_dict);
-        fe->ini_dict=NULL;
-    };
-
-    // Load the INI file into an in-memory structure.
-    fe->ini_dict=iniparser_load(filename);
+    // Find the INI file in the configuration store.
+    ini=ini_store_find(filename);
 
-    // If we didn't succeed
-    if(fe->ini_dict==NULL)
+    // If there isn't one
+    if(!ini->present)
     {
 #ifdef DEBUG_FILE_ACCESS
-        printf("Cannot parse INI file: %s\nReverting to game defaults.\n", filename);
+        printf("No configuration in INI file: %s\nReverting to game defaults.\n", filename);
 #endif
-        // Allocate an empty INI structure, just to make the thing work.
-        // This way, if the user saves, we have something to populate and then save.
-        fe->ini_dict=dictionary_new(0);
-        
         // Free the dynamically-allocated filename
         sfree(filename);
         return(FALSE);
@@ -4230,7 +4416,7 @@ int load_config_from_INI(frontend *fe)
     else
     {
 #ifdef DEBUG_FILE_ACCESS
-        printf("INI file successfully parsed: %s\n", filename);
+        printf("INI file found in configuration store: %s\n", filename);
 #else
         printf("Configuration loaded from %s\n", filename);
 #endif
@@ -4256,7 +4442,7 @@ int load_config_from_INI(frontend *fe)
 
                 // Copy the value read into our string (we can't play with the result
                 // directly because it goes into a dictionary structure).
-                strncpy(string_value,iniparser_getstring(fe->ini_dict, keyword_name, "\n"),250);
+                strncpy(string_value,iniparser_getstring(ini->dict, keyword_name, "\n"),250);
 
                 // Populate the configuration value with the read string.
 		fe->cfg[j].sval=string_value;
@@ -4267,7 +4453,7 @@ int load_config_from_INI(frontend *fe)
 
             case C_BOOLEAN:
                 // Read a boolean value from the INI file, return -1 if not found.
-                boolean_value=iniparser_getboolean(fe->ini_dict, keyword_name,-1);
+                boolean_value=iniparser_getboolean(ini->dict, keyword_name,-1);
 		if(boolean_value==-1)
                 {
                     // Do nothing.  The INI key was not found, and specifying any particular
@@ -4288,7 +4474,7 @@ int load_config_from_INI(frontend *fe)
                 // from the choices available, which is stored in the INI file under 
                 // the key "<configuration_item_name>.default".  Return -1 if not found.
                 strcat(keyword_name,".default");
-                int_value=iniparser_getint(fe->ini_dict, keyword_name,-1);
+                int_value=iniparser_getint(ini->dict, keyword_name,-1);
 		if(int_value==-1)
                 {
                     // Do nothing.  The INI value was not found, and specifying any particular
@@ -4345,6 +4531,7 @@ void load_global_config_from_INI()
 
     int boolean_value;
     int int_value;
+    struct ini_store_entry *global_ini;
     dictionary *global_ini_dict;
     int i;
 
@@ -4358,17 +4545,16 @@ void load_global_config_from_INI()
 #endif
 
 
-    // Load the INI file into an in-memory structure.
-    global_ini_dict=iniparser_load(filename);
+    // Load the INI file into the configuration store.
+    global_ini=ini_store_find(filename);
+    global_ini_dict=global_ini->dict;
 
     // If we didn't succeed
-    if(global_ini_dict==NULL)
+    if(!global_ini->present)
     {
 #ifdef DEBUG_FILE_ACCESS
         printf("Cannot parse INI file: %s\nReverting to global defaults.\n", filename);
 #endif
-        // Allocate an empty INI structure, just to make the thing work.
-        global_ini_dict=dictionary_new(0);
     }
     else
     {
@@ -4498,8 +4684,6 @@ void load_global_config_from_INI()
         };
         sfree(track_number_as_string);
     };
-
-    iniparser_freedict(global_ini_dict);
 };
 
 uint save_global_config_to_INI(uint save_music_config)
@@ -4508,7 +4692,7 @@ uint save_global_config_to_INI(uint save_music_config)
     printf("save_global_config_to_INI()\n");
 #endif
 
-    FILE *inifile;
+    struct ini_store_entry *global_ini;
     dictionary *global_ini_dict;
     int i;
     char *writeable_folder = generate_writeable_folder();
@@ -4520,18 +4704,10 @@ uint save_global_config_to_INI(uint save_music_config)
     printf("Attempting to save global INI file: %s\n",filename);
 #endif
 
-    // Load the INI file into an in-memory structure.
-    global_ini_dict=iniparser_load(filename);
-
-    // If we didn't succeed
-    if(global_ini_dict==NULL)
-    {
-#ifdef DEBUG_FILE_ACCESS
-        printf("Cannot parse INI file: %s\n", filename);
-#endif
-        // Allocate an empty INI structure, just to make the thing work.
-        global_ini_dict=dictionary_new(0);
-    };
+    // Find the INI file in the configuration store.
+    global_ini=ini_store_find(filename);
+    global_ini_dict=global_ini->dict;
+    sfree(filename);
 
     // Create an INI section, in case one does not already exist.
     // If we don't do this, INIParser tends not to write entries under that
@@ -4564,57 +4740,71 @@ uint save_global_config_to_INI(uint save_music_config)
         };
     };
 
-#ifdef DEBUG_FILE_ACCESS
-    printf("INI: Attempting to open %s for writing.\n", filename);
-#endif
-    
-    // Open the INI file for writing.
-    inifile = fopen(filename, "w");
-    // If we succeeded
-    if(inifile)
-    {
-#ifdef DEBUG_FILE_ACCESS
-        printf("INI: %s opened successfully for writing.\n", filename);
-#endif
-        // Write the in-memory INI "dictionary" to disk as an INI file.
-        iniparser_dump_ini(global_ini_dict,inifile);
+    // The file itself is written back later, by ini_store_flush(), which
+    // reports any failure on the statusbar.  If the last write-back of this
+    // file already failed, this one will too, so say so now.
+    ini_store_changed(global_ini);
+    return(!global_ini->write_failed);
+};
 
-        // Flush the data straight to disk.
-        fflush(inifile);
 
-        // Close the file
-        fclose(inifile);
-#ifdef DEBUG_FILE_ACCESS
-        printf("INI: %s written to disk.\n", filename);
+// A savefile held entirely in memory.  We read the whole file in one go and
+// then hand it to the midend from here, rather than making a stdio call for
+// every few bytes of every record.
+struct savefile_buffer {
+    char *data;
+    int len, pos;
+};
+
+// Read the whole of a savefile into memory.  Returns NULL if it can't be read.
+struct savefile_buffer *savefile_load(char *filename)
+{
+#ifdef DEBUG_FUNCTIONS
+    printf("savefile_load()\n");
 #endif
-        sfree(filename);
-        return(TRUE);
-    }
-    else
+    struct savefile_buffer *sb;
+    FILE *fp;
+    long size;
+
+    // Open the file, readonly
+    fp = fopen(filename, "rb");
+    if (!fp)
+        return(NULL);
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < 0)
     {
-#ifdef DEBUG_FILE_ACCESS
-        printf("INI: Error opening %s for writing.\n", filename);
-#endif
-        sfree(filename);
-        return(FALSE);
+        fclose(fp);
+        return(NULL);
     };
-    iniparser_freedict(global_ini_dict);
-    sfree(filename);
+
+    sb=snew(struct savefile_buffer);
+    sb->data=snewn(size + 1, char);
+    sb->len=fread(sb->data, 1, size, fp);
+    sb->pos=0;
+    fclose(fp);
+    return(sb);
 };
 
+void savefile_free(struct savefile_buffer *sb)
+{
+    sfree(sb->data);
+    sfree(sb);
+};
 
-// Callback function used by the midend to read a game from an actual file.
+// Callback function used by the midend to read a game from a loaded savefile.
 // This is called many times by the midend itself to read individual lines of a savefile
 int savefile_read(void *wctx, void *buf, int len)
 {
-#ifdef DEBUG_FUNCTIONS
-    printf("savefile_read()\n");
-#endif
-    FILE *fp = (FILE *)wctx;
-    int ret;
+    struct savefile_buffer *sb = (struct savefile_buffer *)wctx;
 
-    ret = fread(buf, 1, len, fp);
-    return (ret == len);
+    if (len > sb->len - sb->pos)
+        return(FALSE);
+    memcpy(buf, sb->data + sb->pos, len);
+    sb->pos += len;
+    return(TRUE);
 };
 
 uint file_exists(char *filename)
@@ -4700,12 +4890,12 @@ void load_game(frontend *fe, uint saveslot_number)
 
     printf("Loading savefile from: %s\n", save_filename);
 
-    // Open the file, readonly
-    FILE *fp = fopen(save_filename, "r");
+    // Read the whole file into memory
+    struct savefile_buffer *sb = savefile_load(save_filename);
     sfree(save_filename);
 
     // If it didn't open
-    if (!fp)
+    if (!sb)
     {
         // Generate an error message.
         message_text=snewn(38, char);
@@ -4719,10 +4909,10 @@ void load_game(frontend *fe, uint saveslot_number)
 
     // Instruct the midend to start reading in the savefile
     // This will call savefile_read itself multiple times to read the file in bit-by-bit.
-    err = midend_deserialise(fe->me, savefile_read, fp);
+    err = midend_deserialise(fe->me, savefile_read, sb);
 
-    // Close the file
-    fclose(fp);
+    // Free the in-memory copy of the file
+    savefile_free(sb);
 
     // If the midend generated an error while loading the file
     if(err)
@@ -4767,6 +4957,7 @@ void load_autosave_game(frontend *fe)
 
     char *err;
     int x,y;
+    Uint32 checksum;
 
     char *writeable_folder = generate_writeable_folder();
     char *save_filename;
@@ -4777,23 +4968,24 @@ void load_autosave_game(frontend *fe)
     sfree(writeable_folder);
     printf("Loading autosave game from: %s\n", save_filename);
 
-    // Open the file, readonly
-    FILE *fp = fopen(save_filename, "r");
+    // Read the whole file into memory
+    struct savefile_buffer *sb = savefile_load(save_filename);
     sfree(save_filename);
 
     // If it didn't open
-    if(!fp)
+    if(!sb)
     {   
         sdl_status_bar(fe, "Could not load game from autosave slot.");
         return;
     };
+    checksum=journal_checksum(sb->data, sb->len);
 
     // Instruct the midend to start reading in the savefile
     // This will call savefile_read itself multiple times to read the file in bit-by-bit.
-    err = midend_deserialise(fe->me, savefile_read, fp);
+    err = midend_deserialise(fe->me, savefile_read, sb);
 
-    // Close the file
-    fclose(fp);
+    // Free the in-memory copy of the file
+    savefile_free(sb);
 
     // If the midend generated an error while loading the file
     if(err)
@@ -4802,6 +4994,9 @@ void load_autosave_game(frontend *fe)
         return;
     };
 
+    // Bring the game up to date with any moves made since the autosave.
+    journal_replay(fe, checksum);
+
     // Get the new puzzle size
     get_size(fe, &x, &y);
     fe->w=x;
@@ -4819,14 +5014,319 @@ void load_autosave_game(frontend *fe)
     sdl_status_bar(fe, "Game loaded from autosave slot.");
 }
 
+// Where savefile_write sends its output, and a running checksum of it.
+struct savefile_writer {
+    FILE *fp;
+    SHA_State sha;
+};
+
 // Callback function used by the midend to save a game into an actual file.
-// This is called many times by the midend itself to save individual lines of a savefile
+// The midend assembles the whole savefile in memory and calls this once.
 void savefile_write(void *wctx, void *buf, int len)
 {
-    FILE *fp = (FILE *)wctx;
-    fwrite(buf, 1, len, fp);
+    struct savefile_writer *sw = (struct savefile_writer *)wctx;
+    fwrite(buf, 1, len, sw->fp);
+    SHA_Bytes(&sw->sha, buf, len);
 }
 
+// Save the current game to the given file.  The file is written under a
+// temporary name and then renamed over the old one, so a crash or power loss
+// part-way through never leaves a truncated savefile behind.
+// If checksum is not NULL, the checksum of the file contents is stored there.
+// Returns TRUE on success.
+uint savefile_save(frontend *fe, char *filename, Uint32 *checksum)
+{
+#ifdef DEBUG_FUNCTIONS
+    printf("savefile_save()\n");
+#endif
+    char *temp_filename;
+    struct savefile_writer sw;
+    unsigned char digest[20];
+    uint result;
+
+    temp_filename=snewn(strlen(filename) + 5, char);
+    sprintf(temp_filename, "%s.tmp", filename);
+
+    sw.fp = fopen(temp_filename, "wb");
+    if (!sw.fp)
+    {
+        sfree(temp_filename);
+        return(FALSE);
+    };
+
+    SHA_Init(&sw.sha);
+    midend_serialise(fe->me, savefile_write, &sw);
+    SHA_Final(&sw.sha, digest);
+    if (checksum)
+        *checksum = journal_checksum_digest(digest);
+
+    // Make sure the new contents are on disk before they replace the old.
+    flush_file_to_disk(sw.fp);
+    result = !ferror(sw.fp);
+    if (fclose(sw.fp) != 0)
+        result = FALSE;
+
+    if (result)
+        result = (rename(temp_filename, filename) == 0);
+    if (!result)
+        remove(temp_filename);
+
+    sfree(temp_filename);
+    return(result);
+}
+
+// Push a file's buffered data out to disk and wait until it is actually
+// there.  Only the given file is synced, rather than the whole filesystem.
+void flush_file_to_disk(FILE *fp)
+{
+    fflush(fp);
+#ifndef WIN32
+    fsync(fileno(fp));
+#endif
+};
+
+// The autosave journal
+// ====================
+// Rather than only saving the game on a clean exit, every change to the
+// game's history is appended to a journal file next to the autosave as it
+// happens, so that a crash, a flat battery or the power switch loses at
+// most the move in progress.  The journal is a series of records, each an
+// 8-byte header (payload length and checksum, both little-endian) followed
+// by the payload.  The first record names the checksum of the autosave it
+// follows on from, so a journal left over from an older autosave is never
+// applied to a newer one.  The rest are records from the midend (see
+// midend_set_journal).
+//
+// Whenever the journal grows past JOURNAL_COMPACT_SIZE, on exit, and on the
+// first move after a new game has been started or loaded, it's compacted:
+// a full autosave is written and the journal started afresh against it.
+#define JOURNAL_COMPACT_SIZE 32768
+
+char *generate_journal_filename(char *game_name)
+{
+    char *writeable_folder = generate_writeable_folder();
+    char *journal_filename;
+
+    journal_filename=snewn(PATH_MAX + 1 + MAX_GAMENAME_SIZE+10,char);
+    memset(journal_filename, 0, (PATH_MAX + 1 + MAX_GAMENAME_SIZE+10) * sizeof(char));
+    sprintf(journal_filename, "%.*s/%.*s.journal",PATH_MAX, writeable_folder, MAX_GAMENAME_SIZE, game_name);
+    sfree(writeable_folder);
+    return(journal_filename);
+};
+
+Uint32 journal_checksum_digest(unsigned char *digest)
+{
+    return(digest[0] | (digest[1] << 8) | (digest[2] << 16) | ((Uint32)digest[3] << 24));
+};
+
+Uint32 journal_checksum(void *data, int len)
+{
+    unsigned char digest[20];
+
+    SHA_Simple(data, len, digest);
+    return(journal_checksum_digest(digest));
+};
+
+// Write a single record to the end of the journal and make sure it reaches
+// the disk.  Returns TRUE on success.
+uint journal_append_record(FILE *fp, char *buf, int len)
+{
+    unsigned char *record;
+    Uint32 checksum;
+    uint i, result;
+
+    record=snewn(len + 8, unsigned char);
+    checksum=journal_checksum(buf, len);
+    for(i=0;i<4;i++)
+    {
+        record[i]=(len >> (8*i)) & 0xFF;
+        record[4+i]=(checksum >> (8*i)) & 0xFF;
+    };
+    memcpy(record + 8, buf, len);
+
+    result=(fwrite(record, 1, len + 8, fp) == (size_t)(len + 8));
+    flush_file_to_disk(fp);
+    sfree(record);
+    return(result && !ferror(fp));
+};
+
+// Fetch the next record from a journal held in memory.  Returns the payload
+// (pointing into the buffer) or NULL at the end of the journal or at the
+// first record that is truncated or fails its checksum.
+char *journal_next_record(struct savefile_buffer *sb, int *len)
+{
+    unsigned char *p;
+    Uint32 checksum;
+    int i;
+
+    if(sb->len - sb->pos < 8)
+        return(NULL);
+
+    p=(unsigned char *)sb->data + sb->pos;
+    *len=0;
+    checksum=0;
+    for(i=3;i>=0;i--)
+    {
+        *len=(*len << 8) | p[i];
+        checksum=(checksum << 8) | p[4+i];
+    };
+    if((*len < 0) || (*len > sb->len - sb->pos - 8))
+        return(NULL);
+    if(journal_checksum(p + 8, *len) != checksum)
+        return(NULL);
+
+    sb->pos += 8 + *len;
+    return((char *)p + 8);
+};
+
+void journal_close(frontend *fe)
+{
+    if(fe->journal != NULL)
+    {
+        fclose(fe->journal);
+        fe->journal=NULL;
+    };
+};
+
+// Start a new, empty journal following on from the autosave with the given
+// checksum.
+void journal_start(frontend *fe, Uint32 base_checksum)
+{
+    char *journal_filename;
+    char header[16];
+
+    journal_close(fe);
+    fe->journal_needs_base=FALSE;
+
+    journal_filename=generate_journal_filename(fe->sanitised_game_name);
+    fe->journal=fopen(journal_filename, "wb");
+    sfree(journal_filename);
+    if(fe->journal == NULL)
+        return;
+
+    sprintf(header, "BASE:%08lx", (unsigned long)base_checksum);
+    if(!journal_append_record(fe->journal, header, strlen(header)))
+        journal_close(fe);
+};
+
+// Callback function used by the midend to report each change to the game's
+// history.  buf is NULL when the whole history has been replaced.
+void journal_write(void *ctx, char *buf, int len)
+{
+    frontend *fe = (frontend *)ctx;
+
+    if(buf == NULL)
+    {
+        journal_close(fe);
+        fe->journal_needs_base=TRUE;
+        return;
+    };
+
+    if(!global_config->autosave_on_exit)
+        return;
+
+    // The autosave (plus this journal) should describe the game as it is
+    // now.  If it can't, compact: write the whole game out again.
+    if(fe->journal_needs_base || (fe->journal == NULL) || (ftell(fe->journal) > JOURNAL_COMPACT_SIZE))
+    {
+#ifdef DEBUG_FILE_ACCESS
+        printf("Compacting autosave journal.\n");
+#endif
+        autosave_game(fe);
+        return;
+    };
+
+    if(!journal_append_record(fe->journal, buf, len))
+    {
+        printf("Could not write to autosave journal.\n");
+        journal_close(fe);
+        fe->journal_needs_base=TRUE;
+    };
+};
+
+// Apply any journal following on from the autosave with the given checksum,
+// which has just been loaded.  Replay stops at the first record that is
+// damaged or doesn't fit, which is what a crash part-way through writing
+// one leaves behind.
+void journal_replay(frontend *fe, Uint32 base_checksum)
+{
+    char *journal_filename;
+    struct savefile_buffer *sb;
+    char header[16], *record;
+    int len, nrecords=0;
+
+    journal_filename=generate_journal_filename(fe->sanitised_game_name);
+    sb=savefile_load(journal_filename);
+    sfree(journal_filename);
+
+    sprintf(header, "BASE:%08lx", (unsigned long)base_checksum);
+    if(sb != NULL)
+    {
+        record=journal_next_record(sb, &len);
+        if((record != NULL) && (len == (int)strlen(header)) && !memcmp(record, header, len))
+        {
+            while((record=journal_next_record(sb, &len)) != NULL)
+            {
+                if(midend_replay_journal(fe->me, record, len) != NULL)
+                    break;
+                nrecords++;
+            };
+        };
+        savefile_free(sb);
+    };
+
+#ifdef DEBUG_FILE_ACCESS
+    printf("Replayed %d records from autosave journal.\n", nrecords);
+#endif
+
+    // Fold what we replayed into the autosave, so that we never append to a
+    // journal with a damaged record in the middle of it.
+    if(nrecords > 0)
+        autosave_game(fe);
+    else
+        journal_start(fe, base_checksum);
+};
+
+// Run the midend's check of a freshly generated game's solution, if one is
+// waiting. This is done from the once-a-second timer rather than straight
+// after generation so it never delays the first frame. Failures are
+// appended to diagnostics.log in the writeable folder along with the game ID,
+// so the puzzle can be regenerated and looked at later.
+void run_selftest(frontend *fe)
+{
+    char *failure;
+    char *writeable_folder;
+    char *log_filename;
+    char *game_id;
+    FILE *fp;
+    time_t t;
+
+    if(fe->me == NULL)
+        return;
+    failure=midend_selftest(fe->me);
+    if(failure == NULL)
+        return;
+
+    game_id=midend_get_game_id(fe->me);
+    printf("Self-test failed for %s#%s: %s\n", fe->sanitised_game_name, game_id, failure);
+
+    writeable_folder = generate_writeable_folder();
+    log_filename=snewn(PATH_MAX + 1 + 20,char);
+    memset(log_filename, 0, (PATH_MAX + 1 + 20) * sizeof(char));
+    sprintf(log_filename, "%.*s/diagnostics.log",PATH_MAX, writeable_folder);
+    sfree(writeable_folder);
+
+    fp=fopen(log_filename, "a");
+    if(fp != NULL)
+    {
+        t=time(NULL);
+        fprintf(fp, "%.24s %s %s: %s\n", ctime(&t), fe->sanitised_game_name, game_id, failure);
+        fclose(fp);
+    };
+    sfree(log_filename);
+    sfree(game_id);
+};
+
 int autosave_file_exists(char *game_name)
 {
 #ifdef DEBUG_FUNCTIONS
@@ -4853,25 +5353,27 @@ char *autosave_game(frontend *fe)
     char *writeable_folder = generate_writeable_folder();
     char *save_filename;
     char *message_text;
-    FILE *fp;
+    Uint32 checksum;
     
     save_filename=snewn(PATH_MAX + 1 + MAX_GAMENAME_SIZE+10,char);
     memset(save_filename, 0, (PATH_MAX + 1 + MAX_GAMENAME_SIZE+10) * sizeof(char));
     sprintf(save_filename, "%.*s/%.*s.autosave",PATH_MAX, writeable_folder, MAX_GAMENAME_SIZE, fe->sanitised_game_name);
     sfree(writeable_folder);
     printf("Saving autosave game to: %s\n", save_filename);
-    fp = fopen(save_filename, "w");
-    sfree(save_filename);
-    if (!fp)
+    if (!savefile_save(fe, save_filename, &checksum))
     {
+        sfree(save_filename);
         message_text="Could not write to autosave file.";
 #ifdef DEBUG_FILE_ACCESS
         printf("Could not write to autosave file.\n");
 #endif
         return(message_text);
     };
-    midend_serialise(fe->me, savefile_write, fp);
-    fclose(fp);
+    sfree(save_filename);
+
+    // The autosave now holds everything, so start a fresh journal against it.
+    journal_start(fe, checksum);
+
     message_text="Game auto-saved.";
 #ifdef DEBUG_FILE_ACCESS
     printf("Game auto-saved.\n");
@@ -4890,25 +5392,22 @@ char *save_game(frontend *fe, uint saveslot_number)
 
     save_filename=generate_save_filename(fe->sanitised_game_name, saveslot_number);
 
-    FILE *fp;
-    fp = fopen(save_filename, "w");
-    sfree(save_filename);
-    if (!fp)
+    if (!savefile_save(fe, save_filename, NULL))
     {
         message_text=snewn(32,char);
         sprintf(message_text, "Could not write to save slot %u.", saveslot_number);
     }
     else
     {
-        midend_serialise(fe->me, savefile_write, fp);
-        fclose(fp);
         message_text=snewn(27,char);
         sprintf(message_text, "Game saved to save slot %u.", saveslot_number);
     };
+    sfree(save_filename);
     return(message_text);
 }
 
-// Saves the current configuration to an INI file.
+// Saves the current configuration to the game's INI file in the configuration
+// store, to be written back to disk shortly afterwards.
 // The current configuration is assumed to be valid (i.e. the game midend accepts it)
 int save_config_to_INI(frontend *fe)
 {
@@ -4918,7 +5417,7 @@ int save_config_to_INI(frontend *fe)
 
     int j=0;
     char *keyword_name;
-    FILE *inifile;
+    struct ini_store_entry *ini;
     char *ini_filename;
     char digit_as_string[32];
 
@@ -4929,10 +5428,14 @@ int save_config_to_INI(frontend *fe)
     memset(ini_filename, 0, (PATH_MAX + 1 + MAX_GAMENAME_SIZE+5) * sizeof(char));
     sprintf(ini_filename, "%.*s/%.*s.ini",PATH_MAX, writeable_folder, MAX_GAMENAME_SIZE, fe->sanitised_game_name);
     sfree(writeable_folder);
+
+    // Find the INI file in the configuration store.
+    ini=ini_store_find(ini_filename);
+
     // Create an INI section, in case one does not already exist.
     // If we don't do this, INIParser tends not to write entries under that
     // section at all.
-    iniparser_setstring(fe->ini_dict, "Configuration", NULL);
+    iniparser_setstring(ini->dict, "Configuration", NULL);
 
     // Loop over all the configuration items in this game
     while(fe->cfg[j].type!=C_END)
@@ -4949,7 +5452,7 @@ int save_config_to_INI(frontend *fe)
                 printf("INI: %s is now %s in file %s\n",keyword_name,fe->cfg[j].sval,ini_filename);
 #endif
                 // Write the current setting to the in-memory INI dictionary.
-                iniparser_setstring(fe->ini_dict, keyword_name, fe->cfg[j].sval);
+                iniparser_setstring(ini->dict, keyword_name, fe->cfg[j].sval);
                 break;
 
             case C_BOOLEAN:
@@ -4959,14 +5462,14 @@ int save_config_to_INI(frontend *fe)
 #ifdef DEBUG_FILE_ACCESS
                     printf("INI: %s is now %s in file %s\n",keyword_name,"T",ini_filename);
 #endif
-                    iniparser_setstring(fe->ini_dict, keyword_name, "T");
+                    iniparser_setstring(ini->dict, keyword_name, "T");
                 }
                 else
                 {
 #ifdef DEBUG_FILE_ACCESS
                     printf("INI: %s is now %s in file %s\n",keyword_name,"F",ini_filename);
 #endif
-                    iniparser_setstring(fe->ini_dict, keyword_name, "F");
+                    iniparser_setstring(ini->dict, keyword_name, "F");
                 };
                 break;
 
@@ -4975,7 +5478,7 @@ int save_config_to_INI(frontend *fe)
 #ifdef DEBUG_FILE_ACCESS
                 printf("INI: %s is now %s in file %s\n",keyword_name,fe->cfg[j].sval,ini_filename);
 #endif
-                iniparser_setstring(fe->ini_dict, keyword_name, fe->cfg[j].sval);
+                iniparser_setstring(ini->dict, keyword_name, fe->cfg[j].sval);
 
                 // Because "CHOICES" consist of a string of options and a number to 
                 // indicate the currently selected option, we have to write the number into
@@ -4984,7 +5487,7 @@ int save_config_to_INI(frontend *fe)
                 // We do this using a key called "<configuration option>.default".
                 strcat(keyword_name, ".default");
                 sprintf(digit_as_string, "%d", fe->cfg[j].ival);
-                iniparser_setstring(fe->ini_dict, keyword_name, digit_as_string);
+                iniparser_setstring(ini->dict, keyword_name, digit_as_string);
                 
                 break;
         }; // end switch
@@ -4994,44 +5497,14 @@ int save_config_to_INI(frontend *fe)
         j++;
     }; // end while
 
-#ifdef DEBUG_FILE_ACCESS
-    printf("INI: Attempting to open %s for writing.\n", ini_filename);
-#endif
-    // Open the INI file for writing.
-    inifile = fopen(ini_filename, "w");
-    
-    // If we succeeded
-    if(inifile)
-    {
-#ifdef DEBUG_FILE_ACCESS
-        printf("INI: %s opened successfully for writing.\n", ini_filename);
-#endif
-        // Write the in-memory INI "dictionary" to disk as an INI file.
-        iniparser_dump_ini(fe->ini_dict,inifile);
-
-        // Flush the data straight to disk.
-        fflush(inifile);
+    // Free the dynamically-allocated string used for the INI filename.
+    sfree(ini_filename);
 
-        // Close the file
-        fclose(inifile);
-#ifdef DEBUG_FILE_ACCESS
-        printf("INI: %s written to disk.\n", ini_filename);
-#endif
-        // Free the dynamically-allocated string used for the INI filename.
-        sfree(ini_filename);
-
-        return(TRUE);
-    }
-    else
-    {
-#ifdef DEBUG_FILE_ACCESS
-        printf("INI: Error opening %s for writing.\n", ini_filename);
-#endif
-        // Free the dynamically-allocated string used for the INI filename.
-        sfree(ini_filename);
-
-        return(FALSE);
-    };
+    // The file itself is written back later, by ini_store_flush(), which
+    // reports any failure on the statusbar.  If the last write-back of this
+    // file already failed, this one will too, so say so now.
+    ini_store_changed(ini);
+    return(!ini->write_failed);
 };
 
 int get_mouse_type()
@@ -5807,6 +6280,10 @@ void start_game(frontend *fe, int game_index, uint skip_config)
 
     fe->me = midend_new(fe, &this_game, &sdl_drawing, fe);
 
+    // Have every move journalled so it survives a crash (see journal_write).
+    fe->journal_needs_base=TRUE;
+    midend_set_journal(fe->me, journal_write, fe);
+
     // Get the colours that the midend thinks it needs.
     colours = midend_colours(fe->me, &ncolours);
 
@@ -6094,6 +6571,13 @@ void delete_autosave_game(frontend *fe)
             printf("Autosave %s has been deleted at user's request.\n", save_filename);
         else
             printf("Autosave %s could not be deleted (write-protected?).\n", save_filename);
+
+        // The journal is meaningless without the autosave it follows on from.
+        journal_close(fe);
+        fe->journal_needs_base=TRUE;
+        sfree(save_filename);
+        save_filename=generate_journal_filename(fe->sanitised_game_name);
+        remove(save_filename);
     }
     else
     {
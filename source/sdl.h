@@ -81,6 +81,27 @@ uint save_global_config_to_INI();
 void delete_autosave_game(frontend *fe);
 int autosave_file_exists(char *game_name);
 void load_autosave_game(frontend *fe);
+struct savefile_buffer *savefile_load(char *filename);
+void savefile_free(struct savefile_buffer *sb);
+int savefile_read(void *wctx, void *buf, int len);
+void savefile_write(void *wctx, void *buf, int len);
+uint savefile_save(frontend *fe, char *filename, Uint32 *checksum);
+void flush_file_to_disk(FILE *fp);
+struct ini_store_entry *ini_store_find(char *filename);
+void ini_store_changed(struct ini_store_entry *entry);
+uint ini_store_write(struct ini_store_entry *entry);
+void ini_store_flush(frontend *fe, uint force);
+void ini_store_free();
+char *generate_journal_filename(char *game_name);
+Uint32 journal_checksum_digest(unsigned char *digest);
+Uint32 journal_checksum(void *data, int len);
+uint journal_append_record(FILE *fp, char *buf, int len);
+char *journal_next_record(struct savefile_buffer *sb, int *len);
+void journal_close(frontend *fe);
+void journal_start(frontend *fe, Uint32 base_checksum);
+void journal_write(void *ctx, char *buf, int len);
+void journal_replay(frontend *fe, Uint32 base_checksum);
+void run_selftest(frontend *fe);
 void list_music_files();
 void file_list_test();
 void show_hourglass_cursor(uint toggle);
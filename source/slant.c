@@ -239,9 +239,11 @@ static char *validate_params(game_params *params, int full)
 struct solver_scratch {
     /*
      * Disjoint set forest which tracks the connected sets of
-     * points.
+     * points. This and `equiv' are resettable dsfs, since the
+     * generator runs the solver over and over on the same scratch
+     * space.
      */
-    int *connected;
+    rdsf *connected;
 
     /*
      * Counts the number of possible exits from each connected set
@@ -262,7 +264,7 @@ struct solver_scratch {
      * Another disjoint set forest. This one tracks _squares_ which
      * are known to slant in the same direction.
      */
-    int *equiv;
+    rdsf *equiv;
 
     /*
      * Stores slash values which we know for an equivalence class.
@@ -309,10 +311,10 @@ static struct solver_scratch *new_scratch(int w, int h)
 {
     int W = w+1, H = h+1;
     struct solver_scratch *ret = snew(struct solver_scratch);
-    ret->connected = snewn(W*H, int);
+    ret->connected = rdsf_new(W*H);
     ret->exits = snewn(W*H, int);
     ret->border = snewn(W*H, unsigned char);
-    ret->equiv = snewn(w*h, int);
+    ret->equiv = rdsf_new(w*h);
     ret->slashval = snewn(w*h, signed char);
     ret->vbitmap = snewn(w*h, unsigned char);
     return ret;
@@ -322,25 +324,25 @@ static void free_scratch(struct solver_scratch *sc)
 {
     sfree(sc->vbitmap);
     sfree(sc->slashval);
-    sfree(sc->equiv);
+    rdsf_free(sc->equiv);
     sfree(sc->border);
     sfree(sc->exits);
-    sfree(sc->connected);
+    rdsf_free(sc->connected);
     sfree(sc);
 }
 
 /*
- * Wrapper on dsf_merge() which updates the `exits' and `border'
+ * Wrapper on rdsf_merge() which updates the `exits' and `border'
  * arrays.
  */
-static void merge_vertices(int *connected,
+static void merge_vertices(rdsf *connected,
 			   struct solver_scratch *sc, int i, int j)
 {
     int exits = -1, border = FALSE;    /* initialise to placate optimiser */
 
     if (sc) {
-	i = dsf_canonify(connected, i);
-	j = dsf_canonify(connected, j);
+	i = rdsf_canonify(connected, i);
+	j = rdsf_canonify(connected, j);
 
 	/*
 	 * We have used one possible exit from each of the two
@@ -352,10 +354,10 @@ static void merge_vertices(int *connected,
 	border = sc->border[i] || sc->border[j];
     }
 
-    dsf_merge(connected, i, j);
+    rdsf_merge(connected, i, j);
 
     if (sc) {
-	i = dsf_canonify(connected, i);
+	i = rdsf_canonify(connected, i);
 	sc->exits[i] = exits;
 	sc->border[i] = border;
     }
@@ -371,14 +373,14 @@ static void merge_vertices(int *connected,
 static void decr_exits(struct solver_scratch *sc, int i)
 {
     if (sc->clues[i] < 0) {
-	i = dsf_canonify(sc->connected, i);
+	i = rdsf_canonify(sc->connected, i);
 	sc->exits[i]--;
     }
 }
 
 static void fill_square(int w, int h, int x, int y, int v,
 			signed char *soln,
-			int *connected, struct solver_scratch *sc)
+			rdsf *connected, struct solver_scratch *sc)
 {
     int W = w+1 /*, H = h+1 */;
 
@@ -396,7 +398,7 @@ static void fill_square(int w, int h, int x, int y, int v,
     soln[y*w+x] = v;
 
     if (sc) {
-	int c = dsf_canonify(sc->equiv, y*w+x);
+	int c = rdsf_canonify(sc->equiv, y*w+x);
 	sc->slashval[c] = v;
     }
 
@@ -468,13 +470,13 @@ static int slant_solve(int w, int h, const signed char *clues,
      * Establish a disjoint set forest for tracking connectedness
      * between grid points.
      */
-    dsf_init(sc->connected, W*H);
+    rdsf_reset(sc->connected);
 
     /*
      * Establish a disjoint set forest for tracking which squares
      * are known to slant in the same direction.
      */
-    dsf_init(sc->equiv, w*h);
+    rdsf_reset(sc->equiv);
 
     /*
      * Clear the slashval array.
@@ -577,7 +579,7 @@ static int slant_solve(int w, int h, const signed char *clues,
 		nl = c;
 		last = neighbours[nneighbours-1].pos;
 		if (soln[last] == 0)
-		    eq = dsf_canonify(sc->equiv, last);
+		    eq = rdsf_canonify(sc->equiv, last);
 		else
 		    eq = -1;
 		meq = mj1 = mj2 = -1;
@@ -587,7 +589,7 @@ static int slant_solve(int w, int h, const signed char *clues,
 		    if (soln[j] == 0) {
 			nu++;	       /* undecided */
 			if (meq < 0 && difficulty > DIFF_EASY) {
-			    eq2 = dsf_canonify(sc->equiv, j);
+			    eq2 = rdsf_canonify(sc->equiv, j);
 			    if (eq == eq2 && last != j) {
 				/*
 				 * We've found an equivalent pair.
@@ -698,9 +700,9 @@ static int slant_solve(int w, int h, const signed char *clues,
 			    printf("clue point at %d,%d implies %d,%d == %d,"
 				   "%d\n", x, y, mj1%w, mj1/w, mj2%w, mj2/w);
 #endif
-			mj1 = dsf_canonify(sc->equiv, mj1);
+			mj1 = rdsf_canonify(sc->equiv, mj1);
 			sv1 = sc->slashval[mj1];
-			mj2 = dsf_canonify(sc->equiv, mj2);
+			mj2 = rdsf_canonify(sc->equiv, mj2);
 			sv2 = sc->slashval[mj2];
 			if (sv1 != 0 && sv2 != 0 && sv1 != sv2) {
 #ifdef SOLVER_DIAGNOSTICS
@@ -711,8 +713,8 @@ static int slant_solve(int w, int h, const signed char *clues,
 			    return 0;
 			}
 			sv1 = sv1 ? sv1 : sv2;
-			dsf_merge(sc->equiv, mj1, mj2);
-			mj1 = dsf_canonify(sc->equiv, mj1);
+			rdsf_merge(sc->equiv, mj1, mj2);
+			mj1 = rdsf_canonify(sc->equiv, mj1);
 			sc->slashval[mj1] = sv1;
 		    }
 		}
@@ -747,7 +749,7 @@ static int slant_solve(int w, int h, const signed char *clues,
 		bs = FALSE;
 
 		if (difficulty > DIFF_EASY)
-		    v = sc->slashval[dsf_canonify(sc->equiv, y*w+x)];
+		    v = sc->slashval[rdsf_canonify(sc->equiv, y*w+x)];
 		else
 		    v = 0;
 
@@ -756,8 +758,8 @@ static int slant_solve(int w, int h, const signed char *clues,
 		 * (x+1,y+1); if successful, we will deduce that we
 		 * must have a forward slash.
 		 */
-		c1 = dsf_canonify(sc->connected, y*W+x);
-		c2 = dsf_canonify(sc->connected, (y+1)*W+(x+1));
+		c1 = rdsf_canonify(sc->connected, y*W+x);
+		c2 = rdsf_canonify(sc->connected, (y+1)*W+(x+1));
 		if (c1 == c2) {
 		    fs = TRUE;
 #ifdef SOLVER_DIAGNOSTICS
@@ -783,8 +785,8 @@ static int slant_solve(int w, int h, const signed char *clues,
 		 * Now do the same between (x+1,y) and (x,y+1), to
 		 * see if we are required to have a backslash.
 		 */
-		c1 = dsf_canonify(sc->connected, y*W+(x+1));
-		c2 = dsf_canonify(sc->connected, (y+1)*W+x);
+		c1 = rdsf_canonify(sc->connected, y*W+(x+1));
+		c2 = rdsf_canonify(sc->connected, (y+1)*W+x);
 		if (c1 == c2) {
 		    bs = TRUE;
 #ifdef SOLVER_DIAGNOSTICS
@@ -877,9 +879,9 @@ static int slant_solve(int w, int h, const signed char *clues,
                  */
                 if (x+1 < w && !(sc->vbitmap[y*w+x] & 0x3)) {
                     int n1 = y*w+x, n2 = y*w+(x+1);
-                    if (dsf_canonify(sc->equiv, n1) !=
-                        dsf_canonify(sc->equiv, n2)) {
-                        dsf_merge(sc->equiv, n1, n2);
+                    if (rdsf_canonify(sc->equiv, n1) !=
+                        rdsf_canonify(sc->equiv, n2)) {
+                        rdsf_merge(sc->equiv, n1, n2);
                         done_something = TRUE;
 #ifdef SOLVER_DIAGNOSTICS
                         if (verbose)
@@ -891,9 +893,9 @@ static int slant_solve(int w, int h, const signed char *clues,
                 }
                 if (y+1 < h && !(sc->vbitmap[y*w+x] & 0xC)) {
                     int n1 = y*w+x, n2 = (y+1)*w+x;
-                    if (dsf_canonify(sc->equiv, n1) !=
-                        dsf_canonify(sc->equiv, n2)) {
-                        dsf_merge(sc->equiv, n1, n2);
+                    if (rdsf_canonify(sc->equiv, n1) !=
+                        rdsf_canonify(sc->equiv, n2)) {
+                        rdsf_merge(sc->equiv, n1, n2);
                         done_something = TRUE;
 #ifdef SOLVER_DIAGNOSTICS
                         if (verbose)
@@ -993,7 +995,8 @@ static void slant_generate(int w, int h, signed char *soln, random_state *rs)
 {
     int W = w+1, H = h+1;
     int x, y, i;
-    int *connected, *indices;
+    rdsf *connected;
+    int *indices;
 
     /*
      * Clear the output.
@@ -1004,7 +1007,7 @@ static void slant_generate(int w, int h, signed char *soln, random_state *rs)
      * Establish a disjoint set forest for tracking connectedness
      * between grid points.
      */
-    connected = snew_dsf(W*H);
+    connected = rdsf_new(W*H);
 
     /*
      * Prepare a list of the squares in the grid, and fill them in
@@ -1024,10 +1027,10 @@ static void slant_generate(int w, int h, signed char *soln, random_state *rs)
 	y = indices[i] / w;
 	x = indices[i] % w;
 
-	fs = (dsf_canonify(connected, y*W+x) ==
-	      dsf_canonify(connected, (y+1)*W+(x+1)));
-	bs = (dsf_canonify(connected, (y+1)*W+x) ==
-	      dsf_canonify(connected, y*W+(x+1)));
+	fs = (rdsf_canonify(connected, y*W+x) ==
+	      rdsf_canonify(connected, (y+1)*W+(x+1)));
+	bs = (rdsf_canonify(connected, (y+1)*W+x) ==
+	      rdsf_canonify(connected, y*W+(x+1)));
 
 	/*
 	 * It isn't possible to get into a situation where we
@@ -1059,7 +1062,7 @@ static void slant_generate(int w, int h, signed char *soln, random_state *rs)
     }
 
     sfree(indices);
-    sfree(connected);
+    rdsf_free(connected);
 }
 
 static char *new_game_desc(game_params *params, random_state *rs,
@@ -2106,11 +2109,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILESIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    NULL,				       /* redraw_region */
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
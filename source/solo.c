@@ -95,6 +95,7 @@ int solver_show_working, solver_recurse_depth;
 #endif
 
 #include "puzzles.h"
+#include "bitset.h"
 
 /*
  * To save space, I store digits internally as unsigned char. This
@@ -137,68 +138,62 @@ enum {
 };
 
 /*
- * To determine all possible ways to reach a given sum by adding two or
- * three numbers from 1..9, each of which occurs exactly once in the sum,
- * these arrays contain a list of bitmasks for each sum value, where if
- * bit N is set, it means that N occurs in the sum.  Each list is
- * terminated by a zero if it is shorter than the size of the array.
+ * To determine all possible ways to reach a given sum by adding up
+ * to four numbers from 1..9, each of which occurs exactly once in the
+ * sum, killer_sums contains a list of bitmasks, where if bit N is set
+ * it means that N occurs in the sum. The bitmasks for an n-number sum
+ * totalling s are killer_sums[killer_sum_index[n][s]] up to but not
+ * including killer_sums[killer_sum_index[n][s+1]]; sums which cannot
+ * be made have an empty range.
+ *
+ * The tables are constant so that nothing need be computed before a
+ * game can start. They list every subset of 1..9 with at most four
+ * elements, ordered by size, then by total, then lexicographically;
+ * a few lines of any scripting language will regenerate them.
  */
-#define MAX_2SUMS 5
-#define MAX_3SUMS 8
-#define MAX_4SUMS 12
-unsigned int sum_bits2[18][MAX_2SUMS];
-unsigned int sum_bits3[25][MAX_3SUMS];
-unsigned int sum_bits4[31][MAX_4SUMS];
-
-static int find_sum_bits(unsigned int *array, int idx, int value_left,
-			 int addends_left, int min_addend,
-			 unsigned int bitmask_so_far)
-{
-    int i;
-    assert(addends_left >= 2);
-
-    for (i = min_addend; i < value_left; i++) {
-	unsigned int new_bitmask = bitmask_so_far | (1 << i);
-	assert(bitmask_so_far != new_bitmask);
-
-	if (addends_left == 2) {
-	    int j = value_left - i;
-	    if (j <= i)
-		break;
-	    if (j > 9)
-		continue;
-	    array[idx++] = new_bitmask | (1 << j);
-	} else
-	    idx = find_sum_bits(array, idx, value_left - i,
-				addends_left - 1, i + 1,
-				new_bitmask);
-    }
-    return idx;
-}
-
-static void precompute_sum_bits(void)
-{
-    int i;
-    for (i = 3; i < 31; i++) {
-	int j;
-	if (i < 18) {
-	    j = find_sum_bits(sum_bits2[i], 0, i, 2, 1, 0);
-	    assert (j <= MAX_2SUMS);
-	    if (j < MAX_2SUMS)
-		sum_bits2[i][j] = 0;
-	}
-	if (i < 25) {
-	    j = find_sum_bits(sum_bits3[i], 0, i, 3, 1, 0);
-	    assert (j <= MAX_3SUMS);
-	    if (j < MAX_3SUMS)
-		sum_bits3[i][j] = 0;
-	}
-	j = find_sum_bits(sum_bits4[i], 0, i, 4, 1, 0);
-	assert (j <= MAX_4SUMS);
-	if (j < MAX_4SUMS)
-	    sum_bits4[i][j] = 0;
-    }
-}
+#define MAX_KILLER_SUM 30
+static const unsigned short killer_sums[] = {
+    0x002, 0x004, 0x008, 0x010, 0x020, 0x040, 0x080, 0x100, 0x200, 0x006,
+    0x00a, 0x012, 0x00c, 0x022, 0x014, 0x042, 0x024, 0x018, 0x082, 0x044,
+    0x028, 0x102, 0x084, 0x048, 0x030, 0x202, 0x104, 0x088, 0x050, 0x204,
+    0x108, 0x090, 0x060, 0x208, 0x110, 0x0a0, 0x210, 0x120, 0x0c0, 0x220,
+    0x140, 0x240, 0x180, 0x280, 0x300, 0x00e, 0x016, 0x026, 0x01a, 0x046,
+    0x02a, 0x01c, 0x086, 0x04a, 0x032, 0x02c, 0x106, 0x08a, 0x052, 0x04c,
+    0x034, 0x206, 0x10a, 0x092, 0x062, 0x08c, 0x054, 0x038, 0x20a, 0x112,
+    0x0a2, 0x10c, 0x094, 0x064, 0x058, 0x212, 0x122, 0x0c2, 0x20c, 0x114,
+    0x0a4, 0x098, 0x068, 0x222, 0x142, 0x214, 0x124, 0x0c4, 0x118, 0x0a8,
+    0x070, 0x242, 0x182, 0x224, 0x144, 0x218, 0x128, 0x0c8, 0x0b0, 0x282,
+    0x244, 0x184, 0x228, 0x148, 0x130, 0x0d0, 0x302, 0x284, 0x248, 0x188,
+    0x230, 0x150, 0x0e0, 0x304, 0x288, 0x250, 0x190, 0x160, 0x308, 0x290,
+    0x260, 0x1a0, 0x310, 0x2a0, 0x1c0, 0x320, 0x2c0, 0x340, 0x380, 0x01e,
+    0x02e, 0x04e, 0x036, 0x08e, 0x056, 0x03a, 0x10e, 0x096, 0x066, 0x05a,
+    0x03c, 0x20e, 0x116, 0x0a6, 0x09a, 0x06a, 0x05c, 0x216, 0x126, 0x0c6,
+    0x11a, 0x0aa, 0x072, 0x09c, 0x06c, 0x226, 0x146, 0x21a, 0x12a, 0x0ca,
+    0x0b2, 0x11c, 0x0ac, 0x074, 0x246, 0x186, 0x22a, 0x14a, 0x132, 0x0d2,
+    0x21c, 0x12c, 0x0cc, 0x0b4, 0x078, 0x286, 0x24a, 0x18a, 0x232, 0x152,
+    0x0e2, 0x22c, 0x14c, 0x134, 0x0d4, 0x0b8, 0x306, 0x28a, 0x252, 0x192,
+    0x162, 0x24c, 0x18c, 0x234, 0x154, 0x0e4, 0x138, 0x0d8, 0x30a, 0x292,
+    0x262, 0x1a2, 0x28c, 0x254, 0x194, 0x164, 0x238, 0x158, 0x0e8, 0x312,
+    0x2a2, 0x1c2, 0x30c, 0x294, 0x264, 0x1a4, 0x258, 0x198, 0x168, 0x0f0,
+    0x322, 0x2c2, 0x314, 0x2a4, 0x1c4, 0x298, 0x268, 0x1a8, 0x170, 0x342,
+    0x324, 0x2c4, 0x318, 0x2a8, 0x1c8, 0x270, 0x1b0, 0x382, 0x344, 0x328,
+    0x2c8, 0x2b0, 0x1d0, 0x384, 0x348, 0x330, 0x2d0, 0x1e0, 0x388, 0x350,
+    0x2e0, 0x390, 0x360, 0x3a0, 0x3c0
+};
+static const unsigned char killer_sum_index[5][MAX_KILLER_SUM + 2] = {
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+     9, 9, 9, 9, 9, 9, 9, 9, 9},
+    {9, 9, 9, 9, 10, 11, 13, 15, 18, 21, 25, 29, 33, 36, 39, 41, 43, 44,
+     45, 45, 45, 45, 45, 45, 45, 45, 45, 45, 45, 45, 45, 45},
+    {45, 45, 45, 45, 45, 45, 45, 46, 47, 49, 52, 56, 61, 68, 75, 83, 91,
+     99, 106, 113, 118, 122, 125, 127, 128, 129, 129, 129, 129, 129, 129,
+     129},
+    {129, 129, 129, 129, 129, 129, 129, 129, 129, 129, 129, 130, 131, 133,
+     136, 141, 147, 155, 164, 175, 186, 198, 209, 220, 229, 237, 243, 248,
+     251, 253, 254, 255}
+};
 
 struct game_params {
     /*
@@ -961,7 +956,8 @@ static int solver_intersect(struct solver_usage *usage,
 }
 
 struct solver_scratch {
-    unsigned char *grid, *rowidx, *colidx, *set;
+    unsigned char *grid, *rowidx, *colidx;
+    bitword *rowbits, *set;	       /* for set elimination */
     int *neighbours, *bfsqueue;
     int *indexlist, *indexlist2;
 #ifdef STANDALONE_SOLVER
@@ -978,11 +974,11 @@ static int solver_set(struct solver_usage *usage,
                       )
 {
     int cr = usage->cr;
-    int i, j, n, count;
-    unsigned char *grid = scratch->grid;
+    int i, j, n, nw, count;
+    bitword *grid = scratch->rowbits;
     unsigned char *rowidx = scratch->rowidx;
     unsigned char *colidx = scratch->colidx;
-    unsigned char *set = scratch->set;
+    bitword *set = scratch->set;
 
     /*
      * We are passed a cr-by-cr matrix of booleans. Our first job
@@ -1024,11 +1020,18 @@ static int solver_set(struct solver_usage *usage,
     assert(n == j);
 
     /*
-     * And create the smaller matrix.
+     * And create the smaller matrix, as a bitset per row. Column j
+     * is stored as bit n-1-j, so that counting `set' upwards as a
+     * binary number visits the column subsets in the order of a
+     * counter whose least significant digit is the last column.
      */
-    for (i = 0; i < n; i++)
+    nw = BS_WORDS(n);
+    for (i = 0; i < n; i++) {
+        bs_zero(grid + i*nw, nw);
         for (j = 0; j < n; j++)
-            grid[i*cr+j] = usage->cube[indices[rowidx[i]*cr+colidx[j]]];
+            if (usage->cube[indices[rowidx[i]*cr+colidx[j]]])
+                BS_SET(grid + i*nw, n-1-j);
+    }
 
     /*
      * Having done that, we now have a matrix in which every row
@@ -1038,7 +1041,7 @@ static int solver_set(struct solver_usage *usage,
      * columns) whose width and height add up to n.
      */
 
-    memset(set, 0, n);
+    bs_zero(set, nw);
     count = 0;
     while (1) {
         /*
@@ -1052,16 +1055,9 @@ static int solver_set(struct solver_usage *usage,
              * the positions listed in `set'.
              */
             int rows = 0;
-            for (i = 0; i < n; i++) {
-                int ok = TRUE;
-                for (j = 0; j < n; j++)
-                    if (set[j] && grid[i*cr+j]) {
-                        ok = FALSE;
-                        break;
-                    }
-                if (ok)
+            for (i = 0; i < n; i++)
+                if (!bs_intersects(grid + i*nw, set, nw))
                     rows++;
-            }
 
             /*
              * We expect never to be able to get _more_ than
@@ -1102,15 +1098,10 @@ static int solver_set(struct solver_usage *usage,
                  * positions in the cube to meddle with.
                  */
                 for (i = 0; i < n; i++) {
-                    int ok = TRUE;
-                    for (j = 0; j < n; j++)
-                        if (set[j] && grid[i*cr+j]) {
-                            ok = FALSE;
-                            break;
-                        }
-                    if (!ok) {
+                    bitword *row = grid + i*nw;
+                    if (bs_intersects(row, set, nw)) {
                         for (j = 0; j < n; j++)
-                            if (!set[j] && grid[i*cr+j]) {
+                            if (BS_TEST(row, n-1-j) && !BS_TEST(set, n-1-j)) {
                                 int fpos = indices[rowidx[i]*cr+colidx[j]];
 #ifdef STANDALONE_SOLVER
                                 if (solver_show_working) {
@@ -1149,16 +1140,11 @@ static int solver_set(struct solver_usage *usage,
         }
 
         /*
-         * Binary increment: change the rightmost 0 to a 1, and
-         * change all 1s to the right of it to 0s.
+         * Move on to the next subset.
          */
-        i = n;
-        while (i > 0 && set[i-1])
-            set[--i] = 0, count--;
-        if (i > 0)
-            set[--i] = 1, count++;
-        else
+        if (!bs_increment(set, n))
             break;                     /* done */
+        count = bs_count(set, nw);
     }
 
     return 0;
@@ -1444,9 +1430,9 @@ static int solver_killer_sums(struct solver_usage *usage, int b,
 			      )
 {
     int cr = usage->cr;
-    int i, ret, max_sums;
+    int i, ret, size, first, last;
     int nsquares = cages->nr_squares[b];
-    unsigned int *sumbits, possible_addends;
+    unsigned int possible_addends, square_bits[4];
 
     if (clue == 0) {
 	assert(nsquares == 0);
@@ -1484,25 +1470,30 @@ static int solver_killer_sums(struct solver_usage *usage, int b,
 	if (known_block == -1 && known_col == -1 && known_row == -1)
 	    return 0;
     }
-    if (nsquares == 2) {
-	if (clue < 3 || clue > 17)
-	    return -1;
-
-	sumbits = sum_bits2[clue];
-	max_sums = MAX_2SUMS;
-    } else if (nsquares == 3) {
-	if (clue < 6 || clue > 24)
-	    return -1;
-
-	sumbits = sum_bits3[clue];
-	max_sums = MAX_3SUMS;
-    } else {
-	if (clue < 10 || clue > 30)
-	    return -1;
+    if (clue < 0 || clue > MAX_KILLER_SUM)
+	return -1;
+    /*
+     * Single-square cages have always been checked against the
+     * four-number sums, which rules out any total below 10.
+     */
+    size = (nsquares == 1 ? 4 : nsquares);
+    first = killer_sum_index[size][clue];
+    last = killer_sum_index[size][clue+1];
 
-	sumbits = sum_bits4[clue];
-	max_sums = MAX_4SUMS;
+    /*
+     * Find the set of digits still possible in each square of the
+     * cage. Digits above cr are left set, since nothing rules them
+     * out.
+     */
+    for (i = 0; i < nsquares; i++) {
+	int n;
+	int x = cages->blocks[b][i];
+	square_bits[i] = ~0U;
+	for (n = 1; n <= cr; n++)
+	    if (!cube2(x, n))
+		square_bits[i] &= ~(1 << n);
     }
+
     /*
      * For every possible way to get the sum, see if there is
      * one square in the cage that disallows all the required
@@ -1510,24 +1501,13 @@ static int solver_killer_sums(struct solver_usage *usage, int b,
      * the sum is impossible.
      */
     possible_addends = 0;
-    for (i = 0; i < max_sums; i++) {
+    for (i = first; i < last; i++) {
 	int j;
-	unsigned int bits = sumbits[i];
-
-	if (bits == 0)
-	    break;
+	unsigned int bits = killer_sums[i];
 
-	for (j = 0; j < nsquares; j++) {
-	    int n;
-	    unsigned int square_bits = bits;
-	    int x = cages->blocks[b][j];
-	    for (n = 1; n <= cr; n++)
-		if (!cube2(x, n))
-		    square_bits &= ~(1 << n);
-	    if (square_bits == 0) {
+	for (j = 0; j < nsquares; j++)
+	    if ((bits & square_bits[j]) == 0)
 		break;
-	    }
-	}
 	if (j == nsquares)
 	    possible_addends |= bits;
     }
@@ -1621,40 +1601,30 @@ static int filter_whole_cages(struct solver_usage *usage, int *squares, int n,
     return off;
 }
 
-static struct solver_scratch *solver_new_scratch(struct solver_usage *usage)
+/*
+ * The scratch space, like the usage structure, lives in the arena
+ * passed to solver(), and is released along with it.
+ */
+static struct solver_scratch *solver_new_scratch(struct solver_usage *usage,
+						 arena *ar)
 {
-    struct solver_scratch *scratch = snew(struct solver_scratch);
+    struct solver_scratch *scratch = anew(ar, struct solver_scratch);
     int cr = usage->cr;
-    scratch->grid = snewn(cr*cr, unsigned char);
-    scratch->rowidx = snewn(cr, unsigned char);
-    scratch->colidx = snewn(cr, unsigned char);
-    scratch->set = snewn(cr, unsigned char);
-    scratch->neighbours = snewn(5*cr, int);
-    scratch->bfsqueue = snewn(cr*cr, int);
+    scratch->grid = anewn(ar, cr*cr, unsigned char);
+    scratch->rowidx = anewn(ar, cr, unsigned char);
+    scratch->colidx = anewn(ar, cr, unsigned char);
+    scratch->rowbits = anewn(ar, cr * BS_WORDS(cr), bitword);
+    scratch->set = anewn(ar, BS_WORDS(cr), bitword);
+    scratch->neighbours = anewn(ar, 5*cr, int);
+    scratch->bfsqueue = anewn(ar, cr*cr, int);
 #ifdef STANDALONE_SOLVER
-    scratch->bfsprev = snewn(cr*cr, int);
+    scratch->bfsprev = anewn(ar, cr*cr, int);
 #endif
-    scratch->indexlist = snewn(cr*cr, int);   /* used for set elimination */
-    scratch->indexlist2 = snewn(cr, int);   /* only used for intersect() */
+    scratch->indexlist = anewn(ar, cr*cr, int); /* used for set elimination */
+    scratch->indexlist2 = anewn(ar, cr, int);   /* only used for intersect() */
     return scratch;
 }
 
-static void solver_free_scratch(struct solver_scratch *scratch)
-{
-#ifdef STANDALONE_SOLVER
-    sfree(scratch->bfsprev);
-#endif
-    sfree(scratch->bfsqueue);
-    sfree(scratch->neighbours);
-    sfree(scratch->set);
-    sfree(scratch->colidx);
-    sfree(scratch->rowidx);
-    sfree(scratch->grid);
-    sfree(scratch->indexlist);
-    sfree(scratch->indexlist2);
-    sfree(scratch);
-}
-
 /*
  * Used for passing information about difficulty levels between the solver
  * and its callers.
@@ -1666,12 +1636,21 @@ struct difficulty {
     int diff, kdiff;
 };
 
+/*
+ * All of the solver's working memory, including that of its
+ * recursive calls, is allocated from the arena `ar' and released
+ * back to where it was on return. So a caller that solves many grids
+ * can keep one arena for all of them, and never touch the heap after
+ * the first solve.
+ */
 static void solver(int cr, struct block_structure *blocks,
 		  struct block_structure *kblocks, int xtype,
-		  digit *grid, digit *kgrid, struct difficulty *dlev)
+		  digit *grid, digit *kgrid, struct difficulty *dlev,
+		  arena *ar)
 {
     struct solver_usage *usage;
     struct solver_scratch *scratch;
+    arena_mark mark = arena_getmark(ar);
     int x, y, b, i, n, ret;
     int diff = DIFF_BLOCK;
     int kdiff = DIFF_KSINGLE;
@@ -1680,19 +1659,19 @@ static void solver(int cr, struct block_structure *blocks,
      * Set up a usage structure as a clean slate (everything
      * possible).
      */
-    usage = snew(struct solver_usage);
+    usage = anew(ar, struct solver_usage);
     usage->cr = cr;
     usage->blocks = blocks;
     if (kblocks) {
 	usage->kblocks = dup_block_structure(kblocks);
 	usage->extra_cages = alloc_block_structure (kblocks->c, kblocks->r,
 						    cr * cr, cr, cr * cr);
-	usage->extra_clues = snewn(cr*cr, digit);
+	usage->extra_clues = anewn(ar, cr*cr, digit);
     } else {
 	usage->kblocks = usage->extra_cages = NULL;
 	usage->extra_clues = NULL;
     }
-    usage->cube = snewn(cr*cr*cr, unsigned char);
+    usage->cube = anewn(ar, cr*cr*cr, unsigned char);
     usage->grid = grid;		       /* write straight back to the input */
     if (kgrid) {
 	int nclues = kblocks->nr_blocks;
@@ -1700,7 +1679,7 @@ static void solver(int cr, struct block_structure *blocks,
 	 * Allow for expansion of the killer regions, the absolute
 	 * limit is obviously one region per square.
 	 */
-	usage->kclues = snewn(cr*cr, digit);
+	usage->kclues = anewn(ar, cr*cr, digit);
 	for (i = 0; i < nclues; i++) {
 	    for (n = 0; n < kblocks->nr_squares[i]; n++)
 		if (kgrid[kblocks->blocks[i][n]] != 0)
@@ -1714,22 +1693,22 @@ static void solver(int cr, struct block_structure *blocks,
 
     memset(usage->cube, TRUE, cr*cr*cr);
 
-    usage->row = snewn(cr * cr, unsigned char);
-    usage->col = snewn(cr * cr, unsigned char);
-    usage->blk = snewn(cr * cr, unsigned char);
+    usage->row = anewn(ar, cr * cr, unsigned char);
+    usage->col = anewn(ar, cr * cr, unsigned char);
+    usage->blk = anewn(ar, cr * cr, unsigned char);
     memset(usage->row, FALSE, cr * cr);
     memset(usage->col, FALSE, cr * cr);
     memset(usage->blk, FALSE, cr * cr);
 
     if (xtype) {
-	usage->diag = snewn(cr * 2, unsigned char);
+	usage->diag = anewn(ar, cr * 2, unsigned char);
 	memset(usage->diag, FALSE, cr * 2);
     } else
 	usage->diag = NULL; 
 
     usage->nr_regions = cr * 3 + (xtype ? 2 : 0);
-    usage->regions = snewn(cr * usage->nr_regions, int);
-    usage->sq2region = snewn(cr * cr * 3, int *);
+    usage->regions = anewn(ar, cr * usage->nr_regions, int);
+    usage->sq2region = anewn(ar, cr * cr * 3, int *);
 
     for (n = 0; n < cr; n++) {
 	for (i = 0; i < cr; i++) {
@@ -1745,7 +1724,7 @@ static void solver(int cr, struct block_structure *blocks,
 	}
     }
 
-    scratch = solver_new_scratch(usage);
+    scratch = solver_new_scratch(usage, ar);
 
     /*
      * Place all the clue numbers we are given.
@@ -2482,9 +2461,9 @@ static void solver(int cr, struct block_structure *blocks,
 	    y = best / cr;
 	    x = best % cr;
 
-	    list = snewn(cr, digit);
-	    ingrid = snewn(cr * cr, digit);
-	    outgrid = snewn(cr * cr, digit);
+	    list = anewn(ar, cr, digit);
+	    ingrid = anewn(ar, cr * cr, digit);
+	    outgrid = anewn(ar, cr * cr, digit);
 	    memcpy(ingrid, grid, cr * cr);
 
 	    /* Make a list of the possible digits. */
@@ -2520,7 +2499,7 @@ static void solver(int cr, struct block_structure *blocks,
 		solver_recurse_depth++;
 #endif
 
-		solver(cr, blocks, kblocks, xtype, outgrid, kgrid, dlev);
+		solver(cr, blocks, kblocks, xtype, outgrid, kgrid, dlev, ar);
 
 #ifdef STANDALONE_SOLVER
 		solver_recurse_depth--;
@@ -2556,10 +2535,6 @@ static void solver(int cr, struct block_structure *blocks,
 		if (diff == DIFF_AMBIGUOUS)
 		    break;
 	    }
-
-	    sfree(outgrid);
-	    sfree(ingrid);
-	    sfree(list);
 	}
 
     } else {
@@ -2587,24 +2562,384 @@ static void solver(int cr, struct block_structure *blocks,
 	       "one solution");
 #endif
 
-    sfree(usage->cube);
-    sfree(usage->row);
-    sfree(usage->col);
-    sfree(usage->blk);
     if (usage->kblocks) {
 	free_block_structure(usage->kblocks);
 	free_block_structure(usage->extra_cages);
-	sfree(usage->extra_clues);
     }
-    sfree(usage);
 
-    solver_free_scratch(scratch);
+    arena_release(ar, mark);
 }
 
 /* ----------------------------------------------------------------------
  * End of solver code.
  */
 
+/* ----------------------------------------------------------------------
+ * Exact cover solver.
+ *
+ * When all we want to know is how many solutions a grid has, the
+ * deductive solver above is a slow way to find out: at
+ * DIFF_RECURSIVE it rebuilds its whole usage structure at every
+ * guess. Knuth's Algorithm X with dancing links does the same
+ * search with nothing to undo but pointer swaps.
+ *
+ * Every candidate (square, digit) is a row of the matrix. The
+ * primary columns, each of which must be covered exactly once, are
+ * `square filled', `digit in row', `digit in column', `digit in
+ * block' and, for X puzzles, `digit in diagonal'. Killer cages add
+ * a secondary column per cage and digit, covered at most once. The
+ * cage sums can't be expressed as columns at all, so each time a
+ * digit goes into a cage we hide the rows for any digit which the
+ * rest of the cage could no longer use and still make up its clue.
+ * Without that, the column counts would never reflect the sums and
+ * a killer puzzle with no givens would take forever.
+ */
+
+struct dlx {
+    int cr;
+    /* Node links. Node 0 is the root, 1..ncols the column headers. */
+    int *l, *r, *u, *d, *col;
+    int *size;                         /* per column */
+    int *cand;                         /* per node: (xy*cr + n-1) */
+    int *first;                        /* per candidate: one of its nodes */
+    /* Killer only: cage index of each square, and per-cage state. */
+    int *whichcage, *clue, *sum, *left, cagecol;
+    unsigned char *used;               /* used[k*cr+n-1] */
+    int *hidden, nhidden;              /* rows removed by dlx_cage_filter */
+    digit *work, *soln;
+    int nsol, maxsol;
+};
+
+static void dlx_cover(struct dlx *x, int c)
+{
+    int i, j;
+
+    x->r[x->l[c]] = x->r[c];
+    x->l[x->r[c]] = x->l[c];
+    for (i = x->d[c]; i != c; i = x->d[i])
+        for (j = x->r[i]; j != i; j = x->r[j]) {
+            x->u[x->d[j]] = x->u[j];
+            x->d[x->u[j]] = x->d[j];
+            x->size[x->col[j]]--;
+        }
+}
+
+static void dlx_uncover(struct dlx *x, int c)
+{
+    int i, j;
+
+    for (i = x->u[c]; i != c; i = x->u[i])
+        for (j = x->l[i]; j != i; j = x->l[j]) {
+            x->size[x->col[j]]++;
+            x->u[x->d[j]] = j;
+            x->d[x->u[j]] = j;
+        }
+    x->r[x->l[c]] = c;
+    x->l[x->r[c]] = c;
+}
+
+/* Take a row out of every column it is in, or put it back. */
+static void dlx_hide(struct dlx *x, int i)
+{
+    int j = i;
+
+    do {
+        x->u[x->d[j]] = x->u[j];
+        x->d[x->u[j]] = x->d[j];
+        x->size[x->col[j]]--;
+        j = x->r[j];
+    } while (j != i);
+}
+
+static void dlx_unhide(struct dlx *x, int i)
+{
+    int j = i;
+
+    do {
+        j = x->l[j];
+        x->size[x->col[j]]++;
+        x->u[x->d[j]] = j;
+        x->d[x->u[j]] = j;
+    } while (j != i);
+}
+
+/*
+ * Add digit n to the cage containing square xy, and return FALSE
+ * if that leaves the cage unable to meet its clue. The addition is
+ * made either way; dlx_cage_remove() takes it back.
+ */
+static int dlx_cage_add(struct dlx *x, int xy, int n)
+{
+    int k, left, need;
+
+    if (!x->whichcage)
+        return TRUE;
+    k = x->whichcage[xy];
+    x->used[k*x->cr + n-1] = TRUE;
+    x->sum[k] += n;
+    left = --x->left[k];
+    need = x->clue[k] - x->sum[k];
+
+    /* `left' distinct digits sum to between these two bounds. */
+    return need >= left * (left+1) / 2 &&
+        need <= left * (2*x->cr - left + 1) / 2;
+}
+
+static void dlx_cage_remove(struct dlx *x, int xy, int n)
+{
+    int k;
+
+    if (!x->whichcage)
+        return;
+    k = x->whichcage[xy];
+    x->used[k*x->cr + n-1] = FALSE;
+    x->sum[k] -= n;
+    x->left[k]++;
+}
+
+/*
+ * Hide the remaining rows of cage k for every digit n such that the
+ * cage's other empty squares, filled with distinct unused digits
+ * other than n, could not make up what is left of the clue. The
+ * hidden rows go on x->hidden for the caller to restore.
+ */
+static void dlx_cage_filter(struct dlx *x, int k)
+{
+    int cr = x->cr, left = x->left[k], need = x->clue[k] - x->sum[k];
+    unsigned char *used = x->used + k*cr;
+    int n, d, m, lo, hi, c, i;
+
+    if (left == 0)
+        return;
+
+    for (n = 0; n < cr; n++) {
+        if (used[n])
+            continue;
+
+        lo = hi = 0;
+        for (d = 0, m = 0; d < cr && m < left-1; d++)
+            if (!used[d] && d != n) {
+                lo += d+1;
+                m++;
+            }
+        for (d = cr-1, m = 0; d >= 0 && m < left-1; d--)
+            if (!used[d] && d != n) {
+                hi += d+1;
+                m++;
+            }
+
+        if (m < left-1 || need - (n+1) < lo || need - (n+1) > hi) {
+            c = x->cagecol + k*cr + n;
+            for (i = x->d[c]; i != c; i = x->d[i]) {
+                dlx_hide(x, i);
+                x->hidden[x->nhidden++] = i;
+            }
+        }
+    }
+}
+
+/* Returns TRUE once we have found as many solutions as we want. */
+static int dlx_search(struct dlx *x)
+{
+    int c, i, j, best;
+
+    if (x->r[0] == 0) {
+        if (x->nsol++ == 0)
+            memcpy(x->soln, x->work, x->cr * x->cr);
+        return x->nsol >= x->maxsol;
+    }
+
+    /* Knuth's heuristic: branch on the column with fewest rows. */
+    best = x->r[0];
+    for (c = x->r[best]; c != 0; c = x->r[c])
+        if (x->size[c] < x->size[best])
+            best = c;
+    if (x->size[best] == 0)
+        return FALSE;
+
+    dlx_cover(x, best);
+    for (i = x->d[best]; i != best; i = x->d[i]) {
+        int xy = x->cand[i] / x->cr, n = x->cand[i] % x->cr + 1;
+        int done = FALSE;
+
+        if (dlx_cage_add(x, xy, n)) {
+            int mark = x->nhidden;
+
+            x->work[xy] = n;
+            for (j = x->r[i]; j != i; j = x->r[j])
+                dlx_cover(x, x->col[j]);
+            if (x->whichcage)
+                dlx_cage_filter(x, x->whichcage[xy]);
+            done = dlx_search(x);
+            while (x->nhidden > mark)
+                dlx_unhide(x, x->hidden[--x->nhidden]);
+            for (j = x->l[i]; j != i; j = x->l[j])
+                dlx_uncover(x, x->col[j]);
+        }
+        dlx_cage_remove(x, xy, n);
+        if (done) {
+            dlx_uncover(x, best);
+            return TRUE;
+        }
+    }
+    dlx_uncover(x, best);
+
+    return FALSE;
+}
+
+/*
+ * Count the solutions of a puzzle, stopping once we reach maxsol.
+ * So maxsol == 2 answers `is this puzzle unique?'. If there are any
+ * solutions, the first one found is written back into grid.
+ * Working memory comes from `ar' as for solver().
+ */
+static int dlx_solve(int cr, struct block_structure *blocks,
+                     struct block_structure *kblocks, int xtype,
+                     digit *grid, digit *kgrid, int maxsol, arena *ar)
+{
+    arena_mark mark = arena_getmark(ar);
+    int area = cr*cr, ncands = area*cr;
+    int nprimary = 4*area + (xtype ? 2*cr : 0);
+    int ncols = nprimary + (kblocks ? kblocks->nr_blocks * cr : 0);
+    int nnodes = 1 + ncols + ncands * (4 + (xtype ? 2 : 0) + (kblocks ? 1 : 0));
+    int cols[7], ncol;
+    int i, j, k, n, xy, node, ret;
+    unsigned char *covered;
+    struct dlx *x;
+
+    x = anew(ar, struct dlx);
+    x->cr = cr;
+    x->l = anewn(ar, nnodes, int);
+    x->r = anewn(ar, nnodes, int);
+    x->u = anewn(ar, nnodes, int);
+    x->d = anewn(ar, nnodes, int);
+    x->col = anewn(ar, nnodes, int);
+    x->cand = anewn(ar, nnodes, int);
+    x->size = anewn(ar, ncols+1, int);
+    x->first = anewn(ar, ncands, int);
+    x->work = anewn(ar, area, digit);
+    x->soln = anewn(ar, area, digit);
+    x->nsol = 0;
+    x->maxsol = maxsol;
+
+    /*
+     * Column headers. Secondary columns are left out of the root's
+     * list, so that the search never needs to cover them.
+     */
+    for (i = 0; i <= ncols; i++) {
+        x->u[i] = x->d[i] = x->col[i] = i;
+        x->size[i] = 0;
+        if (i <= nprimary) {
+            x->l[i] = (i == 0 ? nprimary : i-1);
+            x->r[i] = (i == nprimary ? 0 : i+1);
+        } else
+            x->l[i] = x->r[i] = i;
+    }
+
+    /*
+     * One row per candidate.
+     */
+    node = ncols + 1;
+    for (xy = 0; xy < area; xy++) {
+        int y = xy / cr, xx = xy % cr, b = blocks->whichblock[xy];
+
+        for (n = 0; n < cr; n++) {
+            ncol = 0;
+            cols[ncol++] = 1 + xy;
+            cols[ncol++] = 1 + area + y*cr + n;
+            cols[ncol++] = 1 + 2*area + xx*cr + n;
+            cols[ncol++] = 1 + 3*area + b*cr + n;
+            if (xtype && ondiag0(xy))
+                cols[ncol++] = 1 + 4*area + n;
+            if (xtype && ondiag1(xy))
+                cols[ncol++] = 1 + 4*area + cr + n;
+            if (kblocks)
+                cols[ncol++] = 1 + nprimary + kblocks->whichblock[xy]*cr + n;
+
+            x->first[xy*cr+n] = node;
+            for (j = 0; j < ncol; j++, node++) {
+                int c = cols[j];
+                x->col[node] = c;
+                x->cand[node] = xy*cr+n;
+                x->l[node] = (j == 0 ? node + ncol-1 : node-1);
+                x->r[node] = (j == ncol-1 ? node - (ncol-1) : node+1);
+                x->u[node] = x->u[c];
+                x->d[node] = c;
+                x->d[x->u[c]] = node;
+                x->u[c] = node;
+                x->size[c]++;
+            }
+        }
+    }
+    assert(node <= nnodes);
+
+    if (kblocks) {
+        x->whichcage = kblocks->whichblock;
+        x->cagecol = 1 + nprimary;
+        x->used = anewn(ar, kblocks->nr_blocks * cr, unsigned char);
+        memset(x->used, 0, kblocks->nr_blocks * cr);
+        x->hidden = anewn(ar, ncands, int);
+        x->nhidden = 0;
+        x->clue = anewn(ar, kblocks->nr_blocks, int);
+        x->sum = anewn(ar, kblocks->nr_blocks, int);
+        x->left = anewn(ar, kblocks->nr_blocks, int);
+        for (k = 0; k < kblocks->nr_blocks; k++) {
+            x->clue[k] = 0;
+            x->sum[k] = 0;
+            x->left[k] = kblocks->nr_squares[k];
+            for (i = 0; i < kblocks->nr_squares[k]; i++)
+                if (kgrid[kblocks->blocks[k][i]])
+                    x->clue[k] = kgrid[kblocks->blocks[k][i]];
+        }
+    } else
+        x->whichcage = NULL;
+
+    /*
+     * Select the rows for the clues we were given. Two clues wanting
+     * the same column means the grid is already inconsistent.
+     */
+    covered = anewn(ar, ncols+1, unsigned char);
+    memset(covered, 0, ncols+1);
+    ret = -1;
+    for (xy = 0; xy < area; xy++) {
+        x->work[xy] = grid[xy];
+        if (grid[xy]) {
+            int first = x->first[xy*cr + grid[xy]-1];
+
+            j = first;
+            do {
+                if (covered[x->col[j]])
+                    ret = 0;
+                covered[x->col[j]] = TRUE;
+                j = x->r[j];
+            } while (j != first);
+            if (!dlx_cage_add(x, xy, grid[xy]))
+                ret = 0;
+            if (ret == 0)
+                break;
+
+            j = first;
+            do {
+                dlx_cover(x, x->col[j]);
+                j = x->r[j];
+            } while (j != first);
+        }
+    }
+
+    if (ret < 0) {
+        if (kblocks)
+            for (k = 0; k < kblocks->nr_blocks; k++)
+                dlx_cage_filter(x, k);
+        dlx_search(x);
+        ret = x->nsol;
+        if (ret > 0)
+            memcpy(grid, x->soln, area);
+    }
+
+    arena_release(ar, mark);
+    return ret;
+}
+
 /* ----------------------------------------------------------------------
  * Killer set generator.
  */
@@ -3453,27 +3788,152 @@ static struct block_structure *gen_killer_cages(int cr, random_state *rs,
     return b;
 }
 
+/*
+ * TRUE if digit n is already in some region containing square xy
+ * (other than xy itself).
+ */
+static int refill_sees(int cr, struct block_structure *blocks, int xtype,
+                       digit *grid, int xy, int n)
+{
+    int x = xy % cr, y = xy / cr, b = blocks->whichblock[xy], i;
+
+    for (i = 0; i < cr; i++)
+        if (grid[y*cr+i] == n || grid[i*cr+x] == n ||
+            grid[blocks->blocks[b][i]] == n)
+            return TRUE;
+    if (xtype && ondiag0(xy))
+        for (i = 0; i < cr; i++)
+            if (grid[diag0(i)] == n)
+                return TRUE;
+    if (xtype && ondiag1(xy))
+        for (i = 0; i < cr; i++)
+            if (grid[diag1(i)] == n)
+                return TRUE;
+    return FALSE;
+}
+
+/*
+ * TRUE if digit n can go nowhere in region `squares' but square xy:
+ * every other empty square in it already sees an n.
+ */
+static int refill_only_place(int cr, struct block_structure *blocks,
+                             int xtype, digit *grid, int *squares,
+                             int xy, int n)
+{
+    int i, t;
+
+    for (i = 0; i < cr; i++) {
+        t = squares[i];
+        if (t != xy && !grid[t] &&
+            !refill_sees(cr, blocks, xtype, grid, t, n))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Cheap test for the clue-removal loop in new_game_desc. `grid' is
+ * the current puzzle with the squares listed in `removed' blanked
+ * out, and `solution' the full grid. If singles alone fill all of
+ * those squares back in, the blanked grid reaches the current one
+ * by deductions the solver tries before anything else, so it is
+ * exactly as hard to solve as the current grid, and we needn't run
+ * the solver at all.
+ *
+ * Singles within a block are DIFF_BLOCK deductions, and are always
+ * allowed. Singles in rows, columns and diagonals, and squares with
+ * only one possible digit, are DIFF_SIMPLE ones, and are only
+ * allowed if `simple' is set. We only look for singles in the
+ * removed squares themselves, which keeps this much cheaper than a
+ * solver run while still catching most removals early on.
+ *
+ * Returns TRUE if every removed square came back; FALSE means we
+ * don't know, and the caller must run a real solver. Either way
+ * `grid' is left as it was passed in.
+ */
+static int refill_by_singles(int cr, struct block_structure *blocks,
+                             int xtype, int simple, digit *grid,
+                             digit *solution, int *removed, int nremoved)
+{
+    int i, m, nleft = nremoved, progress;
+    int rows[ORDER_MAX], cols[ORDER_MAX];
+
+    do {
+        progress = FALSE;
+        for (i = 0; i < nremoved; i++) {
+            int xy = removed[i], n = solution[xy];
+            int x = xy % cr, y = xy / cr, b = blocks->whichblock[xy];
+            int found;
+
+            if (grid[xy])
+                continue;
+
+            found = refill_only_place(cr, blocks, xtype, grid,
+                                      blocks->blocks[b], xy, n);
+            if (!found && simple) {
+                for (m = 0; m < cr; m++) {
+                    rows[m] = y*cr+m;
+                    cols[m] = m*cr+x;
+                }
+                found = (refill_only_place(cr, blocks, xtype, grid,
+                                           rows, xy, n) ||
+                         refill_only_place(cr, blocks, xtype, grid,
+                                           cols, xy, n));
+                if (!found && xtype && ondiag0(xy)) {
+                    for (m = 0; m < cr; m++)
+                        rows[m] = diag0(m);
+                    found = refill_only_place(cr, blocks, xtype, grid,
+                                              rows, xy, n);
+                }
+                if (!found && xtype && ondiag1(xy)) {
+                    for (m = 0; m < cr; m++)
+                        rows[m] = diag1(m);
+                    found = refill_only_place(cr, blocks, xtype, grid,
+                                              rows, xy, n);
+                }
+                if (!found) {
+                    for (m = 1; m <= cr; m++)
+                        if (m != n &&
+                            !refill_sees(cr, blocks, xtype, grid, xy, m))
+                            break;
+                    found = (m > cr);
+                }
+            }
+
+            if (found) {
+                grid[xy] = n;
+                nleft--;
+                progress = TRUE;
+            }
+        }
+    } while (progress && nleft > 0);
+
+    for (i = 0; i < nremoved; i++)
+        grid[removed[i]] = 0;
+
+    return nleft == 0;
+}
+
 static char *new_game_desc(game_params *params, random_state *rs,
 			   char **aux, int interactive)
 {
     int c = params->c, r = params->r, cr = c*r;
     int area = cr*cr;
     struct block_structure *blocks, *kblocks;
-    digit *grid, *grid2, *kgrid;
+    digit *grid, *grid2, *grid3, *kgrid;
     struct xy { int x, y; } *locs;
     int nlocs;
     char *desc;
-    int coords[16], ncoords;
-    int x, y, i, j;
+    int coords[16], ncoords, removed[8];
+    int x, y, i, j, ok;
     struct difficulty dlev;
+    arena *ar;
 
     extern int max_digit_to_input;
     extern int min_digit_to_input;
     max_digit_to_input=cr;
     min_digit_to_input=1;
 
-    precompute_sum_bits();
-
     /*
      * Adjust the maximum difficulty level to be consistent with
      * the puzzle size: all 2x2 puzzles appear to be Trivial
@@ -3488,6 +3948,8 @@ static char *new_game_desc(game_params *params, random_state *rs,
     grid = snewn(area, digit);
     locs = snewn(area, struct xy);
     grid2 = snewn(area, digit);
+    grid3 = snewn(area, digit);
+    ar = arena_new();	       /* shared by every solver run below */
 
     blocks = alloc_block_structure (c, r, area, cr, cr);
 
@@ -3568,7 +4030,8 @@ static char *new_game_desc(game_params *params, random_state *rs,
 		compute_kclues(kblocks, kgrid, grid2, area);
 
 		memset(grid, 0, area * sizeof *grid);
-		solver(cr, blocks, kblocks, params->xtype, grid, kgrid, &dlev);
+		solver(cr, blocks, kblocks, params->xtype, grid, kgrid, &dlev,
+		       ar);
 		if (dlev.diff == dlev.maxdiff && dlev.kdiff == dlev.maxkdiff) {
 		    /*
 		     * We have one that matches our difficulty.  Store it for
@@ -3661,12 +4124,45 @@ static char *new_game_desc(game_params *params, random_state *rs,
 
             memcpy(grid2, grid, area);
             ncoords = symmetries(params, x, y, coords, params->symm);
-            for (j = 0; j < ncoords; j++)
-                grid2[coords[2*j+1]*cr+coords[2*j]] = 0;
+            for (j = 0; j < ncoords; j++) {
+                removed[j] = coords[2*j+1]*cr+coords[2*j];
+                grid2[removed[j]] = 0;
+            }
 
-            solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev);
-            if (dlev.diff <= dlev.maxdiff &&
-		(!params->killer || dlev.kdiff <= dlev.maxkdiff)) {
+            if (refill_by_singles(cr, blocks, params->xtype,
+                                  dlev.maxdiff >= DIFF_SIMPLE, grid2, grid,
+                                  removed, ncoords)) {
+                ok = TRUE;
+            } else if (dlev.maxdiff >= DIFF_RECURSIVE) {
+                /*
+                 * With recursion allowed, the solver accepts exactly
+                 * the grids with one solution, and the exact cover
+                 * solver can tell us that much faster.
+                 */
+                ok = (dlx_solve(cr, blocks, kblocks, params->xtype, grid2,
+                                kgrid, 2, ar) == 1);
+            } else {
+                /*
+                 * From Intermediate up, the solver can take a long
+                 * time to give up on a grid which has become
+                 * ambiguous, and the exact cover solver rules those
+                 * out far more quickly. Below that, the solver gives
+                 * up quickly enough by itself.
+                 */
+                ok = TRUE;
+                if (dlev.maxdiff >= DIFF_INTERSECT) {
+                    memcpy(grid3, grid2, area);
+                    ok = (dlx_solve(cr, blocks, kblocks, params->xtype,
+                                    grid3, kgrid, 2, ar) == 1);
+                }
+                if (ok) {
+                    solver(cr, blocks, kblocks, params->xtype, grid2, kgrid,
+                           &dlev, ar);
+                    ok = (dlev.diff <= dlev.maxdiff &&
+                          (!params->killer || dlev.kdiff <= dlev.maxkdiff));
+                }
+            }
+            if (ok) {
                 for (j = 0; j < ncoords; j++)
                     grid[coords[2*j+1]*cr+coords[2*j]] = 0;
             }
@@ -3674,12 +4170,14 @@ static char *new_game_desc(game_params *params, random_state *rs,
 
         memcpy(grid2, grid, area);
 
-	solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev);
+	solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev, ar);
 	if (dlev.diff == dlev.maxdiff &&
 	    (!params->killer || dlev.kdiff == dlev.maxkdiff))
 	    break;		       /* found one! */
     }
 
+    arena_free(ar);
+    sfree(grid3);
     sfree(grid2);
     sfree(locs);
 
@@ -3945,8 +4443,6 @@ static game_state *new_game(midend *me, game_params *params, char *desc)
     int c = params->c, r = params->r, cr = c*r, area = cr * cr;
     int i;
 
-    precompute_sum_bits();
-
     state->cr = cr;
     state->xtype = params->xtype;
     state->killer = params->killer;
@@ -4097,6 +4593,7 @@ static char *solve_game(game_state *state, game_state *currstate,
     char *ret;
     digit *grid;
     struct difficulty dlev;
+    arena *ar;
 
     /*
      * If we already have the solution in ai, save ourselves some
@@ -4109,8 +4606,10 @@ static char *solve_game(game_state *state, game_state *currstate,
     memcpy(grid, state->grid, cr*cr);
     dlev.maxdiff = DIFF_RECURSIVE;
     dlev.maxkdiff = DIFF_KINTERSECT;
+    ar = arena_new();
     solver(cr, state->blocks, state->kblocks, state->xtype, grid,
-	   state->kgrid, &dlev);
+	   state->kgrid, &dlev, ar);
+    arena_free(ar);
 
     *error = NULL;
 
@@ -4412,7 +4911,7 @@ struct game_drawstate {
     digit *grid;
     unsigned char *pencil;
     unsigned char *hl;
-    /* This is scratch space used within a single call to game_redraw. */
+    /* Scratch space used within a single call to game_redraw. */
     int *entered_items;
 };
 
@@ -4661,6 +5160,16 @@ static void game_free_drawstate(drawing *dr, game_drawstate *ds)
     sfree(ds);
 }
 
+static int number_needs_drawing(game_drawstate *ds, game_state *state,
+				int x, int y, int hl)
+{
+    int cr = state->cr;
+
+    return !(ds->grid[y*cr+x] == state->grid[y*cr+x] &&
+	     ds->hl[y*cr+x] == hl &&
+	     !memcmp(ds->pencil+(y*cr+x)*cr, state->pencil+(y*cr+x)*cr, cr));
+}
+
 static void draw_number(drawing *dr, game_drawstate *ds, game_state *state,
 			int x, int y, int hl)
 {
@@ -4670,9 +5179,7 @@ static void draw_number(drawing *dr, game_drawstate *ds, game_state *state,
     int col_killer = (hl & 32 ? COL_ERROR : COL_KILLER);
     char str[20];
 
-    if (ds->grid[y*cr+x] == state->grid[y*cr+x] &&
-        ds->hl[y*cr+x] == hl &&
-        !memcmp(ds->pencil+(y*cr+x)*cr, state->pencil+(y*cr+x)*cr, cr))
+    if (!number_needs_drawing(ds, state, x, y, hl))
 	return;			       /* no change required */
 
     tx = BORDER + x * TILE_SIZE + 1 + GRIDEXTRA;
@@ -4944,6 +5451,135 @@ static void draw_number(drawing *dr, game_drawstate *ds, game_state *state,
     ds->hl[y*cr+x] = hl;
 }
 
+/*
+ * Fill in `entered' (cr*cr entries: ds->entered_items when called
+ * from game_redraw, a temporary array from game_redraw_region),
+ * which keeps track of rows, columns and boxes which contain a
+ * number more than once. ds itself is only read.
+ */
+static void find_repeated_items(int *entered, game_drawstate *ds,
+				game_state *state)
+{
+    int cr = state->cr;
+    int x, y;
+
+    for (x = 0; x < cr * cr; x++)
+	entered[x] = 0;
+    for (x = 0; x < cr; x++)
+	for (y = 0; y < cr; y++) {
+	    digit d = state->grid[y*cr+x];
+	    if (d) {
+		int box = state->blocks->whichblock[y*cr+x];
+ 		entered[x*cr+d-1] |= ((entered[x*cr+d-1] & 1) << 1) | 1;
+		entered[y*cr+d-1] |= ((entered[y*cr+d-1] & 4) << 1) | 4;
+		entered[box*cr+d-1] |= ((entered[box*cr+d-1] & 16) << 1) | 16;
+		if (ds->xtype) {
+		    if (ondiag0(y*cr+x))
+			entered[d-1] |= ((entered[d-1] & 64) << 1) | 64;
+		    if (ondiag1(y*cr+x))
+			entered[cr+d-1] |= ((entered[cr+d-1] & 64) << 1) | 64;
+		}
+	    }
+	}
+}
+
+/*
+ * Work out the highlight flags draw_number() should use for square
+ * (x,y). entered must have been filled in by find_repeated_items().
+ */
+static int cell_highlight(int *entered, game_drawstate *ds,
+			  game_state *state, game_ui *ui,
+			  float flashtime, int x, int y)
+{
+    int cr = state->cr;
+    int highlight = 0;
+    digit d = state->grid[y*cr+x];
+
+    if (flashtime > 0 &&
+	(flashtime <= FLASH_TIME/3 ||
+	 flashtime >= FLASH_TIME*2/3))
+	highlight = 1;
+
+    /* Highlight active input areas. */
+    if (x == ui->hx && y == ui->hy && ui->hshow)
+	highlight = ui->hpencil ? 2 : 1;
+
+    /* Mark obvious errors (ie, numbers which occur more than once
+     * in a single row, column, or box). */
+    if (d && ((entered[x*cr+d-1] & 2) ||
+	      (entered[y*cr+d-1] & 8) ||
+	      (entered[state->blocks->whichblock[y*cr+x]*cr+d-1] & 32) ||
+	      (ds->xtype && ((ondiag0(y*cr+x) && (entered[d-1] & 128)) ||
+			     (ondiag1(y*cr+x) && (entered[cr+d-1] & 128))))))
+	highlight |= 16;
+
+    if (d && state->kblocks) {
+	int i, b = state->kblocks->whichblock[y*cr+x];
+	int n_squares = state->kblocks->nr_squares[b];
+	int sum = 0, clue = 0;
+	for (i = 0; i < n_squares; i++) {
+	    int xy = state->kblocks->blocks[b][i];
+	    if (state->grid[xy] == 0)
+		break;
+
+	    sum += state->grid[xy];
+	    if (state->kgrid[xy]) {
+		assert(clue == 0);
+		clue = state->kgrid[xy];
+	    }
+	}
+
+	if (i == n_squares) {
+	    assert(clue != 0);
+	    if (sum != clue)
+		highlight |= 32;
+	}
+    }
+
+    return highlight;
+}
+
+static int game_redraw_region(game_drawstate *ds, game_state *oldstate,
+			      game_state *state, int dir, game_ui *ui,
+			      float animtime, float flashtime,
+			      int *rx, int *ry, int *rw, int *rh)
+{
+    int cr = state->cr;
+    int x, y, x0 = cr, y0 = cr, x1 = -1, y1 = -1;
+    int *entered;
+
+    if (!ds->started) {
+	*rx = *ry = 0;
+	*rw = *rh = SIZE(cr);
+	return TRUE;
+    }
+
+    /*
+     * We mustn't modify ds here, so work out the repeated items
+     * into a scratch array rather than ds->entered_items.
+     */
+    entered = snewn(cr*cr, int);
+    find_repeated_items(entered, ds, state);
+    for (x = 0; x < cr; x++)
+	for (y = 0; y < cr; y++)
+	    if (number_needs_drawing(ds, state, x, y,
+				     cell_highlight(entered, ds, state, ui,
+						    flashtime, x, y))) {
+		x0 = min(x0, x); x1 = max(x1, x);
+		y0 = min(y0, y); y1 = max(y1, y);
+	    }
+    sfree(entered);
+
+    if (x1 < 0)
+	return FALSE;
+
+    *rx = BORDER + x0 * TILE_SIZE;
+    *ry = BORDER + y0 * TILE_SIZE;
+    *rw = (x1 - x0 + 1) * TILE_SIZE + 1;
+    *rh = (y1 - y0 + 1) * TILE_SIZE + 1;
+    return TRUE;
+}
+
 static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
 			game_state *state, int dir, game_ui *ui,
 			float animtime, float flashtime)
@@ -4970,79 +5606,16 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
 		  COL_GRID);
     }
 
-    /*
-     * This array is used to keep track of rows, columns and boxes
-     * which contain a number more than once.
-     */
-    for (x = 0; x < cr * cr; x++)
-	ds->entered_items[x] = 0;
-    for (x = 0; x < cr; x++)
-	for (y = 0; y < cr; y++) {
-	    digit d = state->grid[y*cr+x];
-	    if (d) {
-		int box = state->blocks->whichblock[y*cr+x];
- 		ds->entered_items[x*cr+d-1] |= ((ds->entered_items[x*cr+d-1] & 1) << 1) | 1;
-		ds->entered_items[y*cr+d-1] |= ((ds->entered_items[y*cr+d-1] & 4) << 1) | 4;
-		ds->entered_items[box*cr+d-1] |= ((ds->entered_items[box*cr+d-1] & 16) << 1) | 16;
-		if (ds->xtype) {
-		    if (ondiag0(y*cr+x))
-			ds->entered_items[d-1] |= ((ds->entered_items[d-1] & 64) << 1) | 64;
-		    if (ondiag1(y*cr+x))
-			ds->entered_items[cr+d-1] |= ((ds->entered_items[cr+d-1] & 64) << 1) | 64;
-		}
-	    }
-	}
+    find_repeated_items(ds->entered_items, ds, state);
 
     /*
      * Draw any numbers which need redrawing.
      */
     for (x = 0; x < cr; x++) {
 	for (y = 0; y < cr; y++) {
-            int highlight = 0;
-            digit d = state->grid[y*cr+x];
-
-            if (flashtime > 0 &&
-                (flashtime <= FLASH_TIME/3 ||
-                 flashtime >= FLASH_TIME*2/3))
-                highlight = 1;
-
-            /* Highlight active input areas. */
-            if (x == ui->hx && y == ui->hy && ui->hshow)
-                highlight = ui->hpencil ? 2 : 1;
-
-	    /* Mark obvious errors (ie, numbers which occur more than once
-	     * in a single row, column, or box). */
-	    if (d && ((ds->entered_items[x*cr+d-1] & 2) ||
-		      (ds->entered_items[y*cr+d-1] & 8) ||
-		      (ds->entered_items[state->blocks->whichblock[y*cr+x]*cr+d-1] & 32) ||
-		      (ds->xtype && ((ondiag0(y*cr+x) && (ds->entered_items[d-1] & 128)) ||
-				     (ondiag1(y*cr+x) && (ds->entered_items[cr+d-1] & 128))))))
-		highlight |= 16;
-
-	    if (d && state->kblocks) {
-		int i, b = state->kblocks->whichblock[y*cr+x];
-		int n_squares = state->kblocks->nr_squares[b];
-		int sum = 0, clue = 0;
-		for (i = 0; i < n_squares; i++) {
-		    int xy = state->kblocks->blocks[b][i];
-		    if (state->grid[xy] == 0)
-			break;
-
-		    sum += state->grid[xy];
-		    if (state->kgrid[xy]) {
-			assert(clue == 0);
-			clue = state->kgrid[xy];
-		    }
-		}
-
-		if (i == n_squares) {
-		    assert(clue != 0);
-		    if (sum != clue)
-			highlight |= 32;
-		}
-	    }
-
-	    draw_number(dr, ds, state, x, y, highlight);
+	    draw_number(dr, ds, state, x, y,
+			cell_highlight(ds->entered_items, ds, state, ui,
+				       flashtime, x, y));
 	}
     }
 
@@ -5105,17 +5678,19 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILE_SIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    game_redraw_region,
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    REQUIRE_RBUTTON | REQUIRE_NUMPAD,  /* flags */
+    REQUIRE_RBUTTON | REQUIRE_NUMPAD | FAST_RANDOM,  /* flags */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -5125,8 +5700,9 @@ int main(int argc, char **argv)
     game_params *p;
     game_state *s;
     char *id = NULL, *desc, *err;
-    int grade = FALSE;
+    int grade = FALSE, count = FALSE, nsol = 0;
     struct difficulty dlev;
+    arena *ar;
 
     while (--argc > 0) {
         char *p = *++argv;
@@ -5134,6 +5710,8 @@ int main(int argc, char **argv)
             solver_show_working = TRUE;
         } else if (!strcmp(p, "-g")) {
             grade = TRUE;
+        } else if (!strcmp(p, "-c")) {
+            count = TRUE;
         } else if (*p == '-') {
             fprintf(stderr, "%s: unrecognised option `%s'\n", argv[0], p);
             return 1;
@@ -5143,7 +5721,7 @@ int main(int argc, char **argv)
     }
 
     if (!id) {
-        fprintf(stderr, "usage: %s [-g | -v] <game_id>\n", argv[0]);
+        fprintf(stderr, "usage: %s [-g | -v | -c] <game_id>\n", argv[0]);
         return 1;
     }
 
@@ -5165,8 +5743,21 @@ int main(int argc, char **argv)
 
     dlev.maxdiff = DIFF_RECURSIVE;
     dlev.maxkdiff = DIFF_KINTERSECT;
-    solver(s->cr, s->blocks, s->kblocks, s->xtype, s->grid, s->kgrid, &dlev);
-    if (grade) {
+    ar = arena_new();
+    if (count)
+        nsol = dlx_solve(s->cr, s->blocks, s->kblocks, s->xtype, s->grid,
+                         s->kgrid, 2, ar);
+    else
+        solver(s->cr, s->blocks, s->kblocks, s->xtype, s->grid, s->kgrid,
+               &dlev, ar);
+    arena_free(ar);
+    if (count) {
+        printf("%s\n", nsol == 0 ? "No solution" :
+               nsol == 1 ? "Unique solution" : "Multiple solutions");
+        if (nsol > 0)
+            printf("%s\n", grid_text_format(s->cr, s->blocks, s->xtype,
+                                            s->grid));
+    } else if (grade) {
 	printf("Difficulty rating: %s\n",
 	       dlev.diff==DIFF_BLOCK ? "Trivial (blockwise positional elimination only)":
 	       dlev.diff==DIFF_SIMPLE ? "Basic (row/column/number elimination required)":
@@ -1965,6 +1965,29 @@ static void draw_tile(drawing *dr, game_drawstate *ds,
 /*
  * Internal redraw function, used for printing as well as drawing.
  */
+/*
+ * Work out what draw_tile() should show for square (x,y).
+ */
+static int tile_value(game_state *state, game_ui *ui, int x, int y,
+                      int flashing)
+{
+    int v = state->grid[y*state->p.w+x];
+
+    /*
+     * We deliberately do not take drag_ok into account
+     * here, because user feedback suggests that it's
+     * marginally nicer not to have the drag effects
+     * flickering on and off disconcertingly.
+     */
+    if (ui && ui->drag_button >= 0)
+        v = drag_xform(ui, x, y, v);
+
+    if (flashing && (v == TREE || v == TENT))
+        v = NONTENT;
+
+    return v;
+}
+
 static void int_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
 		       game_state *state, int dir, game_ui *ui,
 		       float animtime, float flashtime, int printing)
@@ -2028,21 +2051,9 @@ static void int_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
      */
     for (y = 0; y < h; y++)
         for (x = 0; x < w; x++) {
-            int v = state->grid[y*w+x];
+            int v = tile_value(state, ui, x, y, flashing);
             int credraw = 0;
 
-            /*
-             * We deliberately do not take drag_ok into account
-             * here, because user feedback suggests that it's
-             * marginally nicer not to have the drag effects
-             * flickering on and off disconcertingly.
-             */
-            if (ui && ui->drag_button >= 0)
-                v = drag_xform(ui, x, y, v);
-
-            if (flashing && (v == TREE || v == TENT))
-                v = NONTENT;
-
             if (cmoved) {
               if ((x == cx && y == cy) ||
                   (x == ds->cx && y == ds->cy)) credraw = 1;
@@ -2064,6 +2075,48 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
     int_redraw(dr, ds, oldstate, state, dir, ui, animtime, flashtime, FALSE);
 }
 
+static int game_redraw_region(game_drawstate *ds, game_state *oldstate,
+			      game_state *state, int dir, game_ui *ui,
+			      float animtime, float flashtime,
+			      int *rx, int *ry, int *rw, int *rh)
+{
+    int w = state->p.w, h = state->p.h;
+    int x, y, flashing, cx = -1, cy = -1, cmoved;
+    int x0 = w, y0 = h, x1 = -1, y1 = -1;
+
+    if (!ds->started) {
+	*rx = *ry = 0;
+	game_compute_size(&state->p, TILESIZE, rw, rh);
+	return TRUE;
+    }
+
+    if (ui->cdisp) { cx = ui->cx; cy = ui->cy; }
+    cmoved = (cx != ds->cx || cy != ds->cy);
+    if (flashtime > 0)
+	flashing = (int)(flashtime * 3 / FLASH_TIME) != 1;
+    else
+	flashing = FALSE;
+
+    /* This must agree exactly with the tile loop in int_redraw. */
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            if (ds->drawn[y*w+x] != tile_value(state, ui, x, y, flashing) ||
+                (cmoved && ((x == cx && y == cy) ||
+                            (x == ds->cx && y == ds->cy)))) {
+                x0 = min(x0, x); x1 = max(x1, x);
+                y0 = min(y0, y); y1 = max(y1, y);
+            }
+
+    if (x1 < 0)
+	return FALSE;
+
+    *rx = COORD(x0);
+    *ry = COORD(y0);
+    *rw = (x1 - x0 + 1) * TILESIZE + 1;
+    *rh = (y1 - y0 + 1) * TILESIZE + 1;
+    return TRUE;
+}
+
 static float game_anim_length(game_state *oldstate, game_state *newstate,
 			      int dir, game_ui *ui)
 {
@@ -2113,11 +2166,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILESIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    game_redraw_region,
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
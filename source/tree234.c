@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "tree234.h"
@@ -43,10 +44,23 @@
 #endif
 
 typedef struct node234_Tag node234;
+typedef struct pool234_Tag pool234;
+typedef struct slab234_Tag slab234;
+typedef struct wnode234_Tag wnode234;
+typedef struct wbranch234_Tag wbranch234;
 
 struct tree234_Tag {
     node234 *root;
     cmpfn234 cmp;
+    pool234 *pool;
+    /*
+     * Trees made by newtree234_wide() leave root and pool unused,
+     * and keep their elements in a B+-tree under wroot instead.
+     */
+    int wide;
+    wnode234 *wroot;
+    keyfn234 keyfn;
+    poolstats234 wstats;
 };
 
 struct node234_Tag {
@@ -56,34 +70,886 @@ struct node234_Tag {
     void *elems[3];
 };
 
+/*
+ * Nodes are carved out of slabs belonging to a pool, rather than
+ * each being malloced separately. Freed nodes go on a free list
+ * (chained through their parent pointers) for reuse, and the slabs
+ * themselves are only released when the last tree using the pool
+ * goes away. Every node of a tree always lives in that tree's own
+ * pool, so a tree with a pool to itself can be freed without
+ * walking its nodes at all.
+ *
+ * A tree normally has a pool of its own; trees split off it, or
+ * created by newtree234_shared(), share it.
+ */
+#define SLAB234_MIN 8
+#define SLAB234_MAX 1024
+
+struct slab234_Tag {
+    slab234 *next;
+    node234 nodes[1];		       /* really more */
+};
+
+struct pool234_Tag {
+    int refcount;
+    slab234 *slabs;
+    node234 *freelist;
+    node234 *fresh;		       /* never-used tail of newest slab */
+    int nfresh, nextslab;
+    poolstats234 stats;
+};
+
+static pool234 *newpool234(void) {
+    pool234 *p = snew(pool234);
+    p->refcount = 1;
+    p->slabs = NULL;
+    p->freelist = p->fresh = NULL;
+    p->nfresh = 0;
+    p->nextslab = SLAB234_MIN;
+    p->stats.slabs = p->stats.nodes = p->stats.inuse = p->stats.peak = 0;
+    p->stats.allocs = p->stats.reused = 0;
+    return p;
+}
+
+static void unrefpool234(pool234 *p) {
+    if (--p->refcount <= 0) {
+	while (p->slabs) {
+	    slab234 *next = p->slabs->next;
+	    sfree(p->slabs);
+	    p->slabs = next;
+	}
+	sfree(p);
+    }
+}
+
+static node234 *newnode234(pool234 *p) {
+    node234 *n;
+
+    p->stats.allocs++;
+    if (p->freelist) {
+	n = p->freelist;
+	p->freelist = n->parent;
+	p->stats.reused++;
+    } else {
+	if (!p->nfresh) {
+	    slab234 *slab = (slab234 *)smalloc(sizeof(slab234) +
+					       (p->nextslab - 1) *
+					       sizeof(node234));
+	    slab->next = p->slabs;
+	    p->slabs = slab;
+	    p->fresh = slab->nodes;
+	    p->nfresh = p->nextslab;
+	    p->stats.slabs++;
+	    p->stats.nodes += p->nextslab;
+	    if (p->nextslab < SLAB234_MAX)
+		p->nextslab *= 2;
+	}
+	n = p->fresh++;
+	p->nfresh--;
+    }
+    if (++p->stats.inuse > p->stats.peak)
+	p->stats.peak = p->stats.inuse;
+    return n;
+}
+
+static void freenode234(pool234 *p, node234 *n) {
+    n->parent = p->freelist;
+    p->freelist = n;
+    p->stats.inuse--;
+}
+
+/*
+ * The wide variant: a counted B+-tree. All the elements live in
+ * the leaves, in order; each branch node holds its children
+ * together with the element count of each child and a copy of the
+ * greatest element below it, so a search can pick its way down
+ * without visiting any child it doesn't descend into. Every node
+ * holds up to WIDE234_ORDER entries, which is enough to fill a
+ * couple of cache lines with its key array and keeps the tree
+ * only a few levels deep for any realistic puzzle.
+ *
+ * If the tree has a key function, each element's key is stored
+ * alongside it, and most comparisons can be settled by comparing
+ * those without calling the tree's compare function at all.
+ *
+ * Nodes are malloced individually: there are far fewer of them
+ * than in a 2-3-4 tree of the same size.
+ */
+#define WIDE234_LINE 64			       /* assumed cache line size */
+#ifndef WIDE234_ORDER
+#define WIDE234_ORDER ((int)(2 * WIDE234_LINE / sizeof(long)))
+#endif
+#define WIDE234_MIN (WIDE234_ORDER / 2)
+#define WIDE234_MAXDEPTH 32
+
+struct wnode234_Tag {
+    int n, leaf;
+    long keys[WIDE234_ORDER];
+    void *elems[WIDE234_ORDER];	       /* in a branch, max elem of each kid */
+};
+
+struct wbranch234_Tag {
+    wnode234 node;
+    wnode234 *kids[WIDE234_ORDER];
+    int counts[WIDE234_ORDER];
+};
+
+#define WBRANCH(n) ((wbranch234 *)(n))
+
+static wnode234 *wnewnode234(tree234 *t, int leaf) {
+    wnode234 *n;
+
+    if (leaf)
+	n = snew(wnode234);
+    else
+	n = &snew(wbranch234)->node;
+    n->n = 0;
+    n->leaf = leaf;
+    t->wstats.slabs++;
+    t->wstats.nodes++;
+    t->wstats.allocs++;
+    if (++t->wstats.inuse > t->wstats.peak)
+	t->wstats.peak = t->wstats.inuse;
+    return n;
+}
+
+static void wfreenode234(tree234 *t, wnode234 *n) {
+    t->wstats.slabs--;
+    t->wstats.nodes--;
+    t->wstats.inuse--;
+    sfree(n);
+}
+
+static void wfreesubtree234(tree234 *t, wnode234 *n) {
+    int i;
+
+    if (!n)
+	return;
+    if (!n->leaf)
+	for (i = 0; i < n->n; i++)
+	    wfreesubtree234(t, WBRANCH(n)->kids[i]);
+    wfreenode234(t, n);
+}
+
+static int wcountnode234(wnode234 *n) {
+    int i, count;
+
+    if (!n)
+	return 0;
+    if (n->leaf)
+	return n->n;
+    for (i = count = 0; i < n->n; i++)
+	count += WBRANCH(n)->counts[i];
+    return count;
+}
+
+/*
+ * Bring the count and maximum recorded in a branch for one of its
+ * children back up to date. The child must not be empty.
+ */
+static void wfix234(wnode234 *n, int i) {
+    wnode234 *kid = WBRANCH(n)->kids[i];
+
+    assert(kid->n > 0);
+    WBRANCH(n)->counts[i] = wcountnode234(kid);
+    n->elems[i] = kid->elems[kid->n - 1];
+    n->keys[i] = kid->keys[kid->n - 1];
+}
+
+/*
+ * Move cnt entries (with their kids and counts, in branches)
+ * between or within nodes of the same kind.
+ */
+static void wmove234(wnode234 *dst, int di, wnode234 *src, int si, int cnt) {
+    memmove(dst->keys + di, src->keys + si, cnt * sizeof(long));
+    memmove(dst->elems + di, src->elems + si, cnt * sizeof(void *));
+    if (!src->leaf) {
+	memmove(WBRANCH(dst)->kids + di, WBRANCH(src)->kids + si,
+		cnt * sizeof(wnode234 *));
+	memmove(WBRANCH(dst)->counts + di, WBRANCH(src)->counts + si,
+		cnt * sizeof(int));
+    }
+}
+
+/*
+ * Move the upper half of a full node into a new right sibling,
+ * and return the sibling.
+ */
+static wnode234 *wsplitnode234(tree234 *t, wnode234 *n) {
+    wnode234 *sib = wnewnode234(t, n->leaf);
+    int half = n->n / 2;
+
+    wmove234(sib, 0, n, half, n->n - half);
+    sib->n = n->n - half;
+    n->n = half;
+    return sib;
+}
+
+/*
+ * State for a search through a wide tree. If `usekey' is set,
+ * `key' is the key of e and stored keys are compared first,
+ * falling back to cmp only for ties.
+ */
+typedef struct {
+    void *e;
+    cmpfn234 cmp;
+    long key;
+    int usekey;
+} wquery234;
+
+/*
+ * The route taken down a wide tree to a position in a leaf:
+ * nodes[depth] is the leaf and pos[depth] the position in it, and
+ * above that each nodes[i] is a branch and pos[i] the kid taken.
+ */
+typedef struct {
+    int depth;
+    wnode234 *nodes[WIDE234_MAXDEPTH];
+    int pos[WIDE234_MAXDEPTH];
+} wpath234;
+
+/*
+ * Return the index of the first entry in a node which is >= the
+ * search element, or n->n if there isn't one. *eq is set if that
+ * entry compares equal.
+ */
+static int wlower234(wquery234 *s, wnode234 *n, int *eq) {
+    int lo = 0, hi = n->n, mid, c;
+
+    *eq = FALSE;
+    if (s->usekey) {
+	/*
+	 * Counting the smaller keys is cheaper than a binary search
+	 * here, since it doesn't branch.
+	 */
+	for (mid = 0; mid < hi; mid++)
+	    lo += (n->keys[mid] < s->key);
+	while (lo < hi && n->keys[lo] == s->key) {
+	    c = s->cmp(s->e, n->elems[lo]);
+	    if (c <= 0) {
+		*eq = (c == 0);
+		break;
+	    }
+	    lo++;
+	}
+	return lo;
+    }
+
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	c = s->cmp(s->e, n->elems[mid]);
+	if (c > 0) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	    *eq = (c == 0);
+	}
+    }
+    return lo;
+}
+
+/*
+ * Find the way down to a numeric index. For an insertion the index
+ * may be one past the last element, and we prefer to append to a
+ * leaf rather than insert at the start of the next one.
+ */
+static void wdescend234(tree234 *t, int index, int insert, wpath234 *path) {
+    wnode234 *n = t->wroot;
+    int d = 0, i;
+
+    while (!n->leaf) {
+	if (insert)
+	    for (i = 0; i < n->n - 1 && index > WBRANCH(n)->counts[i]; i++)
+		index -= WBRANCH(n)->counts[i];
+	else
+	    for (i = 0; index >= WBRANCH(n)->counts[i]; i++)
+		index -= WBRANCH(n)->counts[i];
+	assert(d < WIDE234_MAXDEPTH - 1);
+	path->nodes[d] = n;
+	path->pos[d++] = i;
+	n = WBRANCH(n)->kids[i];
+    }
+    path->nodes[d] = n;
+    path->pos[d] = index;
+    path->depth = d;
+}
+
+/*
+ * Find the way down to the first element of a non-empty wide tree
+ * which is not less than e, returning its index. If it compares
+ * equal to e it's returned in *found; otherwise *found is NULL. If
+ * there's no such element, the path ends just past the last one.
+ */
+static int wsearch234(tree234 *t, void *e, cmpfn234 cmp, void **found,
+		      wpath234 *path) {
+    wnode234 *n = t->wroot;
+    wquery234 s;
+    int idx = 0, d = 0, i, j, eq;
+
+    s.e = e;
+    s.cmp = cmp ? cmp : t->cmp;
+    s.usekey = (t->keyfn && s.cmp == t->cmp);
+    s.key = s.usekey ? t->keyfn(e) : 0;
+
+    *found = NULL;
+    while (!n->leaf) {
+	i = wlower234(&s, n, &eq);
+	if (i == n->n) {
+	    /* e is beyond everything here: head for the very end */
+	    idx += wcountnode234(n);
+	    while (!n->leaf) {
+		path->nodes[d] = n;
+		path->pos[d++] = n->n - 1;
+		n = WBRANCH(n)->kids[n->n - 1];
+	    }
+	    path->nodes[d] = n;
+	    path->pos[d] = n->n;
+	    path->depth = d;
+	    return idx;
+	}
+	for (j = 0; j < i; j++)
+	    idx += WBRANCH(n)->counts[j];
+	assert(d < WIDE234_MAXDEPTH - 1);
+	path->nodes[d] = n;
+	path->pos[d++] = i;
+	n = WBRANCH(n)->kids[i];
+    }
+    i = wlower234(&s, n, &eq);
+    if (eq)
+	*found = n->elems[i];
+    path->nodes[d] = n;
+    path->pos[d] = i;
+    path->depth = d;
+    return idx + i;
+}
+
+static void *wide234_index(tree234 *t, int index) {
+    wnode234 *n = t->wroot;
+    int i;
+
+    if (index < 0 || index >= wcountnode234(n))
+	return NULL;
+    while (!n->leaf) {
+	for (i = 0; index >= WBRANCH(n)->counts[i]; i++)
+	    index -= WBRANCH(n)->counts[i];
+	n = WBRANCH(n)->kids[i];
+    }
+    return n->elems[index];
+}
+
+static void *wide234_findrelpos(tree234 *t, void *e, cmpfn234 cmp,
+				int relation, int *index) {
+    wpath234 path;
+    wnode234 *leaf;
+    void *ret;
+    int idx, pos;
+
+    if (!t->wroot)
+	return NULL;
+
+    if (e == NULL) {
+	assert(relation == REL234_LT || relation == REL234_GT);
+	idx = (relation == REL234_LT ? wcountnode234(t->wroot) - 1 : 0);
+	ret = wide234_index(t, idx);
+	if (ret && index) *index = idx;
+	return ret;
+    }
+
+    idx = wsearch234(t, e, cmp, &ret, &path);
+    if (ret && relation != REL234_LT && relation != REL234_GT) {
+	if (index) *index = idx;
+	return ret;
+    }
+    if (relation == REL234_EQ)
+	return NULL;
+    pos = 0;
+    if (relation == REL234_LT || relation == REL234_LE)
+	pos = -1;
+    else if (ret)
+	pos = +1;		       /* REL234_GT, skipping e itself */
+    idx += pos;
+
+    /*
+     * The element we want is usually in the same leaf; if not,
+     * look it up by index.
+     */
+    leaf = path.nodes[path.depth];
+    pos += path.pos[path.depth];
+    if (pos >= 0 && pos < leaf->n)
+	ret = leaf->elems[pos];
+    else
+	ret = wide234_index(t, idx);
+    if (ret && index) *index = idx;
+    return ret;
+}
+
+/*
+ * Insert an element at the end of a path, splitting full nodes on
+ * the way back up.
+ */
+static void winsert234(tree234 *t, wpath234 *path, void *e) {
+    wnode234 *n = path->nodes[path->depth], *sib = NULL;
+    int d = path->depth, i = path->pos[d];
+
+    if (n->n == WIDE234_ORDER) {
+	sib = wsplitnode234(t, n);
+	if (i > n->n) {
+	    i -= n->n;
+	    n = sib;
+	}
+    }
+    wmove234(n, i + 1, n, i, n->n - i);
+    n->elems[i] = e;
+    n->keys[i] = t->keyfn ? t->keyfn(e) : 0;
+    n->n++;
+
+    while (d-- > 0) {
+	n = path->nodes[d];
+	i = path->pos[d];
+	if (!sib) {
+	    wnode234 *kid = WBRANCH(n)->kids[i];
+	    WBRANCH(n)->counts[i]++;
+	    n->elems[i] = kid->elems[kid->n - 1];
+	    n->keys[i] = kid->keys[kid->n - 1];
+	} else {
+	    wnode234 *newsib = NULL;
+	    wfix234(n, i++);
+	    if (n->n == WIDE234_ORDER) {
+		newsib = wsplitnode234(t, n);
+		if (i > n->n) {
+		    i -= n->n;
+		    n = newsib;
+		}
+	    }
+	    wmove234(n, i + 1, n, i, n->n - i);
+	    WBRANCH(n)->kids[i] = sib;
+	    n->n++;
+	    wfix234(n, i);
+	    sib = newsib;
+	}
+    }
+
+    if (sib) {
+	n = wnewnode234(t, FALSE);
+	WBRANCH(n)->kids[0] = t->wroot;
+	WBRANCH(n)->kids[1] = sib;
+	n->n = 2;
+	wfix234(n, 0);
+	wfix234(n, 1);
+	t->wroot = n;
+    }
+}
+
+static void wide234_insert(tree234 *t, void *e, int index) {
+    wpath234 path;
+
+    if (!t->wroot)
+	t->wroot = wnewnode234(t, TRUE);
+    wdescend234(t, index, TRUE, &path);
+    winsert234(t, &path, e);
+}
+
+/*
+ * Top up an undersized child of a branch, either by merging it
+ * with a neighbour or by sharing entries evenly between the two.
+ */
+static void wrebalance234(tree234 *t, wnode234 *n, int i) {
+    wnode234 *l, *r;
+    int li, total, move;
+
+    assert(n->n >= 2);
+    li = (i > 0 ? i - 1 : i);
+    l = WBRANCH(n)->kids[li];
+    r = WBRANCH(n)->kids[li + 1];
+    total = l->n + r->n;
+
+    if (total <= WIDE234_ORDER) {
+	wmove234(l, l->n, r, 0, r->n);
+	l->n = total;
+	wfreenode234(t, r);
+	wmove234(n, li + 1, n, li + 2, n->n - (li + 2));
+	n->n--;
+	wfix234(n, li);
+    } else if (l->n < total / 2) {
+	move = total / 2 - l->n;
+	wmove234(l, l->n, r, 0, move);
+	wmove234(r, 0, r, move, r->n - move);
+	l->n += move;
+	r->n -= move;
+	wfix234(n, li);
+	wfix234(n, li + 1);
+    } else {
+	move = l->n - total / 2;
+	wmove234(r, move, r, 0, r->n);
+	wmove234(r, 0, l, l->n - move, move);
+	l->n -= move;
+	r->n += move;
+	wfix234(n, li);
+	wfix234(n, li + 1);
+    }
+}
+
+/*
+ * Delete the element at the end of a path, and return it.
+ */
+static void *wdelete234(tree234 *t, wpath234 *path) {
+    wnode234 *n = path->nodes[path->depth];
+    int d = path->depth, i = path->pos[d];
+    void *ret;
+
+    ret = n->elems[i];
+    wmove234(n, i, n, i + 1, n->n - i - 1);
+    n->n--;
+
+    while (d-- > 0) {
+	wnode234 *kid;
+	n = path->nodes[d];
+	i = path->pos[d];
+	kid = WBRANCH(n)->kids[i];
+	if (kid->n < WIDE234_MIN) {
+	    wrebalance234(t, n, i);
+	} else {
+	    WBRANCH(n)->counts[i]--;
+	    n->elems[i] = kid->elems[kid->n - 1];
+	    n->keys[i] = kid->keys[kid->n - 1];
+	}
+    }
+
+    n = t->wroot;
+    while (!n->leaf && n->n == 1) {
+	t->wroot = WBRANCH(n)->kids[0];
+	wfreenode234(t, n);
+	n = t->wroot;
+    }
+    if (n->leaf && n->n == 0) {
+	wfreenode234(t, n);
+	t->wroot = NULL;
+    }
+    return ret;
+}
+
+static void *wide234_delpos(tree234 *t, int index) {
+    wpath234 path;
+
+    if (index < 0 || index >= wcountnode234(t->wroot))
+	return NULL;
+    wdescend234(t, index, FALSE, &path);
+    return wdelete234(t, &path);
+}
+
+static void *wide234_add(tree234 *t, void *e) {
+    wpath234 path;
+    void *found;
+
+    if (!t->wroot) {
+	t->wroot = wnewnode234(t, TRUE);
+	path.depth = 0;
+	path.nodes[0] = t->wroot;
+	path.pos[0] = 0;
+    } else {
+	wsearch234(t, e, NULL, &found, &path);
+	if (found)
+	    return found;
+    }
+    winsert234(t, &path, e);
+    return e;
+}
+
+static void *wide234_del(tree234 *t, void *e) {
+    wpath234 path;
+    void *found;
+
+    if (!t->wroot)
+	return NULL;
+    wsearch234(t, e, NULL, &found, &path);
+    if (!found)
+	return NULL;
+    return wdelete234(t, &path);
+}
+
+/*
+ * Append the elements of a subtree, in order, to an array.
+ */
+static void **wgather234(wnode234 *n, void **out) {
+    int i;
+
+    if (!n)
+	return out;
+    if (n->leaf) {
+	memcpy(out, n->elems, n->n * sizeof(void *));
+	return out + n->n;
+    }
+    for (i = 0; i < n->n; i++)
+	out = wgather234(WBRANCH(n)->kids[i], out);
+    return out;
+}
+
+/*
+ * Build the B+-tree for a sorted array of elements bottom up,
+ * spreading the entries evenly across each level so that no node
+ * but the root is less than half full. Returns the root.
+ */
+static wnode234 *wbuild234(tree234 *t, void **elems, int count) {
+    wnode234 **level, *n;
+    int nnodes, nkids, i, j, k, size;
+
+    if (count == 0)
+	return NULL;
+
+    nnodes = (count + WIDE234_ORDER - 1) / WIDE234_ORDER;
+    level = snewn(nnodes, wnode234 *);
+    for (i = k = 0; i < nnodes; i++) {
+	n = level[i] = wnewnode234(t, TRUE);
+	size = count / nnodes + (i < count % nnodes);
+	for (j = 0; j < size; j++, k++) {
+	    n->elems[j] = elems[k];
+	    n->keys[j] = t->keyfn ? t->keyfn(elems[k]) : 0;
+	}
+	n->n = size;
+    }
+
+    while (nnodes > 1) {
+	nkids = nnodes;
+	nnodes = (nkids + WIDE234_ORDER - 1) / WIDE234_ORDER;
+	for (i = k = 0; i < nnodes; i++) {
+	    n = wnewnode234(t, FALSE);
+	    size = nkids / nnodes + (i < nkids % nnodes);
+	    for (j = 0; j < size; j++, k++) {
+		WBRANCH(n)->kids[j] = level[k];
+		n->n = j + 1;
+		wfix234(n, j);
+	    }
+	    level[i] = n;
+	}
+    }
+
+    n = level[0];
+    sfree(level);
+    return n;
+}
+
+static wnode234 *wcopynode234(tree234 *t, wnode234 *n,
+			      copyfn234 copyfn, void *copyfnstate) {
+    wnode234 *n2 = wnewnode234(t, n->leaf);
+    int i;
+
+    n2->n = n->n;
+    for (i = 0; i < n->n; i++) {
+	if (!n->leaf) {
+	    WBRANCH(n2)->kids[i] = wcopynode234(t, WBRANCH(n)->kids[i],
+						copyfn, copyfnstate);
+	    wfix234(n2, i);
+	} else if (copyfn) {
+	    n2->elems[i] = copyfn(copyfnstate, n->elems[i]);
+	    n2->keys[i] = t->keyfn ? t->keyfn(n2->elems[i]) : 0;
+	} else {
+	    n2->elems[i] = n->elems[i];
+	    n2->keys[i] = n->keys[i];
+	}
+    }
+    return n2;
+}
+
+/*
+ * Splitting and joining wide trees is done by flattening them and
+ * rebuilding, which is linear in the size of the trees rather
+ * than logarithmic. Nothing in the puzzles needs these on a hot
+ * path.
+ */
+static tree234 *wide234_splitpos(tree234 *t, int index, int before) {
+    tree234 *ret;
+    void **elems;
+    int count = wcountnode234(t->wroot);
+
+    if (index < 0 || index > count)
+	return NULL;
+    ret = newtree234_wide(t->cmp, t->keyfn);
+    elems = snewn(count + 1, void *);
+    wgather234(t->wroot, elems);
+    wfreesubtree234(t, t->wroot);
+    if (before) {
+	ret->wroot = wbuild234(ret, elems, index);
+	t->wroot = wbuild234(t, elems + index, count - index);
+    } else {
+	t->wroot = wbuild234(t, elems, index);
+	ret->wroot = wbuild234(ret, elems + index, count - index);
+    }
+    sfree(elems);
+    return ret;
+}
+
+/*
+ * Join t2 on to the right of t1, leaving the result in `to' (one
+ * of the two) and the other one empty.
+ */
+static tree234 *wide234_join(tree234 *t1, tree234 *t2, tree234 *to) {
+    tree234 *from = (to == t1 ? t2 : t1);
+    int count1 = wcountnode234(t1->wroot);
+    int count2 = wcountnode234(t2->wroot);
+    void **elems;
+
+    assert(t1->wide && t2->wide);
+    if (count1 == 0 || count2 == 0) {
+	if (!to->wroot) {
+	    elems = snewn(count1 + count2 + 1, void *);
+	    wgather234(from->wroot, elems);
+	    to->wroot = wbuild234(to, elems, count1 + count2);
+	    wfreesubtree234(from, from->wroot);
+	    from->wroot = NULL;
+	    sfree(elems);
+	}
+	return to;
+    }
+
+    if (to->cmp && to->cmp(wide234_index(t1, count1 - 1),
+			   wide234_index(t2, 0)) >= 0)
+	return NULL;
+
+    elems = snewn(count1 + count2, void *);
+    wgather234(t2->wroot, wgather234(t1->wroot, elems));
+    wfreesubtree234(t1, t1->wroot);
+    wfreesubtree234(t2, t2->wroot);
+    t1->wroot = t2->wroot = NULL;
+    to->wroot = wbuild234(to, elems, count1 + count2);
+    sfree(elems);
+    return to;
+}
+
 /*
  * Create a 2-3-4 tree.
  */
-tree234 *newtree234(cmpfn234 cmp) {
+static tree234 *newtree234_pool(cmpfn234 cmp, pool234 *pool) {
     tree234 *ret = snew(tree234);
     LOG(("created tree %p\n", ret));
     ret->root = NULL;
     ret->cmp = cmp;
+    ret->pool = pool;
+    ret->wide = FALSE;
+    ret->wroot = NULL;
+    ret->keyfn = NULL;
     return ret;
 }
+tree234 *newtree234(cmpfn234 cmp) {
+    return newtree234_pool(cmp, newpool234());
+}
+tree234 *newtree234_shared(cmpfn234 cmp, tree234 *share) {
+    if (share->wide)
+	return newtree234_wide(cmp, cmp == share->cmp ? share->keyfn : NULL);
+    share->pool->refcount++;
+    return newtree234_pool(cmp, share->pool);
+}
+
+tree234 *newtree234_wide(cmpfn234 cmp, keyfn234 keyfn) {
+    tree234 *ret = newtree234_pool(cmp, NULL);
+    ret->wide = TRUE;
+    ret->keyfn = keyfn;
+    ret->wstats.slabs = ret->wstats.nodes = 0;
+    ret->wstats.inuse = ret->wstats.peak = 0;
+    ret->wstats.allocs = ret->wstats.reused = 0;
+    return ret;
+}
+
+void getpoolstats234(tree234 *t, poolstats234 *stats) {
+    *stats = t->wide ? t->wstats : t->pool->stats;
+}
 
 /*
  * Free a 2-3-4 tree (not including freeing the elements).
  */
-static void freenode234(node234 *n) {
+static void freesubtree234(pool234 *p, node234 *n) {
     if (!n)
 	return;
-    freenode234(n->kids[0]);
-    freenode234(n->kids[1]);
-    freenode234(n->kids[2]);
-    freenode234(n->kids[3]);
-    sfree(n);
+    freesubtree234(p, n->kids[0]);
+    freesubtree234(p, n->kids[1]);
+    freesubtree234(p, n->kids[2]);
+    freesubtree234(p, n->kids[3]);
+    freenode234(p, n);
 }
 void freetree234(tree234 *t) {
-    freenode234(t->root);
+    if (t->wide) {
+	wfreesubtree234(t, t->wroot);
+	sfree(t);
+	return;
+    }
+    /*
+     * If nothing else is using our pool, all its slabs can go at
+     * once. Otherwise, hand our nodes back to it one by one.
+     */
+    if (t->pool->refcount > 1)
+	freesubtree234(t->pool, t->root);
+    unrefpool234(t->pool);
     sfree(t);
 }
 
+/*
+ * Move all the nodes of a subtree from one pool into another.
+ */
+static node234 *movesubtree234(pool234 *to, pool234 *from, node234 *n) {
+    node234 *n2;
+    int i;
+
+    if (!n)
+	return NULL;
+    n2 = newnode234(to);
+    *n2 = *n;
+    for (i = 0; i < 4; i++) {
+	n2->kids[i] = movesubtree234(to, from, n->kids[i]);
+	if (n2->kids[i])
+	    n2->kids[i]->parent = n2;
+    }
+    freenode234(from, n);
+    return n2;
+}
+
+/*
+ * Before joining tree `from' on to tree `to', make sure all of
+ * from's nodes are in to's pool. If nothing else is using from's
+ * pool, that's just a matter of handing over its slabs; otherwise
+ * we have to move the nodes individually.
+ */
+static void joinpools234(tree234 *to, tree234 *from) {
+    pool234 *p = to->pool, *q = from->pool;
+    slab234 **tail;
+
+    if (p == q)
+	return;
+
+    if (q->refcount > 1) {
+	from->root = movesubtree234(p, q, from->root);
+	if (from->root)
+	    from->root->parent = NULL;
+	return;
+    }
+
+    for (tail = &q->slabs; *tail; tail = &(*tail)->next)
+	continue;
+    *tail = p->slabs;
+    p->slabs = q->slabs;
+    while (q->nfresh > 0) {
+	q->nfresh--;
+	q->fresh->parent = q->freelist;
+	q->freelist = q->fresh++;
+    }
+    while (q->freelist) {
+	node234 *n = q->freelist;
+	q->freelist = n->parent;
+	n->parent = p->freelist;
+	p->freelist = n;
+    }
+    p->stats.slabs += q->stats.slabs;
+    p->stats.nodes += q->stats.nodes;
+    p->stats.inuse += q->stats.inuse;
+    p->stats.allocs += q->stats.allocs;
+    p->stats.reused += q->stats.reused;
+    if (p->stats.peak < p->stats.inuse)
+	p->stats.peak = p->stats.inuse;
+
+    q->slabs = NULL;
+    unrefpool234(q);
+    p->refcount++;
+    from->pool = p;
+}
+
 /*
  * Internal function to count a node.
  */
@@ -104,6 +970,8 @@ static int countnode234(node234 *n) {
  * Count the elements in a tree.
  */
 int count234(tree234 *t) {
+    if (t->wide)
+	return wcountnode234(t->wroot);
     if (t->root)
 	return countnode234(t->root);
     else
@@ -114,8 +982,8 @@ int count234(tree234 *t) {
  * Propagate a node overflow up a tree until it stops. Returns 0 or
  * 1, depending on whether the root had to be split or not.
  */
-static int add234_insert(node234 *left, void *e, node234 *right,
-			 node234 **root, node234 *n, int ki) {
+static int add234_insert(pool234 *pool, node234 *left, void *e,
+			 node234 *right, node234 **root, node234 *n, int ki) {
     int lcount, rcount;
     /*
      * We need to insert the new left/element/right set in n at
@@ -187,7 +1055,7 @@ static int add234_insert(node234 *left, void *e, node234 *right,
 	    LOG(("  done\n"));
 	    break;
 	} else {
-	    node234 *m = snew(node234);
+	    node234 *m = newnode234(pool);
 	    m->parent = n->parent;
 	    LOG(("  splitting a 4-node; created new node %p\n", m));
 	    /*
@@ -283,7 +1151,7 @@ static int add234_insert(node234 *left, void *e, node234 *right,
 	return 0;		       /* root unchanged */
     } else {
 	LOG(("  root is overloaded, split into two\n"));
-	(*root) = snew(node234);
+	(*root) = newnode234(pool);
 	(*root)->kids[0] = left;     (*root)->counts[0] = lcount;
 	(*root)->elems[0] = e;
 	(*root)->kids[1] = right;    (*root)->counts[1] = rcount;
@@ -314,7 +1182,7 @@ static void *add234_internal(tree234 *t, void *e, int index) {
 
     LOG(("adding element \"%s\" to tree %p\n", e, t));
     if (t->root == NULL) {
-	t->root = snew(node234);
+	t->root = newnode234(t->pool);
 	t->root->elems[1] = t->root->elems[2] = NULL;
 	t->root->kids[0] = t->root->kids[1] = NULL;
 	t->root->kids[2] = t->root->kids[3] = NULL;
@@ -382,7 +1250,7 @@ static void *add234_internal(tree234 *t, void *e, int index) {
 	n = n->kids[ki];
     }
 
-    add234_insert(NULL, e, NULL, &t->root, n, ki);
+    add234_insert(t->pool, NULL, e, NULL, &t->root, n, ki);
 
     return orig_e;
 }
@@ -391,6 +1259,9 @@ void *add234(tree234 *t, void *e) {
     if (!t->cmp)		       /* tree is unsorted */
 	return NULL;
 
+    if (t->wide)
+	return wide234_add(t, e);
+
     return add234_internal(t, e, -1);
 }
 void *addpos234(tree234 *t, void *e, int index) {
@@ -398,6 +1269,13 @@ void *addpos234(tree234 *t, void *e, int index) {
 	t->cmp)			       /* tree is sorted */
 	return NULL;		       /* return failure */
 
+    if (t->wide) {
+	if (index > count234(t))
+	    return NULL;
+	wide234_insert(t, e, index);
+	return e;
+    }
+
     return add234_internal(t, e, index);  /* this checks the upper bound */
 }
 
@@ -408,6 +1286,9 @@ void *addpos234(tree234 *t, void *e, int index) {
 void *index234(tree234 *t, int index) {
     node234 *n;
 
+    if (t->wide)
+	return wide234_index(t, index);
+
     if (!t->root)
 	return NULL;		       /* tree is empty */
 
@@ -451,6 +1332,9 @@ void *findrelpos234(tree234 *t, void *e, cmpfn234 cmp,
     int c;
     int idx, ecount, kcount, cmpret;
 
+    if (t->wide)
+	return wide234_findrelpos(t, e, cmp, relation, index);
+
     if (t->root == NULL)
 	return NULL;
 
@@ -779,7 +1663,8 @@ static void trans234_subtree_left(node234 *n, int ki, int *k, int *index) {
  *   /     \       ->        |
  *  a   b B c C d      a A b B c C d
  */
-static void trans234_subtree_merge(node234 *n, int ki, int *k, int *index) {
+static void trans234_subtree_merge(pool234 *pool, node234 *n, int ki,
+				   int *k, int *index) {
     node234 *left, *right;
     int i, leftlen, rightlen, lsize, rsize;
 
@@ -823,7 +1708,7 @@ static void trans234_subtree_merge(node234 *n, int ki, int *k, int *index) {
 
     n->counts[ki] += rightlen + 1;
 
-    sfree(right);
+    freenode234(pool, right);
 
     /*
      * Move the rest of n up by one.
@@ -950,7 +1835,8 @@ static void *delpos234_internal(tree234 *t, int index) {
 		 * ki is small with only small neighbours. Pick a
 		 * neighbour and merge with it.
 		 */
-		trans234_subtree_merge(n, ki>0 ? ki-1 : ki, &ki, &index);
+		trans234_subtree_merge(t->pool, n, ki>0 ? ki-1 : ki,
+				       &ki, &index);
 		sub = n->kids[ki];
 
 		if (!n->elems[0]) {
@@ -961,7 +1847,7 @@ static void *delpos234_internal(tree234 *t, int index) {
 		    LOG(("  shifting root!\n"));
 		    t->root = sub;
 		    sub->parent = NULL;
-		    sfree(n);
+		    freenode234(t->pool, n);
 		    n = NULL;
 		}
 	    }
@@ -993,19 +1879,23 @@ static void *delpos234_internal(tree234 *t, int index) {
     if (!n->elems[0]) {
 	LOG(("  removed last element in tree, destroying empty root\n"));
 	assert(n == t->root);
-	sfree(n);
+	freenode234(t->pool, n);
 	t->root = NULL;
     }
 
     return retval;		       /* finished! */
 }
 void *delpos234(tree234 *t, int index) {
+    if (t->wide)
+	return wide234_delpos(t, index);
     if (index < 0 || index >= countnode234(t->root))
 	return NULL;
     return delpos234_internal(t, index);
 }
 void *del234(tree234 *t, void *e) {
     int index;
+    if (t->wide)
+	return wide234_del(t, e);
     if (!findrelpos234(t, e, NULL, REL234_EQ, &index))
 	return NULL;		       /* it wasn't in there anyway */
     return delpos234_internal(t, index); /* it's there; delete it. */
@@ -1025,7 +1915,7 @@ void *del234(tree234 *t, void *e) {
  * resulting tree is the same height as the original larger one, or
  * one higher.
  */
-static node234 *join234_internal(node234 *left, void *sep,
+static node234 *join234_internal(pool234 *pool, node234 *left, void *sep,
 				 node234 *right, int *height) {
     node234 *root, *node;
     int relht = *height;
@@ -1040,7 +1930,7 @@ static node234 *join234_internal(node234 *left, void *sep,
 	 * nodes.
 	 */
 	node234 *newroot;
-	newroot = snew(node234);
+	newroot = newnode234(pool);
 	newroot->kids[0] = left;     newroot->counts[0] = countnode234(left);
 	newroot->elems[0] = sep;
 	newroot->kids[1] = right;    newroot->counts[1] = countnode234(right);
@@ -1100,7 +1990,7 @@ static node234 *join234_internal(node234 *left, void *sep,
     /*
      * Now proceed as for addition.
      */
-    *height = add234_insert(left, sep, right, &root, node, ki);
+    *height = add234_insert(pool, left, sep, right, &root, node, ki);
 
     return root;
 }
@@ -1114,7 +2004,12 @@ static int height234(tree234 *t) {
     return level;
 }
 tree234 *join234(tree234 *t1, tree234 *t2) {
-    int size2 = countnode234(t2->root);
+    int size2;
+
+    if (t1->wide || t2->wide)
+	return wide234_join(t1, t2, t1);
+
+    size2 = countnode234(t2->root);
     if (size2 > 0) {
 	void *element;
 	int relht;
@@ -1126,15 +2021,22 @@ tree234 *join234(tree234 *t1, tree234 *t2) {
 		return NULL;
 	}
 
+	joinpools234(t1, t2);
 	element = delpos234(t2, 0);
 	relht = height234(t1) - height234(t2);
-	t1->root = join234_internal(t1->root, element, t2->root, &relht);
+	t1->root = join234_internal(t1->pool, t1->root, element, t2->root,
+				    &relht);
 	t2->root = NULL;
     }
     return t1;
 }
 tree234 *join234r(tree234 *t1, tree234 *t2) {
-    int size1 = countnode234(t1->root);
+    int size1;
+
+    if (t1->wide || t2->wide)
+	return wide234_join(t1, t2, t2);
+
+    size1 = countnode234(t1->root);
     if (size1 > 0) {
 	void *element;
 	int relht;
@@ -1146,9 +2048,11 @@ tree234 *join234r(tree234 *t1, tree234 *t2) {
 		return NULL;
 	}
 
+	joinpools234(t2, t1);
 	element = delpos234(t1, size1-1);
 	relht = height234(t1) - height234(t2);
-	t2->root = join234_internal(t1->root, element, t2->root, &relht);
+	t2->root = join234_internal(t2->pool, t1->root, element, t2->root,
+				    &relht);
 	t1->root = NULL;
     }
     return t2;
@@ -1216,7 +2120,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 	 * new node pointers in halves[0] and halves[1], and go up
 	 * a level.
 	 */
-	sib = snew(node234);
+	sib = newnode234(t->pool);
 	for (i = 0; i < 3; i++) {
 	    if (i+ki < 3 && n->elems[i+ki]) {
 		sib->elems[i] = n->elems[i+ki];
@@ -1289,7 +2193,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 	while (halves[half] && !halves[half]->elems[0]) {
 	    LOG(("  root %p is undersize, throwing away\n", halves[half]));
 	    halves[half] = halves[half]->kids[0];
-	    sfree(halves[half]->parent);
+	    freenode234(t->pool, halves[half]->parent);
 	    halves[half]->parent = NULL;
 	    LOG(("  new root is %p\n", halves[half]));
 	}
@@ -1346,7 +2250,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 		     * Neighbour is small, or possibly neighbour is
 		     * medium and we are undersize.
 		     */
-		    trans234_subtree_merge(n, merge, NULL, NULL);
+		    trans234_subtree_merge(t->pool, n, merge, NULL, NULL);
 		    sub = n->kids[merge];
 		    if (!n->elems[0]) {
 			/*
@@ -1357,7 +2261,7 @@ static node234 *split234_internal(tree234 *t, int index) {
 			LOG(("  shifting root!\n"));
 			halves[half] = sub;
 			halves[half]->parent = NULL;
-			sfree(n);
+			freenode234(t->pool, n);
 		    }
 		} else {
 		    /* Neighbour is big enough to move trees over. */
@@ -1378,10 +2282,13 @@ tree234 *splitpos234(tree234 *t, int index, int before) {
     node234 *n;
     int count;
 
+    if (t->wide)
+	return wide234_splitpos(t, index, before);
+
     count = countnode234(t->root);
     if (index < 0 || index > count)
 	return NULL;		       /* error */
-    ret = newtree234(t->cmp);
+    ret = newtree234_shared(t->cmp, t);
     n = split234_internal(t, index);
     if (before) {
 	/* We want to return the ones before the index. */
@@ -1414,9 +2321,10 @@ tree234 *split234(tree234 *t, void *e, cmpfn234 cmp, int rel) {
     return splitpos234(t, index+1, before);
 }
 
-static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
+static node234 *copynode234(pool234 *pool, node234 *n,
+			    copyfn234 copyfn, void *copyfnstate) {
     int i;
-    node234 *n2 = snew(node234);
+    node234 *n2 = newnode234(pool);
 
     for (i = 0; i < 3; i++) {
 	if (n->elems[i] && copyfn)
@@ -1427,7 +2335,7 @@ static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
 
     for (i = 0; i < 4; i++) {
 	if (n->kids[i]) {
-	    n2->kids[i] = copynode234(n->kids[i], copyfn, copyfnstate);
+	    n2->kids[i] = copynode234(pool, n->kids[i], copyfn, copyfnstate);
 	    n2->kids[i]->parent = n2;
 	} else {
 	    n2->kids[i] = NULL;
@@ -1440,9 +2348,16 @@ static node234 *copynode234(node234 *n, copyfn234 copyfn, void *copyfnstate) {
 tree234 *copytree234(tree234 *t, copyfn234 copyfn, void *copyfnstate) {
     tree234 *t2;
 
+    if (t->wide) {
+	t2 = newtree234_wide(t->cmp, t->keyfn);
+	if (t->wroot)
+	    t2->wroot = wcopynode234(t2, t->wroot, copyfn, copyfnstate);
+	return t2;
+    }
+
     t2 = newtree234(t->cmp);
     if (t->root) {
-	t2->root = copynode234(t->root, copyfn, copyfnstate);
+	t2->root = copynode234(t2->pool, t->root, copyfn, copyfnstate);
 	t2->root->parent = NULL;
     } else
 	t2->root = NULL;
@@ -1450,6 +2365,215 @@ tree234 *copytree234(tree234 *t, copyfn234 copyfn, void *copyfnstate) {
     return t2;
 }
 
+/*
+ * Build a subtree of a given height (counting a leaf as height 1)
+ * from a sorted array of elements, spreading them out as evenly as
+ * possible. `cap' is one more than the most elements a subtree one
+ * level lower can hold, i.e. 4^(height-1); the caller must make
+ * sure n is neither too large nor too small for the height.
+ */
+static node234 *buildsubtree234(pool234 *pool, void **elems, int n,
+				int height, int cap) {
+    node234 *node = newnode234(pool);
+    int i, k, size;
+
+    node->parent = NULL;
+    for (i = 0; i < 4; i++) {
+	node->kids[i] = NULL;
+	node->counts[i] = 0;
+    }
+    for (i = 0; i < 3; i++)
+	node->elems[i] = NULL;
+
+    if (height == 1) {
+	assert(n >= 1 && n <= 3);
+	for (i = 0; i < n; i++)
+	    node->elems[i] = elems[i];
+	return node;
+    }
+
+    /*
+     * Use as few kids as will hold everything, which always leaves
+     * each of them with enough elements to reach the height below.
+     */
+    k = (n + cap) / cap;
+    if (k < 2)
+	k = 2;
+    assert(k <= 4);
+    n -= k - 1;			       /* elements for the kids */
+    for (i = 0; i < k; i++) {
+	size = n / k + (i < n % k);
+	node->kids[i] = buildsubtree234(pool, elems, size, height - 1,
+					cap / 4);
+	node->kids[i]->parent = node;
+	node->counts[i] = size;
+	elems += size;
+	if (i < k - 1)
+	    node->elems[i] = *elems++;
+    }
+    return node;
+}
+
+tree234 *newtree234_from_sorted(cmpfn234 cmp, void **elems, int n) {
+    tree234 *t = newtree234(cmp);
+    int height, cap;
+
+    if (n > 0) {
+	for (height = 1, cap = 1; 4 * cap - 1 < n; height++)
+	    cap *= 4;
+	t->root = buildsubtree234(t->pool, elems, n, height, cap);
+    }
+    return t;
+}
+
+/*
+ * Cursors. In a 2-3-4 tree, the cursor's node and pos identify the
+ * current element as node->elems[pos], and stepping along uses the
+ * parent pointers. In a wide tree, they give the element's leaf
+ * and its position there; moving off the end of a leaf just looks
+ * up the next index from the top again, which is rare enough to be
+ * cheap on average.
+ *
+ * A cursor which has run off either end has a NULL node and an
+ * index of -1 or the tree's size, and stepping it back the other
+ * way returns to the first or last element.
+ */
+void *seek234(tree234 *t, cursor234 *c, int index) {
+    int count = count234(t);
+    int k;
+
+    c->tree = t;
+    c->node = NULL;
+    if (index < 0) {
+	c->index = -1;
+	return NULL;
+    }
+    if (index >= count) {
+	c->index = count;
+	return NULL;
+    }
+    c->index = index;
+
+    if (t->wide) {
+	wnode234 *n = t->wroot;
+	while (!n->leaf) {
+	    for (k = 0; index >= WBRANCH(n)->counts[k]; k++)
+		index -= WBRANCH(n)->counts[k];
+	    n = WBRANCH(n)->kids[k];
+	}
+	c->node = n;
+	c->pos = index;
+	return n->elems[index];
+    } else {
+	node234 *n = t->root;
+	while (1) {
+	    for (k = 0; k < 3 && n->elems[k]; k++) {
+		if (index < n->counts[k])
+		    break;
+		index -= n->counts[k];
+		if (index == 0) {
+		    c->node = n;
+		    c->pos = k;
+		    return n->elems[k];
+		}
+		index--;
+	    }
+	    n = n->kids[k];
+	}
+    }
+}
+
+void *next234(cursor234 *c) {
+    int k;
+
+    if (!c->node)
+	return seek234(c->tree, c, c->index + 1);
+    c->index++;
+    k = c->pos;
+
+    if (c->tree->wide) {
+	wnode234 *n = (wnode234 *)c->node;
+	if (k + 1 < n->n) {
+	    c->pos = k + 1;
+	    return n->elems[k + 1];
+	}
+	return seek234(c->tree, c, c->index);
+    } else {
+	node234 *n = (node234 *)c->node, *p;
+
+	if (n->kids[k+1]) {
+	    n = n->kids[k+1];
+	    while (n->kids[0])
+		n = n->kids[0];
+	    k = 0;
+	} else if (k < 2 && n->elems[k+1]) {
+	    k++;
+	} else {
+	    while (1) {
+		if ((p = n->parent) == NULL) {
+		    c->node = NULL;
+		    return NULL;
+		}
+		for (k = 0; p->kids[k] != n; k++);
+		n = p;
+		if (k < 3 && n->elems[k])
+		    break;
+	    }
+	}
+	c->node = n;
+	c->pos = k;
+	return n->elems[k];
+    }
+}
+
+void *prev234(cursor234 *c) {
+    int k;
+
+    if (!c->node)
+	return seek234(c->tree, c, c->index - 1);
+    c->index--;
+    k = c->pos;
+
+    if (c->tree->wide) {
+	wnode234 *n = (wnode234 *)c->node;
+	if (k > 0) {
+	    c->pos = k - 1;
+	    return n->elems[k - 1];
+	}
+	return seek234(c->tree, c, c->index);
+    } else {
+	node234 *n = (node234 *)c->node, *p;
+
+	if (n->kids[k]) {
+	    n = n->kids[k];
+	    while (1) {
+		for (k = 0; k < 3 && n->elems[k]; k++);
+		if (!n->kids[k])
+		    break;
+		n = n->kids[k];
+	    }
+	    k--;
+	} else if (k > 0) {
+	    k--;
+	} else {
+	    while (1) {
+		if ((p = n->parent) == NULL) {
+		    c->node = NULL;
+		    return NULL;
+		}
+		for (k = 0; p->kids[k] != n; k++);
+		n = p;
+		if (k > 0)
+		    break;
+	    }
+	    k--;
+	}
+	c->node = n;
+	c->pos = k;
+	return n->elems[k];
+    }
+}
+
 #ifdef TEST
 
 /*
@@ -1610,6 +2734,11 @@ void disptree(tree234 *t) {
     int ht = height234(t) * 3 - 2;
     int i;
 
+    if (t->wide) {
+	printf("[wide tree, %d elements]\n", width);
+	return;
+    }
+
     if (!t->root) {
 	printf("[empty tree]\n");
     }
@@ -1745,6 +2874,52 @@ int chknode(chkctx *ctx, int level, node234 *node,
     return count;
 }
 
+/*
+ * Checks for the wide variant:
+ *  - every leaf is at the same depth
+ *  - no node but the root is less than half full, and none is
+ *    empty or overfull
+ *  - subtree element counts are accurate
+ *  - each branch entry records the greatest element of its child
+ *  - stored keys match the key function
+ */
+int chkwnode(chkctx *ctx, tree234 *t, int level, wnode234 *node) {
+    int i, count;
+
+    if (node->n < 1 || node->n > WIDE234_ORDER ||
+	(node != t->wroot && node->n < WIDE234_MIN))
+	error("node %p: has %d entries", node, node->n);
+
+    if (node->leaf) {
+	if (ctx->treedepth < 0)
+	    ctx->treedepth = level;
+	else if (ctx->treedepth != level)
+	    error("node %p: leaf at depth %d, previously seen depth %d",
+		  node, level, ctx->treedepth);
+	for (i = 0; i < node->n; i++)
+	    if (t->keyfn && node->keys[i] != t->keyfn(node->elems[i]))
+		error("node %p elem %d: key is %ld, should be %ld", node, i,
+		      node->keys[i], t->keyfn(node->elems[i]));
+	ctx->elemcount += node->n;
+	return node->n;
+    }
+
+    count = 0;
+    for (i = 0; i < node->n; i++) {
+	wnode234 *kid = WBRANCH(node)->kids[i];
+	int subcount = chkwnode(ctx, t, level+1, kid);
+	if (WBRANCH(node)->counts[i] != subcount)
+	    error("node %p kid %d: count says %d, subtree really has %d",
+		  node, i, WBRANCH(node)->counts[i], subcount);
+	if (node->elems[i] != kid->elems[kid->n - 1] ||
+	    node->keys[i] != kid->keys[kid->n - 1])
+	    error("node %p kid %d: max is %s, should be %s", node, i,
+		  node->elems[i], kid->elems[kid->n - 1]);
+	count += subcount;
+    }
+    return count;
+}
+
 void verifytree(tree234 *tree, void **array, int arraylen) {
     chkctx ctx;
     int i;
@@ -1755,7 +2930,10 @@ void verifytree(tree234 *tree, void **array, int arraylen) {
     /*
      * Verify validity of tree properties.
      */
-    if (tree->root) {
+    if (tree->wide) {
+	if (tree->wroot)
+	    chkwnode(&ctx, tree, 0, tree->wroot);
+    } else if (tree->root) {
 	if (tree->root->parent != NULL)
 	    error("root->parent is %p should be null", tree->root->parent);
         chknode(&ctx, 0, tree->root, NULL, NULL);
@@ -1783,6 +2961,34 @@ void verifytree(tree234 *tree, void **array, int arraylen) {
         error("tree really contains %d elements, count234 gave %d",
 	      ctx.elemcount, i);
     }
+    /*
+     * Walk the tree with a cursor in both directions, starting
+     * from each end and from falling off the other end.
+     */
+    {
+	cursor234 c;
+
+	for (i = 0, p = seek234(tree, &c, 0); p; i++, p = next234(&c))
+	    if (i >= arraylen || array[i] != p || c.index != i)
+		error("cursor at position %d: array says %s, tree says %s",
+		      i, i < arraylen ? array[i] : NULL, p);
+	if (i != arraylen || c.index != arraylen)
+	    error("cursor stopped at %d (index %d), array has %d",
+		  i, c.index, arraylen);
+	for (i = arraylen; (p = prev234(&c)) != NULL; )
+	    if (--i < 0 || array[i] != p || c.index != i)
+		error("reverse cursor at position %d: array says %s, "
+		      "tree says %s", i, i >= 0 ? array[i] : NULL, p);
+	if (i != 0 || c.index != -1)
+	    error("reverse cursor stopped at %d (index %d)", i, c.index);
+	if (arraylen && next234(&c) != array[0])
+	    error("cursor did not come back from before the start");
+	for (i = arraylen, p = seek234(tree, &c, arraylen-1); p;
+	     p = prev234(&c))
+	    if (--i < 0 || array[i] != p)
+		error("reverse cursor at position %d: array says %s, "
+		      "tree says %s", i, i >= 0 ? array[i] : NULL, p);
+    }
 }
 void verify(void) { verifytree(tree, array, arraylen); }
 
@@ -1891,6 +3097,38 @@ int mycmp(void *av, void *bv) {
     return strcmp(a, b);
 }
 
+int qsortcmp(const void *av, const void *bv) {
+    return mycmp(*(void * const *)av, *(void * const *)bv);
+}
+
+/*
+ * A deliberately coarse key function, so that plenty of searches
+ * have to fall back to mycmp to break ties.
+ */
+long mykey(void *av) {
+    return *(unsigned char const *)av >> 2;
+}
+
+/*
+ * Which kind of tree the tests are running on: 0 for a 2-3-4
+ * tree, 1 for a wide tree, 2 for a wide tree with keys.
+ */
+int widetest;
+
+tree234 *newtesttree(cmpfn234 c) {
+    if (!widetest)
+	return newtree234(c);
+    return newtree234_wide(c, widetest > 1 && c ? mykey : NULL);
+}
+
+/*
+ * Something which changes when enough elements are removed from
+ * the end of a tree, so as to test splits on another tree shape.
+ */
+int rootshape(tree234 *t) {
+    return t->wide ? t->wroot->n : !t->root->elems[1];
+}
+
 char *strings[] = {
     "0", "2", "3", "I", "K", "d", "H", "J", "Q", "N", "n", "q", "j", "i",
     "7", "G", "F", "D", "b", "x", "g", "B", "e", "v", "V", "T", "f", "E",
@@ -2018,7 +3256,7 @@ void splittest(tree234 *tree, void **array, int arraylen) {
     }
 }
 
-int main(void) {
+void runtests(void) {
     int in[NSTR];
     int i, j, k;
     int tworoot, tmplen;
@@ -2031,7 +3269,7 @@ int main(void) {
     for (i = 0; i < (int)NSTR; i++) in[i] = 0;
     array = NULL;
     arraylen = arraysize = 0;
-    tree = newtree234(mycmp);
+    tree = newtesttree(mycmp);
     cmp = mycmp;
 
     verify();
@@ -2067,7 +3305,7 @@ int main(void) {
      * completeness we'll use it to tear down our unsorted tree
      * once we've built it.
      */
-    tree = newtree234(NULL);
+    tree = newtesttree(NULL);
     cmp = NULL;
     verify();
     for (i = 0; i < 1000; i++) {
@@ -2090,7 +3328,7 @@ int main(void) {
      * Split tests. Split the tree at every possible point and
      * check the resulting subtrees.
      */
-    tworoot = (!tree2->root->elems[1]);/* see if it has a 2-root */
+    tworoot = rootshape(tree2);	       /* e.g. see if it has a 2-root */
     splittest(tree2, array, arraylen);
     /*
      * Now do the split test again, but on a tree that has a 2-root
@@ -2098,7 +3336,7 @@ int main(void) {
      * did).
      */
     tmplen = arraylen;
-    while ((!tree2->root->elems[1]) == tworoot) {
+    while (rootshape(tree2) == tworoot) {
 	delpos234(tree2, --tmplen);
     }
     printf("now trying splits on second tree\n");
@@ -2121,7 +3359,7 @@ int main(void) {
      * Finally, do some testing on split/join on _sorted_ trees. At
      * the same time, we'll be testing split on very small trees.
      */
-    tree = newtree234(mycmp);
+    tree = newtesttree(mycmp);
     cmp = mycmp;
     arraylen = 0;
     for (i = 0; i < 17; i++) {
@@ -2133,15 +3371,32 @@ int main(void) {
     }
     freetree234(tree);
 
+    /*
+     * Bulk construction from a sorted array, at every size up to
+     * well past the point where the tree needs several levels.
+     */
+    if (!widetest) {
+	void *sorted[NSTR];
+	for (i = 0; i < (int)NSTR; i++)
+	    sorted[i] = strings[i];
+	qsort(sorted, NSTR, sizeof(*sorted), qsortcmp);
+	for (i = 0; i <= (int)NSTR; i++) {
+	    tree = newtree234_from_sorted(mycmp, sorted, i);
+	    printf("bulk build of %d elements\n", i);
+	    verifytree(tree, sorted, i);
+	    freetree234(tree);
+	}
+    }
+
     /*
      * Test silly cases of join: join(emptytree, emptytree), and
      * also ensure join correctly spots when sorted trees fail the
      * ordering constraint.
      */
-    tree = newtree234(mycmp);
-    tree2 = newtree234(mycmp);
-    tree3 = newtree234(mycmp);
-    tree4 = newtree234(mycmp);
+    tree = newtesttree(mycmp);
+    tree2 = newtesttree(mycmp);
+    tree3 = newtesttree(mycmp);
+    tree4 = newtesttree(mycmp);
     assert(mycmp(strings[0], strings[1]) < 0);   /* just in case :-) */
     add234(tree2, strings[1]);
     add234(tree4, strings[0]);
@@ -2183,7 +3438,50 @@ int main(void) {
     assert(tree3 == join234(tree3, tree));
     verifytree(tree3, array, 2);
     verifytree(tree, array, 0);
+    freetree234(tree);
+    freetree234(tree2);
+    freetree234(tree3);
+    freetree234(tree4);
+
+    /*
+     * Join a tree whose node pool is shared with another live tree
+     * on to one with a pool of its own, which means moving its
+     * nodes over individually, and check all three trees survive.
+     */
+    {
+	void *expected[40];
+	poolstats234 stats;
+
+	tree = newtesttree(NULL);
+	tree2 = newtesttree(NULL);
+	tree3 = newtree234_shared(NULL, tree2);
+	cmp = NULL;
+	for (i = 0; i < 40; i++) {
+	    expected[i] = strings[i];
+	    addpos234(i < 20 ? tree : tree2, strings[i], i % 20);
+	}
+	for (i = 0; i < 5; i++)
+	    addpos234(tree3, strings[i], i);
+	assert(tree == join234(tree, tree2));
+	verifytree(tree, expected, 40);
+	verifytree(tree2, expected, 0);
+	verifytree(tree3, expected, 5);
+	getpoolstats234(tree, &stats);
+	printf("pool: %d slabs, %d nodes, %d in use, peak %d, "
+	       "%ld allocs, %ld reused\n", stats.slabs, stats.nodes,
+	       stats.inuse, stats.peak, stats.allocs, stats.reused);
+	freetree234(tree2);
+	verifytree(tree3, expected, 5);
+	freetree234(tree3);
+	freetree234(tree);
+    }
+}
 
+int main(void) {
+    for (widetest = 0; widetest < 3; widetest++) {
+	runtests();
+	sfree(array);
+    }
     return 0;
 }
 
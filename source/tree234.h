@@ -37,6 +37,8 @@ typedef int (*cmpfn234)(void *, void *);
 
 typedef void *(*copyfn234)(void *state, void *element);
 
+typedef long (*keyfn234)(void *element);
+
 /*
  * Create a 2-3-4 tree. If `cmp' is NULL, the tree is unsorted, and
  * lookups by key will fail: you can only look things up by numeric
@@ -44,11 +46,55 @@ typedef void *(*copyfn234)(void *state, void *element);
  */
 tree234 *newtree234(cmpfn234 cmp);
 
+/*
+ * Create a 2-3-4 tree which allocates its nodes from the same pool
+ * as an existing one. Nodes freed by either tree can then be
+ * reused by the other, and the pool's memory is only released when
+ * the last tree using it is freed. (A tree with a pool to itself,
+ * as made by newtree234, can be freed without visiting its nodes.)
+ */
+tree234 *newtree234_shared(cmpfn234 cmp, tree234 *share);
+
+/*
+ * Create a tree which stores its elements in a wide-fanout B+-tree
+ * instead of a 2-3-4 tree. It supports the same operations, but
+ * each node spans a few cache lines, so lookups visit far fewer
+ * nodes; splitting and joining such trees takes linear time.
+ *
+ * If `keyfn' is non-NULL, it maps each element to an integer key
+ * which is stored alongside it, and searches compare these keys
+ * before resorting to `cmp'. The keys must be consistent with cmp:
+ * if key(a) < key(b) then cmp(a,b) must be negative. Elements
+ * with equal keys are ordered by cmp. The keys are only used by
+ * searches which use the tree's own compare function.
+ */
+tree234 *newtree234_wide(cmpfn234 cmp, keyfn234 keyfn);
+
+/*
+ * Create a 2-3-4 tree containing n elements from an array, in
+ * linear time. If `cmp' is non-NULL, the array must already be
+ * sorted according to it, with no two elements comparing equal.
+ */
+tree234 *newtree234_from_sorted(cmpfn234 cmp, void **elems, int n);
+
 /*
  * Free a 2-3-4 tree (not including freeing the elements).
  */
 void freetree234(tree234 *t);
 
+/*
+ * Retrieve node allocation statistics for the pool a tree uses.
+ */
+typedef struct {
+    int slabs;			       /* blocks of nodes malloced */
+    int nodes;			       /* total nodes in those blocks */
+    int inuse;			       /* nodes currently in trees */
+    int peak;			       /* most nodes ever in use at once */
+    long allocs;		       /* node allocations made */
+    long reused;		       /* ... of which were recycled nodes */
+} poolstats234;
+void getpoolstats234(tree234 *t, poolstats234 *stats);
+
 /*
  * Add an element e to a sorted 2-3-4 tree t. Returns e on success,
  * or if an existing element compares equal, returns that.
@@ -85,6 +131,34 @@ void *addpos234(tree234 *t, void *e, int index);
  */
 void *index234(tree234 *t, int index);
 
+/*
+ * Step through the elements of a tree in order using a cursor.
+ * seek234 points the cursor at a given index and returns the
+ * element there; next234 and prev234 move it one element forward
+ * or back and return the new element. All three return NULL when
+ * the cursor goes off either end of the tree, and stepping back
+ * from there returns to the first or last element. The index of
+ * the current element is kept in the cursor's `index' field.
+ *
+ * Each step takes constant time on average, so this is a cheaper
+ * way to walk a tree than calling index234 on each index in turn:
+ *
+ *   cursor234 c;
+ *   for (p = seek234(tree, &c, 0); p; p = next234(&c)) consume(p);
+ *
+ * Cursors can be copied freely, but any change to the tree they
+ * point into invalidates them.
+ */
+typedef struct {
+    tree234 *tree;
+    void *node;
+    int pos;
+    int index;
+} cursor234;
+void *seek234(tree234 *t, cursor234 *c, int index);
+void *next234(cursor234 *c);
+void *prev234(cursor234 *c);
+
 /*
  * Find an element e in a sorted 2-3-4 tree t. Returns NULL if not
  * found. e is always passed as the first argument to cmp, so cmp
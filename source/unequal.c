@@ -57,6 +57,7 @@ enum {
 
 struct game_params {
     int order, diff;
+    int uniform;          /* generate with latin_generate_mcmc() */
 };
 
 #define F_IMMUTABLE     1       /* passed in as game description */
@@ -167,6 +168,7 @@ static void decode_params(game_params *ret, char const *string)
         int i;
         p++;
         ret->diff = DIFFCOUNT+1; /* ...which is invalid */
+        ret->uniform = FALSE;
         if (*p) {
             for (i = 0; i < DIFFCOUNT; i++) {
                 if (*p == unequal_diffchars[i])
@@ -174,6 +176,10 @@ static void decode_params(game_params *ret, char const *string)
             }
             p++;
         }
+        if (*p == 'u') {
+            ret->uniform = TRUE;
+            p++;
+        }
     }
 }
 
@@ -183,7 +189,8 @@ static char *encode_params(game_params *params, int full)
 
     sprintf(ret, "%d", params->order);
     if (full)
-        sprintf(ret + strlen(ret), "d%c", unequal_diffchars[params->diff]);
+        sprintf(ret + strlen(ret), "d%c%s", unequal_diffchars[params->diff],
+                params->uniform ? "u" : "");
 
     return dupstr(ret);
 }
@@ -193,7 +200,7 @@ static config_item *game_configure(game_params *params)
     config_item *ret;
     char buf[80];
 
-    ret = snewn(3, config_item);
+    ret = snewn(4, config_item);
 
     ret[0].name = "Size (s*s)";
     ret[0].type = C_STRING;
@@ -206,10 +213,15 @@ static config_item *game_configure(game_params *params)
     ret[1].sval = DIFFCONFIG;
     ret[1].ival = params->diff;
 
-    ret[2].name = NULL;
-    ret[2].type = C_END;
+    ret[2].name = "Uniformly random grids";
+    ret[2].type = C_BOOLEAN;
     ret[2].sval = NULL;
-    ret[2].ival = 0;
+    ret[2].ival = params->uniform;
+
+    ret[3].name = NULL;
+    ret[3].type = C_END;
+    ret[3].sval = NULL;
+    ret[3].ival = 0;
 
     return ret;
 }
@@ -220,6 +232,7 @@ static game_params *custom_params(config_item *cfg)
 
     ret->order = atoi(cfg[0].sval);
     ret->diff = cfg[1].ival;
+    ret->uniform = cfg[2].ival;
 
     return ret;
 }
@@ -492,8 +505,13 @@ static void solver_debug(game_solver *solver, int wide)
     if (solver_show_working) {
         if (!wide)
             game_debug(solver->state);
-        else
-            latin_solver_debug(solver->latin.cube, solver->latin.o);
+        else {
+            int o = solver->latin.o;
+            unsigned char *cube = snewn(o*o*o, unsigned char);
+            latin_solver_get_cube(&solver->latin, cube);
+            latin_solver_debug(cube, o);
+            sfree(cube);
+        }
     }
 #endif
 }
@@ -551,21 +569,21 @@ static void free_solver(game_solver *solver)
 
 static void solver_nminmax(game_solver *usolver,
                            int x, int y, int *min_r, int *max_r,
-                           unsigned char **ns_r)
+                           bitword *ns_r)
 {
     struct latin_solver *solver = &usolver->latin;
     int o = usolver->latin.o, min = o, max = 0, n;
-    unsigned char *ns;
+    bitword ns;
 
     assert(x >= 0 && y >= 0 && x < o && y < o);
 
-    ns = solver->cube + cubepos(x,y,1);
+    ns = solver->cube[x*o+y];
 
     if (grid(x,y) > 0) {
         min = max = grid(x,y)-1;
     } else {
         for (n = 0; n < o; n++) {
-            if (ns[n]) {
+            if ((ns >> n) & 1) {
                 if (n > max) max = n;
                 if (n < min) min = n;
             }
@@ -579,7 +597,7 @@ static void solver_nminmax(game_solver *usolver,
 static int solver_links(game_solver *usolver)
 {
     int i, j, lmin, gmax, nchanged = 0;
-    unsigned char *gns, *lns;
+    bitword gns, lns;
     struct solver_link *link;
     struct latin_solver *solver = &usolver->latin;
 
@@ -591,7 +609,7 @@ static int solver_links(game_solver *usolver)
         for (j = 0; j < solver->o; j++) {
             /* For the 'greater' end of the link, discount all numbers
              * too small to satisfy the inequality. */
-            if (gns[j]) {
+            if ((gns >> j) & 1) {
                 if (j < (lmin+link->len)) {
 #ifdef STANDALONE_SOLVER
                     if (solver_show_working) {
@@ -603,13 +621,13 @@ static int solver_links(game_solver *usolver)
                                j+1, link->gx, link->gy);
                     }
 #endif
-                    cube(link->gx, link->gy, j+1) = FALSE;
+                    latin_solver_rule_out(solver, link->gx, link->gy, j+1);
                     nchanged++;
                 }
             }
             /* For the 'lesser' end of the link, discount all numbers
              * too large to satisfy inequality. */
-            if (lns[j]) {
+            if ((lns >> j) & 1) {
                 if (j > (gmax-link->len)) {
 #ifdef STANDALONE_SOLVER
                     if (solver_show_working) {
@@ -621,7 +639,7 @@ static int solver_links(game_solver *usolver)
                                j+1, link->lx, link->ly);
                     }
 #endif
-                    cube(link->lx, link->ly, j+1) = FALSE;
+                    latin_solver_rule_out(solver, link->lx, link->ly, j+1);
                     nchanged++;
                 }
             }
@@ -742,7 +760,7 @@ got_result:
 #endif
 
     latin_solver_free_scratch(scratch);
-    memcpy(state->hints, solver->latin.cube, o*o*o);
+    latin_solver_get_cube(&solver->latin, state->hints);
     free_solver(solver);
 
     return diff;
@@ -1030,7 +1048,11 @@ generate:
                unequal_diffnames[params->diff], ntries);
 #endif
     if (sq) sfree(sq);
-    sq = latin_generate(params->order, rs);
+    if (params->uniform)
+        /* Uniformly distributed squares, at several times the cost. */
+        sq = latin_generate_mcmc(params->order, rs, 0);
+    else
+        sq = latin_generate(params->order, rs);
     latin_debug(sq, params->order);
     /* Separately shuffle the numeric and inequality clues */
     shuffle(scratch, lscratch/5, sizeof(int), rs);
@@ -1757,11 +1779,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILE_SIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    NULL,				       /* redraw_region */
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,
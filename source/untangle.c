@@ -492,6 +492,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
     point *pts, *pts2;
     long *tmp;
     tree234 *edges, *vertices;
+    cursor234 c, c2;
     edge *e, *e2;
     vertex *v, *vs, *vlist;
     char *ret;
@@ -526,20 +527,24 @@ static char *new_game_desc(game_params *params, random_state *rs,
      *  (c) does not intersect any actual point.
      */
     vs = snewn(n, vertex);
-    vertices = newtree234(vertcmp);
-    for (i = 0; i < n; i++) {
-	v = vs + i;
-	v->param = 0;		       /* in this tree, param is the degree */
-	v->vindex = i;
-	add234(vertices, v);
+    vlist = snewn(n, vertex);
+    {
+	void **sorted = snewn(n, void *);
+	for (i = 0; i < n; i++) {
+	    v = vs + i;
+	    v->param = 0;	       /* in this tree, param is the degree */
+	    v->vindex = i;
+	    sorted[i] = v;
+	}
+	vertices = newtree234_from_sorted(vertcmp, sorted, n);
+	sfree(sorted);
     }
     edges = newtree234(edgecmp);
-    vlist = snewn(n, vertex);
     while (1) {
 	int added = FALSE;
 
-	for (i = 0; i < n; i++) {
-	    v = index234(vertices, i);
+	for (i = 0, v = seek234(vertices, &c, 0); i < n;
+	     i++, v = next234(&c)) {
 	    j = v->vindex;
 
 	    if (v->param >= MAXDEGREE)
@@ -554,8 +559,9 @@ static char *new_game_desc(game_params *params, random_state *rs,
 	     * have an edge.
 	     */
 	    m = 0;
+	    c2 = c;
 	    for (k = i+1; k < n; k++) {
-		vertex *kv = index234(vertices, k);
+		vertex *kv = next234(&c2);
 		int ki = kv->vindex;
 		int dx, dy;
 
@@ -585,7 +591,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
 			break;
 		if (p < n)
 		    continue;
-		for (p = 0; (e = index234(edges, p)) != NULL; p++)
+		for (e = seek234(edges, &c2, 0); e; e = next234(&c2))
 		    if (e->a != ki && e->a != j &&
 			e->b != ki && e->b != j &&
 			cross(pts[ki], pts[j], pts[e->a], pts[e->b]))
@@ -628,8 +634,9 @@ static char *new_game_desc(game_params *params, random_state *rs,
     make_circle(pts2, n, w);
     while (1) {
 	shuffle(tmp, n, sizeof(*tmp), rs);
-	for (i = 0; (e = index234(edges, i)) != NULL; i++) {
-	    for (j = i+1; (e2 = index234(edges, j)) != NULL; j++) {
+	for (e = seek234(edges, &c, 0); e; e = next234(&c)) {
+	    c2 = c;
+	    for (e2 = next234(&c2); e2; e2 = next234(&c2)) {
 		if (e2->a == e->a || e2->a == e->b ||
 		    e2->b == e->a || e2->b == e->b)
 		    continue;
@@ -660,7 +667,7 @@ static char *new_game_desc(game_params *params, random_state *rs,
 	retlen = 0;
 	m = count234(edges);
 	ea = snewn(m, edge);
-	for (i = 0; (e = index234(edges, i)) != NULL; i++) {
+	for (i = 0, e = seek234(edges, &c, 0); e; i++, e = next234(&c)) {
 	    assert(i < m);
 	    ea[i].a = min(tmp[e->a], tmp[e->b]);
 	    ea[i].b = max(tmp[e->a], tmp[e->b]);
@@ -756,20 +763,25 @@ static char *validate_desc(game_params *params, char *desc)
 static void mark_crossings(game_state *state)
 {
     int ok = TRUE;
-    int i, j;
+    cursor234 c, c2;
     edge *e, *e2;
 
 #ifdef SHOW_CROSSINGS
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++)
-	state->crosses[i] = FALSE;
+    {
+	int i;
+	for (i = 0; i < count234(state->graph->edges); i++)
+	    state->crosses[i] = FALSE;
+    }
 #endif
 
     /*
      * Check correctness: for every pair of edges, see whether they
-     * cross.
+     * cross. Stepping cursors along the edge list keeps this
+     * quadratic rather than picking up an extra log factor.
      */
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++) {
-	for (j = i+1; (e2 = index234(state->graph->edges, j)) != NULL; j++) {
+    for (e = seek234(state->graph->edges, &c, 0); e; e = next234(&c)) {
+	c2 = c;
+	for (e2 = next234(&c2); e2; e2 = next234(&c2)) {
 	    if (e2->a == e->a || e2->a == e->b ||
 		e2->b == e->a || e2->b == e->b)
 		continue;
@@ -777,7 +789,7 @@ static void mark_crossings(game_state *state)
 		      state->pts[e->a], state->pts[e->b])) {
 		ok = FALSE;
 #ifdef SHOW_CROSSINGS
-		state->crosses[i] = state->crosses[j] = TRUE;
+		state->crosses[c.index] = state->crosses[c2.index] = TRUE;
 #else
 		goto done;	       /* multi-level break - sorry */
 #endif
@@ -1332,6 +1344,7 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
 {
     int w, h;
     edge *e;
+    cursor234 c;
     int i, j;
     int bg, points_moved;
 
@@ -1392,10 +1405,10 @@ static void game_redraw(drawing *dr, game_drawstate *ds, game_state *oldstate,
      * Draw the edges.
      */
 
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++) {
+    for (e = seek234(state->graph->edges, &c, 0); e; e = next234(&c)) {
 	draw_line(dr, ds->x[e->a], ds->y[e->a], ds->x[e->b], ds->y[e->b],
 #ifdef SHOW_CROSSINGS
-		  (oldstate?oldstate:state)->crosses[i] ?
+		  (oldstate?oldstate:state)->crosses[c.index] ?
 		  COL_CROSSEDLINE :
 #endif
 		  COL_LINE);
@@ -1500,11 +1513,13 @@ const struct game thegame = {
     game_changed_state,
     interpret_move,
     execute_move,
+    NULL, NULL,			       /* encode_state, decode_state */
     PREFERRED_TILESIZE, game_compute_size, game_set_size,
     game_colours,
     game_new_drawstate,
     game_free_drawstate,
     game_redraw,
+    NULL,				       /* redraw_region */
     game_anim_length,
     game_flash_length,
     FALSE, FALSE, NULL, NULL,